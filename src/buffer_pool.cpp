@@ -0,0 +1,133 @@
+#include "buffer_pool.h"
+#include "cell_buffer.h"
+
+#include <cstring>
+
+namespace influence_map {
+    
+    const size_t BufferPool::DEFAULT_MAX_SPARE_BYTES;
+    const size_t BufferPool::MIN_CLASS_BYTES;
+    const size_t BufferPool::CLASSES_PER_DOUBLING;
+    
+    BufferPool::BufferPool(const size_t max_spare_bytes) :
+        _max_spare_bytes(max_spare_bytes),
+        _num_spare_buffers(0),
+        _spare_bytes(0)
+    {
+    }
+    
+    BufferPool::~BufferPool()
+    {
+        trim();
+    }
+    
+    void* BufferPool::allocate(const size_t bytes)
+    {
+        const size_t buffer_class = size_class(bytes);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (buffer_class < _spare.size() && !_spare[buffer_class].empty()) {
+                void * const buffer = _spare[buffer_class].back();
+                _spare[buffer_class].pop_back();
+                _num_spare_buffers--;
+                _spare_bytes -= size_of_class(buffer_class);
+                
+                // Only what was asked for has to come back zeroed.
+                memset(buffer, 0, bytes);
+                return buffer;
+            }
+        }
+        
+        return detail::allocate_zeroed(size_of_class(buffer_class));
+    }
+    
+    void BufferPool::release(void * const buffer, const size_t bytes)
+    {
+        if (!buffer) {
+            return;
+        }
+        
+        const size_t buffer_class = size_class(bytes);
+        const size_t buffer_bytes = size_of_class(buffer_class);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_spare_bytes + buffer_bytes <= _max_spare_bytes) {
+                if (buffer_class >= _spare.size()) {
+                    _spare.resize(buffer_class + 1);
+                }
+                _spare[buffer_class].push_back(buffer);
+                _num_spare_buffers++;
+                _spare_bytes += buffer_bytes;
+                return;
+            }
+        }
+        
+        detail::free_cells(buffer);
+    }
+    
+    void BufferPool::trim()
+    {
+        std::vector<std::vector<void*> > spare;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            spare.swap(_spare);
+            _num_spare_buffers = 0;
+            _spare_bytes = 0;
+        }
+        
+        for (size_t c = 0; c < spare.size(); c++) {
+            for (size_t i = 0; i < spare[c].size(); i++) {
+                detail::free_cells(spare[c][i]);
+            }
+        }
+    }
+    
+    size_t BufferPool::num_spare_buffers() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _num_spare_buffers;
+    }
+    
+    size_t BufferPool::spare_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _spare_bytes;
+    }
+    
+    size_t BufferPool::class_bytes(const size_t bytes)
+    {
+        return size_of_class(size_class(bytes));
+    }
+    
+    size_t BufferPool::size_class(const size_t bytes)
+    {
+        // Class 0 holds up to MIN_CLASS_BYTES. Past that, each doubling from
+        // base to 2 * base is split into CLASSES_PER_DOUBLING even steps.
+        if (bytes <= MIN_CLASS_BYTES) {
+            return 0;
+        }
+        
+        size_t base = MIN_CLASS_BYTES;
+        size_t first_class = 1;
+        while (base < bytes / 2 + bytes % 2) {
+            base *= 2;
+            first_class += CLASSES_PER_DOUBLING;
+        }
+        
+        const size_t step = base / CLASSES_PER_DOUBLING;
+        return first_class + (bytes - base - 1) / step;
+    }
+    
+    size_t BufferPool::size_of_class(const size_t size_class)
+    {
+        if (size_class == 0) {
+            return MIN_CLASS_BYTES;
+        }
+        
+        const size_t doublings = (size_class - 1) / CLASSES_PER_DOUBLING;
+        const size_t steps = (size_class - 1) % CLASSES_PER_DOUBLING + 1;
+        const size_t base = MIN_CLASS_BYTES << doublings;
+        return base + steps * (base / CLASSES_PER_DOUBLING);
+    }
+
+} // namespace influence_map
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace influence_map {
+    
+    /**
+     * Keeps the cell buffers of maps that go away for the next maps made, so
+     * that making and dropping maps over and over stops going to the heap.
+     * Give the same pool to maps of about the same size: buffers are sorted
+     * into size classes a quarter of a power of two apart, and any buffer of a
+     * class serves any request that rounds up to it.
+     *
+     * A pool must outlive the maps using it. Maps on different threads may
+     * share one.
+     */
+    class BufferPool
+    {
+    public:
+        /**
+         * Buffers released while max_spare_bytes are already kept are freed
+         * instead.
+         */
+        explicit BufferPool(const size_t max_spare_bytes = DEFAULT_MAX_SPARE_BYTES);
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+        ~BufferPool();
+        
+        static const size_t DEFAULT_MAX_SPARE_BYTES = 64 * 1024 * 1024;
+        
+        /**
+         * bytes zeroed bytes starting on a cache line boundary, reused if a
+         * spare buffer of their size class is kept. Returns nullptr if the
+         * allocation fails.
+         */
+        void* allocate(const size_t bytes);
+        
+        /**
+         * Hands back a buffer from allocate() of the same bytes.
+         */
+        void release(void * const buffer, const size_t bytes);
+        
+        /**
+         * Frees every spare buffer.
+         */
+        void trim();
+        
+        size_t num_spare_buffers() const;
+        size_t spare_bytes() const;
+        
+        /**
+         * The bytes allocated for a request of bytes.
+         */
+        static size_t class_bytes(const size_t bytes);
+    
+    private:
+        static const size_t MIN_CLASS_BYTES = 256;
+        static const size_t CLASSES_PER_DOUBLING = 4;
+        
+        const size_t _max_spare_bytes;
+        
+        mutable std::mutex _mutex;
+        
+        // Guarded by _mutex. The spare buffers of each size class.
+        std::vector<std::vector<void*> > _spare;
+        size_t _num_spare_buffers;
+        size_t _spare_bytes;
+        
+        static size_t size_class(const size_t bytes);
+        static size_t size_of_class(const size_t size_class);
+    };
+
+} // namespace influence_map
@@ -0,0 +1,202 @@
+#include "cell_buffer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace influence_map {
+    
+    namespace {
+        
+        // Sits just in front of the cells, so free_cells() knows where they
+        // came from.
+        struct BlockHeader
+        {
+            void* block;
+            
+            // Zero for blocks from malloc.
+            size_t mapped_bytes;
+        };
+        
+        BlockHeader& header(const void * const cells)
+        {
+            return reinterpret_cast<BlockHeader*>(const_cast<void*>(cells))[-1];
+        }
+        
+        bool parse_huge_pages(const char * const name, HugePages& huge_pages)
+        {
+            const HugePages settings[] = { HugePagesOff, HugePagesTransparent, HugePagesReserved };
+            for (size_t i = 0; i < sizeof(settings) / sizeof(settings[0]); i++) {
+                if (strcmp(name, huge_pages_name(settings[i])) == 0) {
+                    huge_pages = settings[i];
+                    return true;
+                }
+            }
+            return false;
+        }
+        
+        HugePages initial_huge_pages()
+        {
+            HugePages huge_pages = HugePagesTransparent;
+            
+            const char * const requested = getenv("CCINFLUENCE_HUGE_PAGES");
+            if (requested) {
+                parse_huge_pages(requested, huge_pages);
+            }
+            
+            return huge_pages;
+        }
+        
+        std::atomic<int>& huge_pages_setting()
+        {
+            static std::atomic<int> setting(initial_huge_pages());
+            return setting;
+        }
+
+#if defined(__linux__)
+        // Buffers on huge pages would otherwise all start at the same offset
+        // into physically contiguous 2 MB, where the rows a step reads and
+        // writes land on the same cache sets. Each one starts a few pages and
+        // a cache line further in than the last, round NUM_COLOURS offsets.
+        static const size_t NUM_COLOURS = 8;
+        static const size_t COLOUR_BYTES = 4096 + detail::CACHE_LINE_BYTES;
+        std::atomic<size_t> next_colour(0);
+        
+        void* place_cells(void * const block, const size_t mapped_bytes, const size_t colour)
+        {
+            // The header takes the cache line before the cells.
+            void * const cells = static_cast<char*>(block) + detail::CACHE_LINE_BYTES + colour * COLOUR_BYTES;
+            header(cells).block = block;
+            header(cells).mapped_bytes = mapped_bytes;
+            return cells;
+        }
+        
+        void* map_cells(const size_t bytes, const HugePages huge_pages)
+        {
+            // Fresh mappings are already zeroed, so nothing touches the pages
+            // until the cells are first written.
+            const size_t colour = next_colour++ % NUM_COLOURS;
+            const size_t huge_page = detail::HUGE_PAGE_BYTES;
+            const size_t length = (bytes + detail::CACHE_LINE_BYTES + colour * COLOUR_BYTES + huge_page - 1) / huge_page * huge_page;
+            const int protection = PROT_READ | PROT_WRITE;
+
+#ifdef MAP_HUGETLB
+            if (huge_pages == HugePagesReserved) {
+                int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_2MB
+                flags |= MAP_HUGE_2MB;
+#endif
+                void * const block = mmap(nullptr, length, protection, flags, -1, 0);
+                if (block != MAP_FAILED) {
+                    return place_cells(block, length, colour);
+                }
+            }
+#endif
+            
+            // Transparent huge pages only back whole aligned 2 MB ranges, so
+            // map one huge page more than needed and trim either end back to
+            // a boundary.
+            void * const mapped = mmap(nullptr, length + huge_page, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mapped == MAP_FAILED) {
+                return nullptr;
+            }
+            
+            const uintptr_t start = reinterpret_cast<uintptr_t>(mapped);
+            const uintptr_t aligned = (start + huge_page - 1) & ~uintptr_t(huge_page - 1);
+            const size_t head = aligned - start;
+            if (head > 0) {
+                munmap(mapped, head);
+            }
+            munmap(reinterpret_cast<void*>(aligned + length), huge_page - head);
+            
+            void * const block = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+            // Turned down when huge pages are off system wide, which leaves
+            // ordinary pages.
+            madvise(block, length, MADV_HUGEPAGE);
+#endif
+            return place_cells(block, length, colour);
+        }
+#endif
+    
+    } // namespace
+    
+    HugePages huge_pages()
+    {
+        return HugePages(huge_pages_setting().load());
+    }
+    
+    void set_huge_pages(const HugePages huge_pages)
+    {
+        huge_pages_setting().store(huge_pages);
+    }
+    
+    const char* huge_pages_name(const HugePages huge_pages)
+    {
+        switch (huge_pages) {
+            case HugePagesOff:         return "off";
+            case HugePagesTransparent: return "transparent";
+            case HugePagesReserved:    return "reserved";
+        }
+        return "unknown";
+    }
+
+namespace detail {
+    
+    void* allocate_zeroed(const size_t bytes)
+    {
+#if defined(__linux__)
+        const HugePages setting = huge_pages();
+        if (setting != HugePagesOff && bytes >= MIN_HUGE_PAGE_BUFFER_BYTES) {
+            void * const cells = map_cells(bytes, setting);
+            if (cells) {
+                return cells;
+            }
+        }
+#endif
+        
+        // Over-allocate so the block can be aligned, and keep the pointer
+        // malloc gave us just in front of it for free_cells().
+        void * const block = malloc(bytes + CACHE_LINE_BYTES + sizeof(BlockHeader));
+        if (!block) {
+            return nullptr;
+        }
+        
+        const uintptr_t first = reinterpret_cast<uintptr_t>(block) + sizeof(BlockHeader);
+        const uintptr_t aligned = (first + CACHE_LINE_BYTES - 1) & ~uintptr_t(CACHE_LINE_BYTES - 1);
+        void * const cells = reinterpret_cast<void*>(aligned);
+        header(cells).block = block;
+        header(cells).mapped_bytes = 0;
+        
+        memset(cells, 0, bytes);
+        return cells;
+    }
+    
+    void free_cells(void * const cells)
+    {
+        if (!cells) {
+            return;
+        }
+        
+        const BlockHeader block = header(cells);
+#if defined(__linux__)
+        if (block.mapped_bytes > 0) {
+            munmap(block.block, block.mapped_bytes);
+            return;
+        }
+#endif
+        free(block.block);
+    }
+    
+    size_t mapped_bytes(const void * const cells)
+    {
+        return header(cells).mapped_bytes;
+    }
+
+} // namespace detail
+} // namespace influence_map
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+
+namespace influence_map {
+    
+    /**
+     * How buffers of at least two huge pages are backed, maps' cells included.
+     * Walking a big map a few rows at a time touches a new 4 KB page every few
+     * hundred cells, which with ordinary pages soon outruns the TLB.
+     *
+     * Huge pages are only asked for on Linux. Elsewhere, and whenever the
+     * kernel turns them down, buffers fall back to ordinary pages.
+     */
+    enum HugePages {
+        // From the heap, as small buffers always are.
+        HugePagesOff         = 0,
+        
+        // Mapped on 2 MB boundaries with madvise(MADV_HUGEPAGE), for the
+        // kernel to back with transparent huge pages as it can.
+        HugePagesTransparent = 1,
+        
+        // From the kernel's reserved 2 MB pages with MAP_HUGETLB, falling back
+        // to transparent huge pages when none are free.
+        HugePagesReserved    = 2
+    };
+    
+    /**
+     * The current setting. On first use this is HugePagesTransparent, or the
+     * one named by the CCINFLUENCE_HUGE_PAGES environment variable if that is
+     * set to one of "off", "transparent" or "reserved".
+     */
+    HugePages huge_pages();
+    
+    /**
+     * Changes how buffers allocated from now on are backed.
+     */
+    void set_huge_pages(const HugePages huge_pages);
+    
+    const char* huge_pages_name(const HugePages huge_pages);
+
+namespace detail {
+    
+    static const size_t CACHE_LINE_BYTES = 64;
+    static const size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+    
+    // Smaller buffers would waste too much of their last huge page.
+    static const size_t MIN_HUGE_PAGE_BUFFER_BYTES = 2 * HUGE_PAGE_BYTES;
+    
+    /**
+     * Allocates bytes zeroed bytes starting on a cache line boundary. Release
+     * them with free_cells(). Returns nullptr if the allocation fails.
+     */
+    void* allocate_zeroed(const size_t bytes);
+    void free_cells(void * const cells);
+    
+    /**
+     * The length of the huge page aligned mapping cells were put in, or zero
+     * if they came from the heap.
+     */
+    size_t mapped_bytes(const void * const cells);
+    
+    /**
+     * Allocates count zeroed cells starting on a cache line boundary. Every cell
+     * type's zero is all zero bits.
+     */
+    template <typename Cell>
+    Cell* allocate_cells(const size_t count)
+    {
+        return static_cast<Cell*>(allocate_zeroed(count * sizeof(Cell)));
+    }
+    
+} // namespace detail
+} // namespace influence_map
@@ -0,0 +1,423 @@
+#pragma once
+
+#include "cell_types.h"
+#include "map_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace influence_map {
+namespace detail {
+    
+    /**
+     * The map kernels for one cell type, with the same contracts as the float
+     * kernels in KernelTable. Values going in and out are decoded, so max and the
+     * residual are in influence rather than in stored units.
+     *
+     * The table carries the float kernels it was made with, and hands them to
+     * the propagate kernels on every row, so they are looked up once per table
+     * rather than once per row.
+     */
+    template <typename Cell>
+    struct CellKernelTable
+    {
+        typedef typename CellTraits<Cell>::Value Value;
+        typedef BasicPropagateRowParams<Value> Params;
+        
+        const KernelTable* vectors;
+        
+        void (*propagate_row_kernel)(const KernelTable& vectors,
+                                     const Cell * const above,
+                                     const Cell * const row,
+                                     const Cell * const below,
+                                     Cell * const out,
+                                     const size_t count,
+                                     const Params& params);
+        
+        Value (*propagate_row_residual_kernel)(const KernelTable& vectors,
+                                               const Cell * const above,
+                                               const Cell * const row,
+                                               const Cell * const below,
+                                               Cell * const out,
+                                               const size_t count,
+                                               const Params& params);
+        
+        void (*fill)(Cell * const out, const size_t count, const Cell value);
+        Value (*max)(const Cell * const in, const size_t count, const Value current);
+        
+        void (*stamp_row)(Cell * const out,
+                          const Value * const weights,
+                          const size_t count,
+                          const Value strength,
+                          const StampBlend blend,
+                          const bool clamp,
+                          const Value clamp_min,
+                          const Value clamp_max);
+        
+        void propagate_row(const Cell * const above,
+                           const Cell * const row,
+                           const Cell * const below,
+                           Cell * const out,
+                           const size_t count,
+                           const Params& params) const
+        {
+            propagate_row_kernel(*vectors, above, row, below, out, count, params);
+        }
+        
+        Value propagate_row_residual(const Cell * const above,
+                                     const Cell * const row,
+                                     const Cell * const below,
+                                     Cell * const out,
+                                     const size_t count,
+                                     const Params& params) const
+        {
+            return propagate_row_residual_kernel(*vectors, above, row, below, out, count, params);
+        }
+    };
+    
+    /**
+     * The scalar kernel double cells run, and the reference for the other cell
+     * types. It does the same arithmetic as the float kernels in the cell
+     * type's Value, and rounds each result back to the cell type as it is
+     * stored.
+     */
+    template <typename Cell, bool Clamp, bool Measure, bool Masked, bool Terrain, bool Floor>
+    typename CellTraits<Cell>::Value propagate_cells(const Cell * const above,
+                                                     const Cell * const row,
+                                                     const Cell * const below,
+                                                     Cell * const out,
+                                                     const size_t count,
+                                                     const BasicPropagateRowParams<typename CellTraits<Cell>::Value>& params)
+    {
+        typedef CellTraits<Cell> Traits;
+        typedef typename Traits::Value Value;
+        
+        Value residual = 0;
+        
+        for (size_t x = 0; x < count; x++) {
+            const Value edge_influence = Traits::largest(above[x], row[x + 1], below[x], row[x - 1]);
+            const Value corner_influence = Traits::largest(above[x - 1], above[x + 1], below[x + 1], below[x - 1]);
+            
+            const Value edge = Terrain ? params.edge_factors[params.terrain[x]] : params.edge;
+            const Value corner = Terrain ? params.corner_factors[params.terrain[x]] : params.corner;
+            
+            Value max_influence = 0;
+            max_influence = max_of(edge_influence * edge, max_influence);
+            max_influence = max_of(corner_influence * corner, max_influence);
+            
+            const Value cur_influence = Traits::decode(row[x]);
+            Value result = (max_influence - cur_influence) * params.momentum + cur_influence;
+            if (Floor) result = max_of(params.floor[x], result);
+            out[x] = Traits::encode(Clamp ? clamp_to(result, params.clamp_min, params.clamp_max) : result);
+            if (Masked && (blocked_bits(params.blocked, params.blocked_bit + x, 1) & 1)) out[x] = Traits::encode(Value(0));
+            
+            if (Measure) residual = max_of(Value(std::fabs(Traits::decode(out[x]) - cur_influence)), residual);
+        }
+        
+        return residual;
+    }
+    
+    template <typename Cell, bool Measure, bool Masked, bool Terrain, bool Floor>
+    typename CellTraits<Cell>::Value propagate_cells_clamped(const Cell * const above,
+                                                             const Cell * const row,
+                                                             const Cell * const below,
+                                                             Cell * const out,
+                                                             const size_t count,
+                                                             const typename CellKernelTable<Cell>::Params& params)
+    {
+        return params.clamp
+            ? propagate_cells<Cell, true, Measure, Masked, Terrain, Floor>(above, row, below, out, count, params)
+            : propagate_cells<Cell, false, Measure, Masked, Terrain, Floor>(above, row, below, out, count, params);
+    }
+    
+    template <typename Cell, bool Measure, bool Floor>
+    typename CellTraits<Cell>::Value propagate_cells_masked(const Cell * const above,
+                                                            const Cell * const row,
+                                                            const Cell * const below,
+                                                            Cell * const out,
+                                                            const size_t count,
+                                                            const typename CellKernelTable<Cell>::Params& params)
+    {
+        if (params.blocked) {
+            return params.terrain
+                ? propagate_cells_clamped<Cell, Measure, true, true, Floor>(above, row, below, out, count, params)
+                : propagate_cells_clamped<Cell, Measure, true, false, Floor>(above, row, below, out, count, params);
+        }
+        return params.terrain
+            ? propagate_cells_clamped<Cell, Measure, false, true, Floor>(above, row, below, out, count, params)
+            : propagate_cells_clamped<Cell, Measure, false, false, Floor>(above, row, below, out, count, params);
+    }
+    
+    template <typename Cell, bool Measure>
+    typename CellTraits<Cell>::Value propagate_cells_dispatch(const Cell * const above,
+                                                              const Cell * const row,
+                                                              const Cell * const below,
+                                                              Cell * const out,
+                                                              const size_t count,
+                                                              const typename CellKernelTable<Cell>::Params& params)
+    {
+        return params.floor
+            ? propagate_cells_masked<Cell, Measure, true>(above, row, below, out, count, params)
+            : propagate_cells_masked<Cell, Measure, false>(above, row, below, out, count, params);
+    }
+    
+    template <typename Cell>
+    void propagate_cells_row(const KernelTable&,
+                             const Cell * const above,
+                             const Cell * const row,
+                             const Cell * const below,
+                             Cell * const out,
+                             const size_t count,
+                             const typename CellKernelTable<Cell>::Params& params)
+    {
+        propagate_cells_dispatch<Cell, false>(above, row, below, out, count, params);
+    }
+    
+    template <typename Cell>
+    typename CellTraits<Cell>::Value propagate_cells_row_residual(const KernelTable&,
+                                                                  const Cell * const above,
+                                                                  const Cell * const row,
+                                                                  const Cell * const below,
+                                                                  Cell * const out,
+                                                                  const size_t count,
+                                                                  const typename CellKernelTable<Cell>::Params& params)
+    {
+        return propagate_cells_dispatch<Cell, true>(above, row, below, out, count, params);
+    }
+    
+    template <typename Cell>
+    const CellConversions<Cell>& conversions(const KernelTable& kernels);
+    
+    template <>
+    inline const CellConversions<uint8_t>& conversions<uint8_t>(const KernelTable& kernels)
+    {
+        return kernels.uint8_cells;
+    }
+    
+    template <>
+    inline const CellConversions<uint16_t>& conversions<uint16_t>(const KernelTable& kernels)
+    {
+        return kernels.uint16_cells;
+    }
+    
+    template <>
+    inline const CellConversions<Half>& conversions<Half>(const KernelTable& kernels)
+    {
+        return kernels.half_cells;
+    }
+    
+    /**
+     * propagate_cells for cells narrower than float, run on the vector kernels.
+     * A chunk of the row at a time is widened to float, propagated with the
+     * float kernel and narrowed back. Each result is rounded exactly once, as
+     * in propagate_cells, so the cells come out the same; the residual is
+     * measured on the cells as stored.
+     */
+    template <typename Cell, bool Measure>
+    float propagate_widened(const KernelTable& kernels,
+                            const Cell * const above,
+                            const Cell * const row,
+                            const Cell * const below,
+                            Cell * const out,
+                            const size_t count,
+                            const PropagateRowParams& params)
+    {
+        static const size_t CHUNK_CELLS = 256;
+        
+        const CellConversions<Cell>& cells = conversions<Cell>(kernels);
+        
+        // The input chunks take the cell either side as well.
+        float wide_above[CHUNK_CELLS + 2];
+        float wide_row[CHUNK_CELLS + 2];
+        float wide_below[CHUNK_CELLS + 2];
+        float wide_out[CHUNK_CELLS];
+        
+        float residual = 0;
+        for (size_t start = 0; start < count; start += CHUNK_CELLS) {
+            const size_t chunk_count = std::min(CHUNK_CELLS, count - start);
+            cells.widen(above + start - 1, wide_above, chunk_count + 2);
+            cells.widen(row + start - 1, wide_row, chunk_count + 2);
+            cells.widen(below + start - 1, wide_below, chunk_count + 2);
+            
+            PropagateRowParams chunk_params = params;
+            chunk_params.blocked_bit += start;
+            if (params.terrain) chunk_params.terrain += start;
+            if (params.floor) chunk_params.floor += start;
+            
+            kernels.propagate_row(wide_above + 1, wide_row + 1, wide_below + 1, wide_out, chunk_count, chunk_params);
+            cells.narrow(wide_out, out + start, chunk_count);
+            
+            if (Measure) {
+                cells.widen(out + start, wide_out, chunk_count);
+                residual = kernels.max_difference(wide_out, wide_row + 1, chunk_count, residual);
+            }
+        }
+        
+        return residual;
+    }
+    
+    template <typename Cell>
+    void propagate_widened_row(const KernelTable& kernels,
+                               const Cell * const above,
+                               const Cell * const row,
+                               const Cell * const below,
+                               Cell * const out,
+                               const size_t count,
+                               const PropagateRowParams& params)
+    {
+        propagate_widened<Cell, false>(kernels, above, row, below, out, count, params);
+    }
+    
+    template <typename Cell>
+    float propagate_widened_row_residual(const KernelTable& kernels,
+                                         const Cell * const above,
+                                         const Cell * const row,
+                                         const Cell * const below,
+                                         Cell * const out,
+                                         const size_t count,
+                                         const PropagateRowParams& params)
+    {
+        return propagate_widened<Cell, true>(kernels, above, row, below, out, count, params);
+    }
+    
+    template <typename Cell>
+    void fill_cells(Cell * const out, const size_t count, const Cell value)
+    {
+        std::fill(out, out + count, value);
+    }
+    
+    template <typename Cell>
+    typename CellTraits<Cell>::Value max_cell(const Cell * const in,
+                                              const size_t count,
+                                              const typename CellTraits<Cell>::Value current)
+    {
+        typename CellTraits<Cell>::Value result = current;
+        for (size_t i = 0; i < count; i++) {
+            result = max_of(CellTraits<Cell>::decode(in[i]), result);
+        }
+        return result;
+    }
+    
+    template <typename Cell>
+    void stamp_cells(Cell * const out,
+                     const typename CellTraits<Cell>::Value * const weights,
+                     const size_t count,
+                     const typename CellTraits<Cell>::Value strength,
+                     const StampBlend blend,
+                     const bool clamp,
+                     const typename CellTraits<Cell>::Value clamp_min,
+                     const typename CellTraits<Cell>::Value clamp_max)
+    {
+        typedef CellTraits<Cell> Traits;
+        typedef typename Traits::Value Value;
+        
+        for (size_t i = 0; i < count; i++) {
+            const Value stamped = strength * weights[i];
+            const Value current = Traits::decode(out[i]);
+            Value result = stamped;
+            if (blend == StampMax) {
+                result = max_of(stamped, current);
+            } else if (blend == StampAdd) {
+                result = current + stamped;
+            }
+            out[i] = Traits::encode(clamp ? clamp_to(result, clamp_min, clamp_max) : result);
+        }
+    }
+    
+    /**
+     * The kernels for a cell type. Like kernels(), fetch this once per multi-row
+     * operation.
+     */
+    template <typename Cell>
+    CellKernelTable<Cell> cell_kernels()
+    {
+        const CellKernelTable<Cell> table = {
+            &detail::kernels(),
+            propagate_cells_row<Cell>,
+            propagate_cells_row_residual<Cell>,
+            fill_cells<Cell>,
+            max_cell<Cell>,
+            stamp_cells<Cell>
+        };
+        return table;
+    }
+    
+    /**
+     * Cells narrower than float propagate on the vector kernels, widened to
+     * float and narrowed back. Double cells run the scalar kernels.
+     */
+    template <typename Cell>
+    CellKernelTable<Cell> widened_cell_kernels()
+    {
+        const CellKernelTable<Cell> table = {
+            &detail::kernels(),
+            propagate_widened_row<Cell>,
+            propagate_widened_row_residual<Cell>,
+            fill_cells<Cell>,
+            max_cell<Cell>,
+            stamp_cells<Cell>
+        };
+        return table;
+    }
+    
+    template <>
+    inline CellKernelTable<uint8_t> cell_kernels<uint8_t>()
+    {
+        return widened_cell_kernels<uint8_t>();
+    }
+    
+    template <>
+    inline CellKernelTable<uint16_t> cell_kernels<uint16_t>()
+    {
+        return widened_cell_kernels<uint16_t>();
+    }
+    
+    template <>
+    inline CellKernelTable<Half> cell_kernels<Half>()
+    {
+        return widened_cell_kernels<Half>();
+    }
+    
+    // The float kernels as CellKernelTable calls them, with the table passed in.
+    inline void propagate_float_row(const KernelTable& kernels,
+                                    const float * const above,
+                                    const float * const row,
+                                    const float * const below,
+                                    float * const out,
+                                    const size_t count,
+                                    const PropagateRowParams& params)
+    {
+        kernels.propagate_row(above, row, below, out, count, params);
+    }
+    
+    inline float propagate_float_row_residual(const KernelTable& kernels,
+                                              const float * const above,
+                                              const float * const row,
+                                              const float * const below,
+                                              float * const out,
+                                              const size_t count,
+                                              const PropagateRowParams& params)
+    {
+        return kernels.propagate_row_residual(above, row, below, out, count, params);
+    }
+    
+    /**
+     * Float maps run the vector kernels for the active SIMD tier.
+     */
+    template <>
+    inline CellKernelTable<float> cell_kernels<float>()
+    {
+        const KernelTable& kernels = detail::kernels();
+        const CellKernelTable<float> table = {
+            &kernels,
+            propagate_float_row,
+            propagate_float_row_residual,
+            kernels.fill,
+            kernels.max,
+            kernels.stamp_row
+        };
+        return table;
+    }
+    
+} // namespace detail
+} // namespace influence_map
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace influence_map {
+    
+    /**
+     * An IEEE 754 binary16 value, stored as its bits. Influence maps of Half
+     * cells do their arithmetic in float and round each result to half.
+     */
+    struct Half
+    {
+        uint16_t bits;
+    };
+    
+namespace detail {
+    
+    template <typename Value>
+    inline Value max_of(const Value candidate, const Value current)
+    {
+        // The comparison every kernel uses, so NaNs and signed zeros resolve
+        // the same way everywhere: a NaN candidate never wins.
+        return candidate > current ? candidate : current;
+    }
+    
+    template <typename Value>
+    inline Value clamp_to(const Value influence, const Value lowest, const Value highest)
+    {
+        if (influence >= lowest && influence <= highest) {
+            return influence;
+        } else if (influence > highest) {
+            return highest;
+        } else {
+            return lowest;
+        }
+    }
+    
+    inline float half_to_float(const uint16_t half)
+    {
+        const uint32_t sign = uint32_t(half & 0x8000) << 16;
+        const uint32_t exponent = (half >> 10) & 0x1f;
+        const uint32_t mantissa = half & 0x3ff;
+        
+        uint32_t bits;
+        if (exponent == 0) {
+            // Zero or subnormal, which is exactly mantissa * 2^-24.
+            const float magnitude = float(mantissa) * (1.0f / 16777216.0f);
+            memcpy(&bits, &magnitude, sizeof(bits));
+            bits |= sign;
+        } else if (exponent == 0x1f) {
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        } else {
+            bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        }
+        
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+    
+    inline uint16_t float_to_half(const float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+        uint32_t magnitude = bits & 0x7fffffff;
+        
+        if (magnitude >= 0x7f800000) {
+            // Infinity stays infinity, NaNs stay quiet NaNs.
+            return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 | ((magnitude >> 13) & 0x3ff) : 0);
+        }
+        if (magnitude >= 0x477ff000) {
+            // 65520 and up round to infinity.
+            return sign | 0x7c00;
+        }
+        if (magnitude < 0x38800000) {
+            // Below the smallest normal half. Adding 0.5 lines the half
+            // mantissa up with the bottom of the float mantissa, and the float
+            // addition rounds it to nearest even for us.
+            float shifted;
+            memcpy(&shifted, &magnitude, sizeof(shifted));
+            shifted += 0.5f;
+            uint32_t shifted_bits;
+            memcpy(&shifted_bits, &shifted, sizeof(shifted_bits));
+            return sign | uint16_t(shifted_bits - 0x3f000000);
+        }
+        
+        // Rebias the exponent and round the 13 dropped bits to nearest even.
+        const uint32_t odd = (magnitude >> 13) & 1;
+        magnitude += (uint32_t(15 - 127) << 23) + 0xfff + odd;
+        return sign | uint16_t(magnitude >> 13);
+    }
+    
+} // namespace detail
+    
+    /**
+     * How BasicInfluenceMap stores, reads and orders each cell type. Value is the
+     * type influence is read, written and computed in. Normalized types store 0..1
+     * in the whole range of an unsigned integer, and encoding saturates anything
+     * outside that to 0 or 1, so they always clamp to 0..1.
+     */
+    template <typename Cell>
+    struct CellTraits;
+    
+    template <>
+    struct CellTraits<float>
+    {
+        typedef float Value;
+        static const bool NORMALIZED = false;
+        
+        static Value decode(const float cell) { return cell; }
+        static float encode(const Value value) { return value; }
+        
+        // The largest of zero and four cells.
+        static Value largest(const float a, const float b, const float c, const float d)
+        {
+            return detail::max_of(d, detail::max_of(c, detail::max_of(b, detail::max_of(a, 0.0f))));
+        }
+    };
+    
+    template <>
+    struct CellTraits<double>
+    {
+        typedef double Value;
+        static const bool NORMALIZED = false;
+        
+        static Value decode(const double cell) { return cell; }
+        static double encode(const Value value) { return value; }
+        
+        static Value largest(const double a, const double b, const double c, const double d)
+        {
+            return detail::max_of(d, detail::max_of(c, detail::max_of(b, detail::max_of(a, 0.0))));
+        }
+    };
+    
+    template <>
+    struct CellTraits<Half>
+    {
+        typedef float Value;
+        static const bool NORMALIZED = false;
+        
+        static Value decode(const Half cell) { return detail::half_to_float(cell.bits); }
+        static Half encode(const Value value) { const Half cell = { detail::float_to_half(value) }; return cell; }
+        
+        static Value largest(const Half a, const Half b, const Half c, const Half d)
+        {
+            return CellTraits<float>::largest(decode(a), decode(b), decode(c), decode(d));
+        }
+    };
+    
+    template <typename Code>
+    struct NormalizedCellTraits
+    {
+        typedef float Value;
+        static const bool NORMALIZED = true;
+        static const Code MAX_CODE = Code(~Code(0));
+        
+        static Value decode(const Code cell)
+        {
+            return float(cell) * (1.0f / float(MAX_CODE));
+        }
+        
+        static Code encode(const Value value)
+        {
+            if (!(value > 0.0f)) {
+                return 0;
+            } else if (value >= 1.0f) {
+                return MAX_CODE;
+            }
+            return Code(value * float(MAX_CODE) + 0.5f);
+        }
+        
+        // Decoding is monotonic, so the largest code decodes to the largest
+        // value and only one conversion is needed.
+        static Value largest(const Code a, const Code b, const Code c, const Code d)
+        {
+            const Code ab = a > b ? a : b;
+            const Code cd = c > d ? c : d;
+            return decode(ab > cd ? ab : cd);
+        }
+    };
+    
+    template <>
+    struct CellTraits<uint8_t> : NormalizedCellTraits<uint8_t> {};
+    
+    template <>
+    struct CellTraits<uint16_t> : NormalizedCellTraits<uint16_t> {};
+    
+} // namespace influence_map
@@ -0,0 +1,136 @@
+#include "derived_maps.h"
+#include "map_kernels.h"
+#include "thread_pool.h"
+#include "xassert.h"
+
+#include <algorithm>
+
+namespace influence_map {
+    
+    const size_t DerivedInfluenceMaps::MIN_ROWS_PER_BAND;
+    
+    DerivedInfluenceMaps::DerivedInfluenceMaps(const size_t width, const size_t height) :
+        _influence(width, height, false, 0.0f),
+        _tension(width, height, false, 0.0f),
+        _vulnerability(width, height, false, 0.0f),
+        _thread_pool(nullptr)
+    {
+    }
+    
+    size_t DerivedInfluenceMaps::width() const
+    {
+        return _influence.width();
+    }
+    
+    size_t DerivedInfluenceMaps::height() const
+    {
+        return _influence.height();
+    }
+    
+    const InfluenceMap& DerivedInfluenceMaps::influence() const
+    {
+        return _influence;
+    }
+    
+    const InfluenceMap& DerivedInfluenceMaps::tension() const
+    {
+        return _tension;
+    }
+    
+    const InfluenceMap& DerivedInfluenceMaps::vulnerability() const
+    {
+        return _vulnerability;
+    }
+    
+    void DerivedInfluenceMaps::check_sources(const InfluenceMap& ally, const InfluenceMap& enemy) const
+    {
+        XASSERT(ally.width() == width() && ally.height() == height(), "ally map is a different size");
+        XASSERT(enemy.width() == width() && enemy.height() == height(), "enemy map is a different size");
+    }
+    
+    void DerivedInfluenceMaps::derive_row(const float * const ally, const float * const enemy, const size_t y)
+    {
+        // All five maps are the same size, so they share a layout.
+        const size_t offset = _influence.row_offset(y);
+        detail::kernels().derive_row(ally,
+                                     enemy,
+                                     _influence._data + offset,
+                                     _tension._data + offset,
+                                     _vulnerability._data + offset,
+                                     width());
+    }
+    
+    void DerivedInfluenceMaps::finish_derive()
+    {
+        _influence.mark_all_tiles_changed();
+        _tension.mark_all_tiles_changed();
+        _vulnerability.mark_all_tiles_changed();
+    }
+    
+    template <typename RowFn>
+    void DerivedInfluenceMaps::for_each_band(const RowFn& rows)
+    {
+        const size_t map_height = height();
+        
+        if (_thread_pool && _thread_pool->num_threads() > 1 && map_height >= MIN_ROWS_PER_BAND * 2) {
+            const size_t max_bands = _thread_pool->num_threads() * 4;
+            const size_t num_bands = std::min(max_bands, map_height / MIN_ROWS_PER_BAND);
+            const size_t rows_per_band = (map_height + num_bands - 1) / num_bands;
+            
+            _thread_pool->parallel_for(num_bands, [&](const size_t band) {
+                const size_t begin = band * rows_per_band;
+                rows(begin, std::min(begin + rows_per_band, map_height));
+            });
+        } else {
+            rows(0, map_height);
+        }
+    }
+    
+    void DerivedInfluenceMaps::derive(const InfluenceMap& ally, const InfluenceMap& enemy)
+    {
+        check_sources(ally, enemy);
+        
+        for_each_band([&](const size_t begin, const size_t end) {
+            for (size_t y = begin; y < end; y++) {
+                derive_row(ally._data + ally.row_offset(y), enemy._data + enemy.row_offset(y), y);
+            }
+        });
+        
+        finish_derive();
+    }
+    
+    void DerivedInfluenceMaps::propagate(InfluenceMap& ally, InfluenceMap& enemy, const float momentum, const float decay)
+    {
+        check_sources(ally, enemy);
+        XASSERT(&ally != &enemy, "ally and enemy must be different maps");
+        
+        const detail::CellKernelTable<float> kernels = detail::cell_kernels<float>();
+        const InfluenceMap::Params ally_params = ally.begin_step(momentum, decay);
+        const InfluenceMap::Params enemy_params = enemy.begin_step(momentum, decay);
+        
+        // Each propagated row is derived from straight away, while it is still
+        // in cache. Nothing reads the rows being written until the swap.
+        for_each_band([&](const size_t begin, const size_t end) {
+            for (size_t y = begin; y < end; y++) {
+                ally.propagate_span(y, 0, width(), kernels, ally_params, false);
+                enemy.propagate_span(y, 0, width(), kernels, enemy_params, false);
+                derive_row(ally._copy + ally.row_offset(y), enemy._copy + enemy.row_offset(y), y);
+            }
+        });
+        
+        ally.finish_step();
+        enemy.finish_step();
+        finish_derive();
+    }
+    
+    void DerivedInfluenceMaps::set_thread_pool(ThreadPool * const thread_pool)
+    {
+        _thread_pool = thread_pool;
+    }
+    
+    ThreadPool* DerivedInfluenceMaps::thread_pool() const
+    {
+        return _thread_pool;
+    }
+
+} // namespace influence_map
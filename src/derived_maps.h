@@ -0,0 +1,75 @@
+#pragma once
+
+#include "influence_map.h"
+
+#include <cstddef>
+
+namespace influence_map {
+    
+    class ThreadPool;
+    
+    /**
+     * The maps usually derived from an ally and an enemy influence map:
+     *
+     *      influence     = ally - enemy, who controls each cell
+     *      tension       = ally + enemy, how contested it is
+     *      vulnerability = tension - |influence|, contested and evenly matched
+     *
+     * propagate() steps the ally and enemy maps and derives all three in the
+     * same pass over the rows, each while the rows it reads are still in cache,
+     * rather than in three more passes over the whole grid afterwards.
+     */
+    class DerivedInfluenceMaps
+    {
+    public:
+        DerivedInfluenceMaps(const size_t width, const size_t height);
+        DerivedInfluenceMaps(const DerivedInfluenceMaps&) = delete;
+        DerivedInfluenceMaps& operator=(const DerivedInfluenceMaps&) = delete;
+        
+        size_t width() const;
+        size_t height() const;
+        
+        const InfluenceMap& influence() const;
+        const InfluenceMap& tension() const;
+        const InfluenceMap& vulnerability() const;
+        
+        /**
+         * Derives the maps from ally and enemy as they stand. Both must be the
+         * same size as these maps.
+         */
+        void derive(const InfluenceMap& ally, const InfluenceMap& enemy);
+        
+        /**
+         * The same as ally.propagate(momentum, decay), enemy.propagate(momentum,
+         * decay) and then derive(ally, enemy), with every result bit for bit
+         * the same, but in one pass. ally and enemy must be different maps.
+         */
+        void propagate(InfluenceMap& ally, InfluenceMap& enemy, const float momentum, const float decay);
+        
+        /**
+         * Spreads derive() and propagate() over the pool's threads in bands of
+         * rows, whatever pools ally and enemy have. The pool must outlive the
+         * maps or be detached by passing nullptr.
+         */
+        void set_thread_pool(ThreadPool * const thread_pool);
+        ThreadPool* thread_pool() const;
+    
+    private:
+        InfluenceMap _influence;
+        InfluenceMap _tension;
+        InfluenceMap _vulnerability;
+        
+        ThreadPool* _thread_pool;
+        
+        // Below this a band costs less than waking a worker for it.
+        static const size_t MIN_ROWS_PER_BAND = 16;
+        
+        void check_sources(const InfluenceMap& ally, const InfluenceMap& enemy) const;
+        void derive_row(const float * const ally, const float * const enemy, const size_t y);
+        void finish_derive();
+        
+        template <typename RowFn>
+        void for_each_band(const RowFn& rows);
+    };
+
+} // namespace influence_map
@@ -0,0 +1,7 @@
+#include "emitter_field.h"
+
+namespace influence_map {
+    
+    template class BasicEmitterField<float>;
+
+} // namespace influence_map
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "cell_kernels.h"
+#include "stamps.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace influence_map {
+    
+    template <typename Cell, typename Clamp, typename Border>
+    class BasicInfluenceMap;
+    
+    /**
+     * A rectangle of cells, [x_begin, x_end) x [y_begin, y_end).
+     */
+    struct CellRect
+    {
+        size_t x_begin;
+        size_t y_begin;
+        size_t x_end;
+        size_t y_end;
+    };
+    
+    /**
+     * The influence of a set of moving sources, each a stamp registered once and
+     * then moved or changed through its handle. Every cell holds the stamps
+     * covering it blended by max or add, as if they had all been stamped onto
+     * an empty field. Cells of an empty field hold the blend's identity,
+     * -infinity for max and zero for add, so the cells no emitter covers never
+     * raise anything when a max field is applied as a floor.
+     *
+     * A change only redoes the cells under the old and new discs: the old disc
+     * is cleared and every other emitter overlapping it stamped back, then the
+     * new one is stamped on top. So keeping the field up to date costs what
+     * moved, not how many emitters there are. Each of those rectangles is
+     * recorded in dirty_rects() until clear_dirty().
+     *
+     * Feed it to a map with BasicInfluenceMap::apply_emitters().
+     */
+    template <typename Value>
+    class BasicEmitterField
+    {
+    public:
+        typedef BasicStampSource<Value> Source;
+        typedef size_t Handle;
+        
+        // Side length in cells of the squares emitters are bucketed by.
+        static const size_t TILE_SIZE = 16;
+        
+        /**
+         * blend is StampMax or StampAdd. StampReplace depends on the order
+         * emitters are stamped in, which a field doesn't keep.
+         */
+        BasicEmitterField(const size_t width, const size_t height, const StampBlend blend = StampMax);
+        BasicEmitterField(const BasicEmitterField&) = delete;
+        BasicEmitterField& operator=(const BasicEmitterField&) = delete;
+        
+        size_t width() const;
+        size_t height() const;
+        StampBlend blend() const;
+        
+        /**
+         * The number of emitters registered.
+         */
+        size_t size() const;
+        
+        /**
+         * Registers an emitter, which is stamped straight away. Its centre must
+         * be on the field. The handle stays valid until remove().
+         */
+        Handle add(const Source& source);
+        void remove(const Handle handle);
+        
+        const Source& source(const Handle handle) const;
+        
+        /**
+         * Changes an emitter, retracting its old stamp and applying the new
+         * one. Nothing is done if source is what the emitter already is.
+         */
+        void update(const Handle handle, const Source& source);
+        void move(const Handle handle, const size_t x, const size_t y);
+        void set_strength(const Handle handle, const Value strength);
+        
+        Value value(const size_t x, const size_t y) const;
+        const Value* row(const size_t y) const;
+        
+        /**
+         * The rectangles of cells changed since the last clear_dirty(), which
+         * may overlap.
+         */
+        const std::vector<CellRect>& dirty_rects() const;
+        void clear_dirty();
+    
+    private:
+        template <typename Cell, typename Clamp, typename Border>
+        friend class BasicInfluenceMap;
+        
+        typedef detail::CellKernelTable<Value> Kernels;
+        typedef detail::BasicStampKernel<Value> StampKernel;
+        
+        struct Emitter
+        {
+            Source source;
+            size_t kernel;
+            bool live;
+            
+            // The last restamp() that stamped this emitter, so an emitter in
+            // several tiles is only stamped once.
+            size_t visit;
+        };
+        
+        const size_t _width;
+        const size_t _height;
+        const StampBlend _blend;
+        const Value _empty;
+        
+        std::vector<Value> _values;
+        
+        std::vector<Emitter> _emitters;
+        std::vector<Handle> _free;
+        std::vector<StampKernel> _kernels;
+        size_t _visit;
+        
+        // The handles of the emitters overlapping each tile, row by row.
+        size_t _tiles_x;
+        std::vector<std::vector<Handle> > _tiles;
+        
+        std::vector<CellRect> _dirty;
+        
+        CellRect bounds(const Emitter& emitter) const;
+        void insert(const Handle handle);
+        void erase(const Handle handle);
+        void stamp(const Emitter& emitter, const CellRect& clip, const Kernels& kernels);
+        void restamp(const CellRect& rect, const Kernels& kernels);
+        
+        bool tile_covered(const size_t tx, const size_t ty) const;
+    };
+    
+    typedef BasicEmitterField<float> EmitterField;
+    
+    // The common float field is built once, in emitter_field.cpp.
+    extern template class BasicEmitterField<float>;
+
+} // namespace influence_map
+
+#include "emitter_field.inl"
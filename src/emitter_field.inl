@@ -0,0 +1,271 @@
+#include "xassert.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace influence_map {
+    
+    template <typename Value>
+    const size_t BasicEmitterField<Value>::TILE_SIZE;
+    
+    template <typename Value>
+    BasicEmitterField<Value>::BasicEmitterField(const size_t width, const size_t height, const StampBlend blend) :
+        _width(width),
+        _height(height),
+        _blend(blend),
+        _empty(blend == StampMax ? -std::numeric_limits<Value>::infinity() : Value(0)),
+        _values(width * height, _empty),
+        _visit(0),
+        _tiles_x((width + TILE_SIZE - 1) / TILE_SIZE),
+        _tiles(_tiles_x * ((height + TILE_SIZE - 1) / TILE_SIZE))
+    {
+        XASSERT(blend == StampMax || blend == StampAdd, "emitter fields blend by max or add");
+    }
+    
+    template <typename Value>
+    size_t BasicEmitterField<Value>::width() const
+    {
+        return _width;
+    }
+    
+    template <typename Value>
+    size_t BasicEmitterField<Value>::height() const
+    {
+        return _height;
+    }
+    
+    template <typename Value>
+    StampBlend BasicEmitterField<Value>::blend() const
+    {
+        return _blend;
+    }
+    
+    template <typename Value>
+    size_t BasicEmitterField<Value>::size() const
+    {
+        return _emitters.size() - _free.size();
+    }
+    
+    template <typename Value>
+    typename BasicEmitterField<Value>::Handle BasicEmitterField<Value>::add(const Source& source)
+    {
+        XASSERT(source.x < _width && source.y < _height, "emitter centre out of bounds");
+        
+        Handle handle = _emitters.size();
+        if (_free.empty()) {
+            _emitters.push_back(Emitter());
+        } else {
+            handle = _free.back();
+            _free.pop_back();
+        }
+        
+        Emitter& emitter = _emitters[handle];
+        emitter.source = source;
+        emitter.kernel = detail::find_stamp_kernel(_kernels, source.radius, source.falloff);
+        emitter.live = true;
+        emitter.visit = _visit;
+        insert(handle);
+        
+        // Stamping on top gives the same cells as restamping the disc, since
+        // max and add don't care about order.
+        const CellRect rect = bounds(emitter);
+        stamp(emitter, rect, detail::cell_kernels<Value>());
+        _dirty.push_back(rect);
+        return handle;
+    }
+    
+    template <typename Value>
+    void BasicEmitterField<Value>::remove(const Handle handle)
+    {
+        XASSERT(handle < _emitters.size() && _emitters[handle].live, "not a registered emitter");
+        
+        Emitter& emitter = _emitters[handle];
+        const CellRect rect = bounds(emitter);
+        erase(handle);
+        emitter.live = false;
+        _free.push_back(handle);
+        
+        restamp(rect, detail::cell_kernels<Value>());
+        _dirty.push_back(rect);
+    }
+    
+    template <typename Value>
+    const typename BasicEmitterField<Value>::Source& BasicEmitterField<Value>::source(const Handle handle) const
+    {
+        XASSERT(handle < _emitters.size() && _emitters[handle].live, "not a registered emitter");
+        return _emitters[handle].source;
+    }
+    
+    template <typename Value>
+    void BasicEmitterField<Value>::update(const Handle handle, const Source& source)
+    {
+        XASSERT(handle < _emitters.size() && _emitters[handle].live, "not a registered emitter");
+        XASSERT(source.x < _width && source.y < _height, "emitter centre out of bounds");
+        
+        Emitter& emitter = _emitters[handle];
+        const Source& old = emitter.source;
+        if (old.x == source.x && old.y == source.y && old.radius == source.radius &&
+            old.strength == source.strength && old.falloff == source.falloff) {
+            return;
+        }
+        
+        const Kernels kernels = detail::cell_kernels<Value>();
+        
+        // Retract: redo the old disc without this emitter.
+        const CellRect old_rect = bounds(emitter);
+        erase(handle);
+        emitter.live = false;
+        restamp(old_rect, kernels);
+        _dirty.push_back(old_rect);
+        
+        // Apply: stamp the new disc on top of whatever is there.
+        emitter.source = source;
+        emitter.kernel = detail::find_stamp_kernel(_kernels, source.radius, source.falloff);
+        emitter.live = true;
+        insert(handle);
+        
+        const CellRect new_rect = bounds(emitter);
+        stamp(emitter, new_rect, kernels);
+        _dirty.push_back(new_rect);
+    }
+    
+    template <typename Value>
+    void BasicEmitterField<Value>::move(const Handle handle, const size_t x, const size_t y)
+    {
+        Source moved = source(handle);
+        moved.x = x;
+        moved.y = y;
+        update(handle, moved);
+    }
+    
+    template <typename Value>
+    void BasicEmitterField<Value>::set_strength(const Handle handle, const Value strength)
+    {
+        Source changed = source(handle);
+        changed.strength = strength;
+        update(handle, changed);
+    }
+    
+    template <typename Value>
+    Value BasicEmitterField<Value>::value(const size_t x, const size_t y) const
+    {
+        XASSERT(x < _width, "x is greater than field width");
+        XASSERT(y < _height, "y is greater than field height");
+        return _values[y * _width + x];
+    }
+    
+    template <typename Value>
+    const Value* BasicEmitterField<Value>::row(const size_t y) const
+    {
+        XASSERT(y < _height, "y is greater than field height");
+        return &_values[y * _width];
+    }
+    
+    template <typename Value>
+    const std::vector<CellRect>& BasicEmitterField<Value>::dirty_rects() const
+    {
+        return _dirty;
+    }
+    
+    template <typename Value>
+    void BasicEmitterField<Value>::clear_dirty()
+    {
+        _dirty.clear();
+    }
+    
+    template <typename Value>
+    CellRect BasicEmitterField<Value>::bounds(const Emitter& emitter) const
+    {
+        // The disc's bounding box, clipped to the field.
+        const Source& source = emitter.source;
+        const CellRect rect = {
+            source.x >= source.radius ? source.x - source.radius : 0,
+            source.y >= source.radius ? source.y - source.radius : 0,
+            std::min(source.x + source.radius + 1, _width),
+            std::min(source.y + source.radius + 1, _height)
+        };
+        return rect;
+    }
+    
+    template <typename Value>
+    void BasicEmitterField<Value>::insert(const Handle handle)
+    {
+        const CellRect rect = bounds(_emitters[handle]);
+        for (size_t ty = rect.y_begin / TILE_SIZE; ty <= (rect.y_end - 1) / TILE_SIZE; ty++) {
+            for (size_t tx = rect.x_begin / TILE_SIZE; tx <= (rect.x_end - 1) / TILE_SIZE; tx++) {
+                _tiles[ty * _tiles_x + tx].push_back(handle);
+            }
+        }
+    }
+    
+    template <typename Value>
+    void BasicEmitterField<Value>::erase(const Handle handle)
+    {
+        const CellRect rect = bounds(_emitters[handle]);
+        for (size_t ty = rect.y_begin / TILE_SIZE; ty <= (rect.y_end - 1) / TILE_SIZE; ty++) {
+            for (size_t tx = rect.x_begin / TILE_SIZE; tx <= (rect.x_end - 1) / TILE_SIZE; tx++) {
+                std::vector<Handle>& tile = _tiles[ty * _tiles_x + tx];
+                const typename std::vector<Handle>::iterator found = std::find(tile.begin(), tile.end(), handle);
+                XASSERT(found != tile.end(), "emitter missing from its tile");
+                *found = tile.back();
+                tile.pop_back();
+            }
+        }
+    }
+    
+    template <typename Value>
+    void BasicEmitterField<Value>::stamp(const Emitter& emitter, const CellRect& clip, const Kernels& kernels)
+    {
+        // Stamps the part of the emitter's disc inside clip.
+        const Source& source = emitter.source;
+        const StampKernel& kernel = _kernels[emitter.kernel];
+        const size_t radius = kernel.radius;
+        const size_t diameter = 2 * radius + 1;
+        const size_t y_begin = std::max(source.y >= radius ? source.y - radius : 0, clip.y_begin);
+        const size_t y_end = std::min(source.y + radius + 1, clip.y_end);
+        
+        for (size_t y = y_begin; y < y_end; y++) {
+            const size_t kernel_row = y + radius - source.y;
+            const size_t half_width = kernel.half_widths[kernel_row];
+            const size_t begin = std::max(source.x >= half_width ? source.x - half_width : 0, clip.x_begin);
+            const size_t end = std::min(source.x + half_width + 1, clip.x_end);
+            if (begin >= end) {
+                continue;
+            }
+            
+            const Value * const weights = &kernel.weights[kernel_row * diameter + (begin + radius - source.x)];
+            kernels.stamp_row(&_values[y * _width + begin], weights, end - begin, source.strength, _blend,
+                              false, Value(0), Value(0));
+        }
+    }
+    
+    template <typename Value>
+    void BasicEmitterField<Value>::restamp(const CellRect& rect, const Kernels& kernels)
+    {
+        // Clears rect and stamps back every live emitter overlapping it.
+        for (size_t y = rect.y_begin; y < rect.y_end; y++) {
+            kernels.fill(&_values[y * _width + rect.x_begin], rect.x_end - rect.x_begin, _empty);
+        }
+        
+        _visit++;
+        for (size_t ty = rect.y_begin / TILE_SIZE; ty <= (rect.y_end - 1) / TILE_SIZE; ty++) {
+            for (size_t tx = rect.x_begin / TILE_SIZE; tx <= (rect.x_end - 1) / TILE_SIZE; tx++) {
+                const std::vector<Handle>& tile = _tiles[ty * _tiles_x + tx];
+                for (size_t i = 0; i < tile.size(); i++) {
+                    Emitter& emitter = _emitters[tile[i]];
+                    if (emitter.visit != _visit) {
+                        emitter.visit = _visit;
+                        stamp(emitter, rect, kernels);
+                    }
+                }
+            }
+        }
+    }
+    
+    template <typename Value>
+    bool BasicEmitterField<Value>::tile_covered(const size_t tx, const size_t ty) const
+    {
+        return !_tiles[ty * _tiles_x + tx].empty();
+    }
+
+} // namespace influence_map
@@ -1,12 +1,58 @@
 #pragma once
 
+#include "buffer_pool.h"
+#include "cell_buffer.h"
+#include "cell_kernels.h"
+#include "cell_types.h"
+#include "emitter_field.h"
+#include "map_policies.h"
+#include "stamps.h"
+
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 namespace influence_map {
+namespace detail {
+    
+    struct ExpressionAccess;
+
+} // namespace detail
+    
+    class ThreadPool;
+    class DerivedInfluenceMaps;
+    
+    template <typename Cell, typename Clamp, typename Border>
+    class BasicInfluenceMapFork;
     
-    class InfluenceMap
+    /**
+     * A grid of influence values stored as Cell, which may be float, double,
+     * Half, or uint8_t or uint16_t holding 0..1 in fixed point. Influence is read,
+     * written and computed in Value: double for double cells and float for the
+     * rest. Fixed point maps always clamp to 0..1 on top of Clamp.
+     *
+     * Narrower cells save memory, not arithmetic. uint8_t, uint16_t and Half
+     * rows are widened to float, run through the float vector kernels and
+     * narrowed back, so they propagate a little slower than float; double
+     * runs the scalar kernel. One 4096x4096 step with the AVX-512 kernels
+     * took 15 ms for float, 19 ms for uint8_t, 22 ms for uint16_t, 17 ms for
+     * Half and 81 ms for double. Below AVX2 there is no F16C to convert Half
+     * with, and a Half step takes longer than a double one.
+     *
+     * Clamp and Border pick, at compile time, how influence is clamped and what
+     * lies beyond the edges; see map_policies.h. The defaults behave as the map
+     * always has: clamping to 0..1 is a constructor flag and the border is zero.
+     */
+    template <typename Cell, typename Clamp = RuntimeClamp01, typename Border = ZeroBorder>
+    class BasicInfluenceMap
     {
     public:
+        typedef typename CellTraits<Cell>::Value Value;
+        typedef BasicStampSource<Value> StampSource;
+        typedef typename BasicEmitterField<Value>::Handle EmitterHandle;
+        
         enum ConnectionIndex {
             TopLeft     = 0,
             TopMiddle   = 1,
@@ -20,63 +66,582 @@ namespace influence_map {
         
         static const size_t CONNECTIONS_ARRAY_LENGTH = 8;
         
-        InfluenceMap(const size_t width, const size_t height, const bool clamp_values_to_0_1, const float initial_influence);
-        InfluenceMap(const InfluenceMap&) = delete;
-        InfluenceMap& operator=(const InfluenceMap&) = delete;
-        ~InfluenceMap();
+        // Side length in cells of the square tiles sparse propagation tracks.
+        static const size_t TILE_SIZE = 32;
+        
+        struct Convergence
+        {
+            size_t iterations;
+            
+            // The largest change to any cell in the last step.
+            Value residual;
+        };
+        
+        /**
+         * Maps given a pool take their cell buffers from it and hand them back
+         * when they go, rather than going to the heap each time.
+         */
+        BasicInfluenceMap(const size_t width,
+                          const size_t height,
+                          const bool clamp_values_to_0_1,
+                          const Value initial_influence,
+                          BufferPool * const pool = nullptr);
+        
+        /**
+         * For maps whose Clamp policy fixes the clamping. With RuntimeClamp01 this
+         * is an unclamped map.
+         */
+        BasicInfluenceMap(const size_t width, const size_t height, const Value initial_influence, BufferPool * const pool = nullptr);
+        BasicInfluenceMap(const BasicInfluenceMap&) = delete;
+        BasicInfluenceMap& operator=(const BasicInfluenceMap&) = delete;
+        
+        /**
+         * Moving a map hands over its cells and everything else without
+         * copying them, and leaves other with no cells, 0 by 0, only fit to be
+         * assigned to or destroyed. No snapshot or fork of either map may be
+         * held meanwhile.
+         */
+        BasicInfluenceMap(BasicInfluenceMap&& other);
+        BasicInfluenceMap& operator=(BasicInfluenceMap&& other);
+        ~BasicInfluenceMap();
         
         size_t num_cells() const;
         size_t width() const;
         size_t height() const;
         
-        float influence(const size_t x, const size_t y) const;
-        void set_influence(const size_t x, const size_t y, const float influence);
+        Value influence(const size_t x, const size_t y) const;
+        void set_influence(const size_t x, const size_t y, const Value influence);
         
         /**
-         * Assumes that connections_array has space for 8 floats:
+         * Sets every cell to influence, clamped as for set_influence().
+         */
+        void fill(const Value influence);
+        
+        /**
+         * The largest influence of any cell, ignoring NaNs. Returns -INFINITY for a
+         * map with no cells.
+         */
+        Value peak_influence() const;
+        
+        /**
+         * Stamps a disc of influence radius cells in radius onto the map, centred
+         * on (x, y), which must be on the map. Each covered cell gets strength
+         * scaled by falloff, blended with what is already there, and clamped as
+         * for set_influence(). Obstacles stay at zero. Whatever the Border, the
+         * disc is clipped where it runs off the map.
+         *
+         * The weights for each radius and falloff are worked out on first use
+         * and kept, and each row of the disc is blended in one vector pass, so
+         * this is far cheaper than calling set_influence() for every cell.
+         */
+        void stamp(const size_t x,
+                   const size_t y,
+                   const size_t radius,
+                   const Value strength,
+                   const StampFalloff falloff,
+                   const StampBlend blend = StampMax);
+        
+        /**
+         * stamp() for each of count sources in turn.
+         */
+        void stamp_many(const StampSource * const sources, const size_t count, const StampBlend blend = StampMax);
+        
+        /**
+         * Raises every cell the field covers to at least the field's value, as
+         * a StampMax stamp of the whole field would, clamped as for
+         * set_influence(). Obstacles stay at zero. Only tiles with emitters on
+         * them are visited.
+         *
+         * The field's dirty_rects() are marked changed for sparse propagation
+         * too, so a change is picked up even where the map had settled. Call
+         * field.clear_dirty() once every map fed by the field has applied it.
+         * The field must be the same size as the map.
+         */
+        void apply_emitters(const BasicEmitterField<Value>& field);
+        
+        /**
+         * Registers a source that propagate() keeps topped up, rather than one
+         * set back with set_influence() or stamp() after every call. Each step
+         * raises the cells an emitter covers to at least its stamp as they are
+         * written, inside the propagation kernel, with emitters blending by max.
+         * That is the same, bit for bit, as each step followed by
+         * apply_emitters() of a field holding the same emitters. Cells are only
+         * raised by the next step, not straight away.
+         *
+         * The handle stays valid until remove_emitter(). Changing or removing
+         * an emitter only redoes the cells under its old and new discs, as in
+         * BasicEmitterField.
+         */
+        EmitterHandle add_emitter(const StampSource& source);
+        void update_emitter(const EmitterHandle handle, const StampSource& source);
+        void move_emitter(const EmitterHandle handle, const size_t x, const size_t y);
+        void set_emitter_strength(const EmitterHandle handle, const Value strength);
+        void remove_emitter(const EmitterHandle handle);
+        
+        const StampSource& emitter(const EmitterHandle handle) const;
+        size_t num_emitters() const;
+        
+        /**
+         * Obstacles are walls: they always hold zero influence, so propagate()
+         * carries nothing into or through them. Making a cell an obstacle zeroes
+         * it, and set_influence() and fill() leave obstacles at zero. Influence
+         * still passes diagonally between two obstacles that only touch at a
+         * corner.
+         *
+         * Obstacles are kept as one bit per cell, allocated when the first one is
+         * set. Until then, and after clear_obstacles(), propagate() runs the
+         * unmasked kernels.
+         */
+        void set_obstacle(const size_t x, const size_t y, const bool obstacle);
+        bool is_obstacle(const size_t x, const size_t y) const;
+        void clear_obstacles();
+        
+        /**
+         * Terrain makes influence spread at different rates across the map. Every
+         * cell has a terrain type, 0 unless set, and every type has a cost that
+         * multiplies decay for influence entering cells of that type: at cost 2
+         * influence fades twice as fast, at 0.5 half as fast. Types cost 1 until
+         * set, which is the same as having no terrain. Costs must not be negative.
+         *
+         * Costs are turned into a table of edge and corner weights once per
+         * decay, so propagate() looks weights up rather than calling exp(). Like
+         * obstacles, the per-cell types are only allocated once set, and
+         * clear_terrain() goes back to uniform decay.
+         */
+        void set_terrain(const size_t x, const size_t y, const uint8_t terrain);
+        uint8_t terrain(const size_t x, const size_t y) const;
+        void set_terrain_cost(const uint8_t terrain, const Value cost);
+        Value terrain_cost(const uint8_t terrain) const;
+        void clear_terrain();
+        
+        /**
+         * Assumes that connections_array has space for 8 values:
          *
          *      1 2 3
          *      8   4
          *      7 6 5
          * At the edges of the grid the out_of_bounds_value is used to fill any cell
-         * positions which do not exist.
+         * positions which do not exist. Under a Border that maps every position
+         * back onto the map, like ClampToEdgeBorder or WrapBorder, none are missing
+         * and out_of_bounds_value is ignored.
          *
          * Each influence value is multiplied by influence_weight before being stored.
          * This does not affect the values in the source cells.
          */
         void connections(const size_t x,
                          const size_t y,
-                         float * const connections_array,
-                         const float influence_weight,
-                         const float out_of_bounds_value) const;
+                         Value * const connections_array,
+                         const Value influence_weight,
+                         const Value out_of_bounds_value) const;
+        
+        /**
+         * As above, but cell positions beyond the edge of the map read whatever the
+         * Border policy puts there, weighted like every other cell.
+         */
+        void connections(const size_t x,
+                         const size_t y,
+                         Value * const connections_array,
+                         const Value influence_weight) const;
         
         /**
-         * Similar to connections(), this fills the connections_array (which must be at least 8 floats in size)
+         * Similar to connections(), this fills the connections_array (which must be at least 8 values in size)
          * with the surrounding influence by adding them to values already in those positions in the array.
          *
          * As it adds to the array you *must* have already seeded the connections_array with valid numeric values.
          *
-         * Unlike the connections() function, out of bounds cells are simply ignored.
+         * Unlike the connections() function, out of bounds cells are simply ignored,
+         * unless the Border policy maps them onto cells inside the map.
          */
         void add_connections(const size_t x,
                              const size_t y,
-                             float * const connections_array,
-                             const float influence_weight) const;
-
-        void propagate(const float momentum, const float decay);
+                             Value * const connections_array,
+                             const Value influence_weight) const;
+        
+        void propagate(const Value momentum, const Value decay);
+        
+        /**
+         * propagate() that also returns the largest absolute change it made to any
+         * cell, measured in the same pass over the map.
+         */
+        Value propagate_with_residual(const Value momentum, const Value decay);
+        
+        /**
+         * Propagates until a step changes no cell by more than epsilon, or until
+         * max_iterations steps have run, whichever comes first.
+         */
+        Convergence propagate_until_stable(const Value momentum,
+                                           const Value decay,
+                                           const Value epsilon,
+                                           const size_t max_iterations);
+        
+        /**
+         * Gives exactly the same result as calling propagate(momentum, decay) steps
+         * times, but works through the map in column blocks, taking each block
+         * through several steps while it is still in cache instead of streaming the
+         * whole map through memory once per step. Borders that are not CONSTANT
+         * change every step, so those maps simply step.
+         */
+        void propagate_steps(const size_t steps, const Value momentum, const Value decay);
+        
+        /**
+         * Jumps straight to the state repeated propagation converges on when every
+         * cell keeps at least its current influence and momentum is 1: each cell
+         * ends up with the largest current influence anywhere on the map, scaled by
+         * exp(-decay * distance), where distance counts 1 for every edge step and
+         * 1.414 for every corner step, exactly as propagate() does. A constant
+         * border counts as a source just beyond every edge, and distances on a
+         * WrapBorder map go the short way round the torus.
+         *
+         * Without terrain it runs in two passes over the map however far
+         * influence has to travel, repeated while influence is still crossing
+         * a wrapping edge, which takes at most three pairs. With terrain the
+         * cheapest route may wind back and forth, so pairs of passes repeat
+         * until one changes nothing. That takes a few pairs on real maps, but
+         * a maze of costs can take up to width + height pairs, which is
+         * O(num_cells() * (width + height)) in the worst case.
+         *
+         * Results match iterating to convergence to within rounding. decay
+         * must not be negative.
+         */
+        void solve_steady_state(const Value decay);
         
+        /**
+         * Spreads propagate() over the pool's threads in bands of rows. The map does
+         * not own the pool, which must outlive it or be detached by passing nullptr.
+         * The results are the same whatever the number of threads.
+         *
+         * A pool can be shared by any number of maps.
+         */
+        void set_thread_pool(ThreadPool * const thread_pool);
+        ThreadPool* thread_pool() const;
+        
+        /**
+         * With sparse propagation on, propagate() only recomputes the tiles that
+         * changed in the previous step or were written through set_influence(),
+         * plus the tiles next to them. Everything else is already at the fixed
+         * point of propagate() and is copied through, so a step costs in proportion
+         * to the active area rather than num_cells(). Results are bit identical
+         * to dense propagation.
+         *
+         * Changing momentum or decay between steps makes every tile active again
+         * for one step. Off by default, as it costs a little over dense
+         * propagation on maps where most cells change every step.
+         */
+        void set_sparse_propagation(const bool enabled);
+        bool sparse_propagation() const;
+        
+        /**
+         * The number of tiles the last propagate() recomputed, out of
+         * num_tiles(). Dense propagation recomputes all of them.
+         */
+        size_t num_active_tiles() const;
+        size_t num_tiles() const;
+    
+        /**
+         * A read only view of the map as it was published, which stays valid and
+         * unchanged until it is released or destroyed, however the map changes
+         * meanwhile. Copies share the view. Release every snapshot before
+         * destroying the map.
+         */
+        class Snapshot
+        {
+        public:
+            Snapshot();
+            Snapshot(const Snapshot& other);
+            Snapshot& operator=(const Snapshot& other);
+            ~Snapshot();
+            
+            bool valid() const;
+            void release();
+            
+            size_t width() const;
+            size_t height() const;
+            
+            // As the map's own functions of the same names.
+            Value influence(const size_t x, const size_t y) const;
+            void connections(const size_t x,
+                             const size_t y,
+                             Value * const connections_array,
+                             const Value influence_weight,
+                             const Value out_of_bounds_value) const;
+            void connections(const size_t x,
+                             const size_t y,
+                             Value * const connections_array,
+                             const Value influence_weight) const;
+            void add_connections(const size_t x,
+                                 const size_t y,
+                                 Value * const connections_array,
+                                 const Value influence_weight) const;
+        
+        private:
+            friend class BasicInfluenceMap;
+            template <typename ForkCell, typename ForkClamp, typename ForkBorder>
+            friend class BasicInfluenceMapFork;
+            
+            Snapshot(const BasicInfluenceMap * const map, const size_t buffer, const size_t count);
+            
+            const Cell* cells() const;
+            
+            const BasicInfluenceMap* _map;
+            size_t _buffer;
+            // What it adds to its buffer's readers: 1, or PIN for a fork's.
+            size_t _count;
+        };
+        
+        /**
+         * Lets other threads read the map through snapshot() while this one
+         * propagates and changes it, at the cost of a third buffer. Call it
+         * before any other thread takes a snapshot. There is no turning it off.
+         *
+         * Each step then writes into a buffer no snapshot is reading and
+         * publishes it with one atomic store once it is done. Taking a snapshot
+         * never waits, and neither does a step, unless snapshots of two
+         * different steps are both still held: then every buffer is in use
+         * and the step waits for one of them to be released. So hold snapshots
+         * for a query or a tick, not across steps. A step, or a write after
+         * one, that waits more than MAX_SNAPSHOT_WAIT_SECONDS asserts rather
+         * than waiting forever, as the snapshots holding it up are most likely
+         * held by the thread that is stepping.
+         *
+         * Other changes to cells, like set_influence() or stamp(), are seen by
+         * new snapshots after the next step or publish(). The first of them
+         * after a step copies the published buffer, so that readers never see
+         * cells change; emitters avoid that, as the step applies them itself.
+         */
+        void enable_snapshots();
+        bool snapshots_enabled() const;
+        
+        // How long a step waits for snapshots to let go of a buffer.
+        static const size_t MAX_SNAPSHOT_WAIT_SECONDS = 10;
+        
+        /**
+         * A snapshot of the map as last published. Safe to call from any
+         * thread once enable_snapshots() has returned, and never blocks.
+         */
+        Snapshot snapshot() const;
+        
+        /**
+         * Publishes the cells as they are now, changes since the last step
+         * included.
+         */
+        void publish();
+    
     private:
-        const size_t _width;
-        const size_t _height;
-        const bool _clamp_values_to_0_1;
+        // Both work through maps a row at a time alongside their own work.
+        friend class DerivedInfluenceMaps;
+        friend struct detail::ExpressionAccess;
         
-        float* _data;
-        float* _copy;
+        // Forks read the map's cells and propagate the way it does.
+        template <typename ForkCell, typename ForkClamp, typename ForkBorder>
+        friend class BasicInfluenceMapFork;
+        
+        typedef detail::CellKernelTable<Cell> Kernels;
+        typedef typename Kernels::Params Params;
+        typedef detail::BasicStampKernel<Value> StampKernel;
+        
+        size_t _width;
+        size_t _height;
+        bool _clamp_values_to_0_1;
+        
+        // Cells are stored row by row, _stride cells apart, with a halo of zeros
+        // HALO cells deep on every side so stencils never need bounds checks.
+        // Cell (0, 0) is _origin cells into each buffer and every row starts on
+        // a cache line.
+        static const size_t HALO = 1;
+        static const size_t CELLS_PER_CACHE_LINE = detail::CACHE_LINE_BYTES / sizeof(Cell);
+        size_t _stride;
+        size_t _origin;
+        
+        BufferPool* _pool;
+        Cell* _data;
+        Cell* _copy;
+        
+        // With snapshots on, _data and _copy are two of three buffers. Readers
+        // count themselves in on the published buffer, and a step only writes
+        // a buffer that is neither published nor being read. Forks count in
+        // as PIN rather than 1 on the buffer they pinned, so that one load
+        // tells whether anything but forks is reading it.
+        struct SnapshotState
+        {
+            static const size_t NUM_BUFFERS = 3;
+            static const size_t PIN = size_t(1) << (sizeof(size_t) * 4);
+            
+            Cell* buffers[NUM_BUFFERS];
+            std::atomic<size_t> published;
+            std::atomic<size_t> readers[NUM_BUFFERS];
+        };
+        std::unique_ptr<SnapshotState> _snapshots;
+        
+        ThreadPool* _thread_pool;
+        
+        // Per tile, whether any cell changed in the last step or was written
+        // since, and whether the back buffer may no longer match the front.
+        size_t _tiles_x;
+        size_t _tiles_y;
+        std::vector<unsigned char> _tile_changed;
+        std::vector<unsigned char> _tile_stale;
+        std::vector<unsigned char> _tile_active;
+        size_t _num_active_tiles;
+        bool _sparse_propagation;
+        Params _sparse_params;
+        
+        // One bit per cell, set for obstacles, _obstacle_stride words per row so
+        // every row starts on a word. Empty while there are no obstacles.
+        size_t _obstacle_stride;
+        std::vector<uint64_t> _obstacles;
+        
+        // One terrain type per cell, _width per row, empty while decay is
+        // uniform. The weight tables are rebuilt when decay or a cost changes.
+        static const size_t NUM_TERRAIN_TYPES = 256;
+        std::vector<uint8_t> _terrain;
+        std::vector<Value> _terrain_costs;
+        std::vector<Value> _edge_factors;
+        std::vector<Value> _corner_factors;
+        Value _factors_decay;
+        size_t _terrain_types;
+        
+        std::vector<StampKernel> _stamp_kernels;
+        
+        // The registered emitters, made on the first add_emitter().
+        std::unique_ptr<BasicEmitterField<Value> > _emitters;
+        
+        // The rows propagate_steps() keeps in flight, one set per column block,
+        // kept from call to call so that repeated passes stop allocating.
+        std::vector<std::vector<Cell> > _block_scratch;
+        
+        // Below this a band costs less than waking a worker for it.
+        static const size_t MIN_ROWS_PER_BAND = 16;
+        
+        // Cache budget for the rows propagate_steps() keeps in flight per block,
+        // and the most steps it takes a block through in one pass.
+        static const size_t TEMPORAL_BLOCK_BYTES = 256 * 1024;
+        static const size_t MIN_TEMPORAL_BLOCK_WIDTH = 64;
+        static const size_t MAX_STEPS_PER_PASS = 16;
         
         size_t coords_to_linear(const size_t x, const size_t y) const;
-        float clamp_influence(const float influence) const;
+        size_t row_offset(const size_t y) const;
+        bool is_interior(const size_t x, const size_t y) const;
+        Value clamp_influence(const Value influence) const;
+        
+        static size_t padded_stride(const size_t width);
+        size_t buffer_cells() const;
+        Cell* allocate_buffer() const;
+        void free_buffer(Cell * const buffer) const;
+        void free_buffers();
+        void fill_cells(Cell * const buffer, const Value influence);
+        void fill_halo(Cell * const buffer, const Value influence);
+        bool refresh_halo();
+        void zero_obstacles(Cell * const buffer);
+        void zero_obstacle_row(Cell * const row, const size_t y) const;
+        void zero_obstacle_span(Cell * const span, const size_t y, const size_t begin, const size_t end) const;
+        Params row_params(const Params& params, const size_t y, const size_t begin) const;
+        
+        // The reads behind connections() and add_connections(), for the map's
+        // own cells or a snapshot's.
+        void connections(const Cell * const cells,
+                         const size_t x,
+                         const size_t y,
+                         Value * const connections_array,
+                         const Value influence_weight,
+                         const Value out_of_bounds_value) const;
+        void connections(const Cell * const cells,
+                         const size_t x,
+                         const size_t y,
+                         Value * const connections_array,
+                         const Value influence_weight) const;
+        void add_connections(const Cell * const cells,
+                             const size_t x,
+                             const size_t y,
+                             Value * const connections_array,
+                             const Value influence_weight) const;
+        Value border_connection(const Cell * const cells,
+                                const size_t x,
+                                const size_t y,
+                                const int dx,
+                                const int dy,
+                                const Value influence_weight) const;
+        
+        size_t buffer_index(const Cell * const buffer) const;
+        bool buffer_writable(const size_t buffer) const;
+        bool buffer_held_by_map(const size_t buffer) const;
+        size_t wait_for_writable(const size_t first, const size_t second) const;
+        void claim_data();
+        
+        // Pins the front buffer for a fork, which has to see every change made
+        // so far, without publishing it. Only safe while nothing is changing
+        // the map.
+        Snapshot pin_snapshot() const;
+        void claim_back_buffer();
+        void swap_buffers();
+        
+        Value propagate_span(const size_t y,
+                             const size_t begin,
+                             const size_t end,
+                             const Kernels& kernels,
+                             const Params& params,
+                             const bool measure_residual);
+        Value propagate_rows(const size_t begin,
+                             const size_t end,
+                             const Kernels& kernels,
+                             const Params& params,
+                             const bool measure_residual);
+        Value propagate_all(const Value momentum, const Value decay, const bool measure_residual);
+        
+        // A dense step is begin_step(), propagate_span() over every row, each of
+        // which writes that row of _copy, then finish_step() to swap buffers.
+        Params begin_step(const Value momentum, const Value decay);
+        void finish_step();
+        Value propagate_sparse(const Kernels& kernels, const Params& params);
+        Value propagate_tile_row(const size_t tile_y, const Kernels& kernels, const Params& params);
+        
+        // Sets active for the tiles a sparse step works out, given which
+        // changed in the last one, and returns how many there are. Every tile
+        // wakes up if params differ from last_params, which it then updates.
+        size_t find_active_tiles(const Params& params,
+                                 Params& last_params,
+                                 std::vector<unsigned char>& changed,
+                                 std::vector<unsigned char>& active) const;
+        
+        size_t tile_index(const size_t x, const size_t y) const;
+        void mark_all_tiles_changed();
+        void mark_tiles_changed(const size_t x_begin, const size_t y_begin, const size_t x_end, const size_t y_end);
+        void mark_emitters_changed();
+        
+        const StampKernel& stamp_kernel(const size_t radius, const StampFalloff falloff);
+        void stamp_kernel_at(const size_t x,
+                             const size_t y,
+                             const StampKernel& kernel,
+                             const Value strength,
+                             const StampBlend blend,
+                             const Kernels& kernels);
+        
+        Params propagate_params(const Value momentum, const Value decay);
+        
+        // For forks, which keep their own weight tables.
+        Params propagate_params(const Value momentum,
+                                const Value decay,
+                                std::vector<Value>& edge_factors,
+                                std::vector<Value>& corner_factors,
+                                Value& factors_decay) const;
+        void propagate_blocked(const size_t steps, const Value momentum, const Value decay);
+        void propagate_column_block(const size_t begin,
+                                    const size_t end,
+                                    const size_t steps,
+                                    const Kernels& kernels,
+                                    const Params& params,
+                                    std::vector<Cell>& scratch);
     };
     
+    typedef BasicInfluenceMap<float> InfluenceMap;
+    typedef BasicInfluenceMap<double> DoubleInfluenceMap;
+    typedef BasicInfluenceMap<Half> HalfInfluenceMap;
+    typedef BasicInfluenceMap<uint8_t> UInt8InfluenceMap;
+    typedef BasicInfluenceMap<uint16_t> UInt16InfluenceMap;
+    typedef BasicInfluenceMap<float, RuntimeClamp01, WrapBorder> ToroidalInfluenceMap;
+    
+    // The common float map is built once, in influence_map.cpp.
+    extern template class BasicInfluenceMap<float>;
+
 } // namespace influence_map
 
 #include "influence_map.inl"
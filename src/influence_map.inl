@@ -1,49 +1,1850 @@
+#include "cell_buffer.h"
+#include "thread_pool.h"
 #include "xassert.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
 namespace influence_map {
-        
-    inline size_t InfluenceMap::coords_to_linear(const size_t x, const size_t y) const
+    
+    template <typename Cell, typename Clamp, typename Border>
+    inline size_t BasicInfluenceMap<Cell, Clamp, Border>::coords_to_linear(const size_t x, const size_t y) const
     {
         XASSERT(x < _width, "x is greater than map width");
         XASSERT(y < _height, "y is greater than map height");
         
-        return _width * y + x;
+        return row_offset(y) + x;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    inline size_t BasicInfluenceMap<Cell, Clamp, Border>::row_offset(const size_t y) const
+    {
+        return _origin + _stride * y;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    inline bool BasicInfluenceMap<Cell, Clamp, Border>::is_interior(const size_t x, const size_t y) const
+    {
+        return x > 0 && y > 0 && x + 1 < _width && y + 1 < _height;
     }
     
-    inline float InfluenceMap::clamp_influence(const float influence) const
+    template <typename Cell, typename Clamp, typename Border>
+    inline typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::clamp_influence(const Value influence) const
     {
-        if (!_clamp_values_to_0_1 || (influence >= 0.0f && influence <= 1.0f)) {
+        if (!Clamp::clamps(_clamp_values_to_0_1)) {
             return influence;
-        } else if (influence > 1.0f) {
-            return 1.0f;
-        } else {
-            return 0.0f;
         }
+        return detail::clamp_to(influence, Clamp::template lowest<Value>(), Clamp::template highest<Value>());
     }
     
-    inline size_t InfluenceMap::num_cells() const
+    template <typename Cell, typename Clamp, typename Border>
+    inline size_t BasicInfluenceMap<Cell, Clamp, Border>::num_cells() const
     {
         return _width * _height;
     }
     
-    inline size_t InfluenceMap::width() const
+    template <typename Cell, typename Clamp, typename Border>
+    inline size_t BasicInfluenceMap<Cell, Clamp, Border>::width() const
     {
         return _width;
     }
     
-    inline size_t InfluenceMap::height() const
+    template <typename Cell, typename Clamp, typename Border>
+    inline size_t BasicInfluenceMap<Cell, Clamp, Border>::height() const
     {
         return _height;
     }
-
-    inline float InfluenceMap::influence(const size_t x, const size_t y) const
+    
+    template <typename Cell, typename Clamp, typename Border>
+    inline typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::influence(const size_t x, const size_t y) const
+    {
+        return CellTraits<Cell>::decode(_data[coords_to_linear(x, y)]);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    inline void BasicInfluenceMap<Cell, Clamp, Border>::set_influence(const size_t x, const size_t y, const Value influence)
+    {
+        if (_snapshots) {
+            claim_data();
+        }
+        
+        const bool obstacle = !_obstacles.empty() && is_obstacle(x, y);
+        _data[coords_to_linear(x, y)] = CellTraits<Cell>::encode(obstacle ? Value(0) : clamp_influence(influence));
+        
+        const size_t tile = tile_index(x, y);
+        _tile_changed[tile] = 1;
+        _tile_stale[tile] = 1;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    inline size_t BasicInfluenceMap<Cell, Clamp, Border>::tile_index(const size_t x, const size_t y) const
+    {
+        return (y / TILE_SIZE) * _tiles_x + x / TILE_SIZE;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    const size_t BasicInfluenceMap<Cell, Clamp, Border>::TILE_SIZE;
+    template <typename Cell, typename Clamp, typename Border>
+    const size_t BasicInfluenceMap<Cell, Clamp, Border>::HALO;
+    template <typename Cell, typename Clamp, typename Border>
+    const size_t BasicInfluenceMap<Cell, Clamp, Border>::CELLS_PER_CACHE_LINE;
+    template <typename Cell, typename Clamp, typename Border>
+    const size_t BasicInfluenceMap<Cell, Clamp, Border>::MIN_ROWS_PER_BAND;
+    template <typename Cell, typename Clamp, typename Border>
+    const size_t BasicInfluenceMap<Cell, Clamp, Border>::TEMPORAL_BLOCK_BYTES;
+    template <typename Cell, typename Clamp, typename Border>
+    const size_t BasicInfluenceMap<Cell, Clamp, Border>::MIN_TEMPORAL_BLOCK_WIDTH;
+    template <typename Cell, typename Clamp, typename Border>
+    const size_t BasicInfluenceMap<Cell, Clamp, Border>::MAX_STEPS_PER_PASS;
+    template <typename Cell, typename Clamp, typename Border>
+    const size_t BasicInfluenceMap<Cell, Clamp, Border>::NUM_TERRAIN_TYPES;
+    template <typename Cell, typename Clamp, typename Border>
+    const size_t BasicInfluenceMap<Cell, Clamp, Border>::MAX_SNAPSHOT_WAIT_SECONDS;
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMap<Cell, Clamp, Border>::BasicInfluenceMap(const size_t width,
+                                                              const size_t height,
+                                                              const bool clamp_values_to_0_1,
+                                                              const Value initial_influence,
+                                                              BufferPool * const pool) :
+        _width(width), _height(height), _clamp_values_to_0_1(clamp_values_to_0_1),
+        _stride(padded_stride(width)), _origin(_stride * HALO + CELLS_PER_CACHE_LINE),
+        _pool(pool),
+        _thread_pool(nullptr),
+        _tiles_x((width + TILE_SIZE - 1) / TILE_SIZE), _tiles_y((height + TILE_SIZE - 1) / TILE_SIZE),
+        _tile_changed(_tiles_x * _tiles_y, 1), _tile_stale(_tiles_x * _tiles_y, 1), _tile_active(_tiles_x * _tiles_y, 1),
+        _num_active_tiles(0), _sparse_propagation(false),
+        _obstacle_stride((width + 63) / 64),
+        _factors_decay(NAN), _terrain_types(0)
+    {
+        const Params no_params = { Value(NAN), Value(NAN), Value(NAN), false, Value(0), Value(0), nullptr, 0, nullptr, nullptr, nullptr, 0, nullptr };
+        _sparse_params = no_params;
+        
+        // Of course, if width * height overflows size_t, we're screwed. No sane
+        // person would use values that large of course...
+        //
+        // Both buffers start zeroed, which is the halo a zero border needs.
+        _data = allocate_buffer();
+        _copy = allocate_buffer();
+        XASSERT(_data && _copy, "out of memory allocating influence map");
+        
+        const Value clamped_influence = clamp_influence(initial_influence);
+        fill_cells(_data, clamped_influence);
+        fill_cells(_copy, clamped_influence);
+        
+        // Nothing writes the halo of a constant border after this.
+        if (Border::CONSTANT && Border::template value<Value>() != Value(0)) {
+            fill_halo(_data, Border::template value<Value>());
+            fill_halo(_copy, Border::template value<Value>());
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMap<Cell, Clamp, Border>::BasicInfluenceMap(const size_t width,
+                                                              const size_t height,
+                                                              const Value initial_influence,
+                                                              BufferPool * const pool) :
+        BasicInfluenceMap(width, height, false, initial_influence, pool)
+    {
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMap<Cell, Clamp, Border>::BasicInfluenceMap(BasicInfluenceMap&& other) :
+        _width(0), _height(0), _pool(nullptr), _data(nullptr), _copy(nullptr)
+    {
+        *this = std::move(other);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMap<Cell, Clamp, Border>& BasicInfluenceMap<Cell, Clamp, Border>::operator=(BasicInfluenceMap&& other)
+    {
+        if (this == &other) {
+            return *this;
+        }
+        
+        // Snapshots point back at the map they came from, so none can follow
+        // the cells to their new map.
+        if (other._snapshots) {
+            for (size_t i = 0; i < SnapshotState::NUM_BUFFERS; i++) {
+                XASSERT(other._snapshots->readers[i].load() == 0, "moved a map with snapshots held");
+            }
+        }
+        free_buffers();
+        
+        _width = other._width;
+        _height = other._height;
+        _clamp_values_to_0_1 = other._clamp_values_to_0_1;
+        _stride = other._stride;
+        _origin = other._origin;
+        _pool = other._pool;
+        _data = other._data;
+        _copy = other._copy;
+        _snapshots = std::move(other._snapshots);
+        _thread_pool = other._thread_pool;
+        
+        _tiles_x = other._tiles_x;
+        _tiles_y = other._tiles_y;
+        _tile_changed = std::move(other._tile_changed);
+        _tile_stale = std::move(other._tile_stale);
+        _tile_active = std::move(other._tile_active);
+        _num_active_tiles = other._num_active_tiles;
+        _sparse_propagation = other._sparse_propagation;
+        // Params point into the tables below, whose buffers move with them.
+        _sparse_params = other._sparse_params;
+        
+        _obstacle_stride = other._obstacle_stride;
+        _obstacles = std::move(other._obstacles);
+        _terrain = std::move(other._terrain);
+        _terrain_costs = std::move(other._terrain_costs);
+        _edge_factors = std::move(other._edge_factors);
+        _corner_factors = std::move(other._corner_factors);
+        _factors_decay = other._factors_decay;
+        _terrain_types = other._terrain_types;
+        
+        _stamp_kernels = std::move(other._stamp_kernels);
+        _emitters = std::move(other._emitters);
+        _block_scratch = std::move(other._block_scratch);
+        
+        // Moving a vector leaves it empty in practice but not by promise.
+        other._width = 0;
+        other._height = 0;
+        other._data = nullptr;
+        other._copy = nullptr;
+        other._tiles_x = 0;
+        other._tiles_y = 0;
+        other._tile_changed.clear();
+        other._tile_stale.clear();
+        other._tile_active.clear();
+        other._num_active_tiles = 0;
+        other._obstacle_stride = 0;
+        other._obstacles.clear();
+        other._terrain.clear();
+        other._terrain_costs.clear();
+        other._edge_factors.clear();
+        other._corner_factors.clear();
+        other._factors_decay = Value(NAN);
+        other._terrain_types = 0;
+        other._stamp_kernels.clear();
+        other._block_scratch.clear();
+        return *this;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMap<Cell, Clamp, Border>::~BasicInfluenceMap()
+    {
+        free_buffers();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMap<Cell, Clamp, Border>::padded_stride(const size_t width)
+    {
+        // The left halo column sits at the end of a whole cache line of padding so
+        // that every row starts on a cache line. The right halo column follows the
+        // row, then the stride rounds up to the next cache line.
+        const size_t line = CELLS_PER_CACHE_LINE;
+        return (line + width + HALO + line - 1) / line * line;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMap<Cell, Clamp, Border>::buffer_cells() const
+    {
+        return _stride * (_height + 2 * HALO);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    Cell* BasicInfluenceMap<Cell, Clamp, Border>::allocate_buffer() const
+    {
+        if (_pool) {
+            return static_cast<Cell*>(_pool->allocate(buffer_cells() * sizeof(Cell)));
+        }
+        return detail::allocate_cells<Cell>(buffer_cells());
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::free_buffer(Cell * const buffer) const
     {
-        return _data[coords_to_linear(x, y)];
+        if (_pool) {
+            _pool->release(buffer, buffer_cells() * sizeof(Cell));
+        } else {
+            detail::free_cells(buffer);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::free_buffers()
+    {
+        if (_snapshots) {
+            for (size_t i = 0; i < SnapshotState::NUM_BUFFERS; i++) {
+                XASSERT(_snapshots->readers[i].load() == 0, "snapshot outlived its map");
+                free_buffer(_snapshots->buffers[i]);
+            }
+            _snapshots.reset();
+        } else {
+            free_buffer(_data);
+            free_buffer(_copy);
+        }
+        _data = nullptr;
+        _copy = nullptr;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::fill_cells(Cell * const buffer, const Value influence)
+    {
+        const Kernels kernels = detail::cell_kernels<Cell>();
+        const Cell cell = CellTraits<Cell>::encode(influence);
+        for (size_t y = 0; y < _height; y++) {
+            kernels.fill(buffer + row_offset(y), _width, cell);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::fill_halo(Cell * const buffer, const Value influence)
+    {
+        const Cell cell = CellTraits<Cell>::encode(influence);
+        const size_t row_length = _width + 2 * HALO;
+        
+        std::fill(buffer + row_offset(0) - _stride - HALO, buffer + row_offset(0) - _stride - HALO + row_length, cell);
+        std::fill(buffer + row_offset(_height) - HALO, buffer + row_offset(_height) - HALO + row_length, cell);
+        for (size_t y = 0; y < _height; y++) {
+            buffer[row_offset(y) - 1] = cell;
+            buffer[row_offset(y) + _width] = cell;
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    bool BasicInfluenceMap<Cell, Clamp, Border>::refresh_halo()
+    {
+        // Every halo cell takes the value of the cell the border maps it onto,
+        // which is what lets propagate() run the interior kernel over edge and
+        // seam cells alike. Costs one pass around the edge of the map. Returns
+        // whether any halo cell changed.
+        if (_width == 0 || _height == 0) {
+            return false;
+        }
+        
+        bool changed = false;
+        const ptrdiff_t stride = ptrdiff_t(_stride);
+        const ptrdiff_t width = ptrdiff_t(_width);
+        const ptrdiff_t height = ptrdiff_t(_height);
+        
+        const ptrdiff_t halo_rows[2] = { -1, height };
+        for (size_t r = 0; r < 2; r++) {
+            ptrdiff_t source_y = halo_rows[r];
+            Border::resolve(source_y, _height);
+            const Cell * const source = _data + row_offset(size_t(source_y));
+            Cell * const halo = _data + ptrdiff_t(_origin) + halo_rows[r] * stride;
+            if (memcmp(halo, source, _width * sizeof(Cell)) != 0) {
+                memcpy(halo, source, _width * sizeof(Cell));
+                changed = true;
+            }
+        }
+        
+        for (ptrdiff_t y = -1; y <= height; y++) {
+            const ptrdiff_t halo_columns[2] = { -1, width };
+            for (size_t c = 0; c < 2; c++) {
+                ptrdiff_t source_x = halo_columns[c];
+                ptrdiff_t source_y = y;
+                Border::resolve(source_x, _width);
+                Border::resolve(source_y, _height);
+                const Cell * const source = _data + row_offset(size_t(source_y)) + size_t(source_x);
+                Cell * const halo = _data + ptrdiff_t(_origin) + y * stride + halo_columns[c];
+                if (memcmp(halo, source, sizeof(Cell)) != 0) {
+                    *halo = *source;
+                    changed = true;
+                }
+            }
+        }
+        
+        return changed;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::fill(const Value influence)
+    {
+        claim_data();
+        fill_cells(_data, clamp_influence(influence));
+        zero_obstacles(_data);
+        mark_all_tiles_changed();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::set_obstacle(const size_t x, const size_t y, const bool obstacle)
+    {
+        XASSERT(x < _width && y < _height, "obstacle out of bounds");
+        
+        if (_obstacles.empty()) {
+            if (!obstacle) {
+                return;
+            }
+            _obstacles.assign(_obstacle_stride * _height, 0);
+        }
+        
+        uint64_t& word = _obstacles[y * _obstacle_stride + x / 64];
+        const uint64_t bit = uint64_t(1) << (x % 64);
+        word = obstacle ? word | bit : word & ~bit;
+        
+        if (obstacle) {
+            set_influence(x, y, Value(0));
+        } else {
+            // Influence may now flow through, so sparse propagation has to
+            // look at this tile and its neighbours again.
+            const size_t tile = tile_index(x, y);
+            _tile_changed[tile] = 1;
+            _tile_stale[tile] = 1;
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    bool BasicInfluenceMap<Cell, Clamp, Border>::is_obstacle(const size_t x, const size_t y) const
+    {
+        XASSERT(x < _width && y < _height, "obstacle out of bounds");
+        
+        if (_obstacles.empty()) {
+            return false;
+        }
+        return (_obstacles[y * _obstacle_stride + x / 64] >> (x % 64)) & 1;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::clear_obstacles()
+    {
+        if (!_obstacles.empty()) {
+            std::vector<uint64_t>().swap(_obstacles);
+            mark_all_tiles_changed();
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::set_terrain(const size_t x, const size_t y, const uint8_t terrain)
+    {
+        XASSERT(x < _width && y < _height, "terrain out of bounds");
+        
+        if (_terrain.empty()) {
+            if (terrain == 0) {
+                return;
+            }
+            _terrain.assign(_width * _height, 0);
+            _terrain_costs.resize(NUM_TERRAIN_TYPES, Value(1));
+            _edge_factors.resize(NUM_TERRAIN_TYPES);
+            _corner_factors.resize(NUM_TERRAIN_TYPES);
+            _factors_decay = NAN;
+            _terrain_types = 1;
+        }
+        
+        _terrain[y * _width + x] = terrain;
+        _terrain_types = std::max(_terrain_types, size_t(terrain) + 1);
+        
+        const size_t tile = tile_index(x, y);
+        _tile_changed[tile] = 1;
+        _tile_stale[tile] = 1;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    uint8_t BasicInfluenceMap<Cell, Clamp, Border>::terrain(const size_t x, const size_t y) const
+    {
+        XASSERT(x < _width && y < _height, "terrain out of bounds");
+        
+        return _terrain.empty() ? 0 : _terrain[y * _width + x];
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::set_terrain_cost(const uint8_t terrain, const Value cost)
+    {
+        XASSERT(cost >= Value(0), "terrain cost must not be negative");
+        
+        if (_terrain_costs.empty()) {
+            _terrain_costs.resize(NUM_TERRAIN_TYPES, Value(1));
+        }
+        _terrain_costs[terrain] = cost;
+        _factors_decay = NAN;
+        mark_all_tiles_changed();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::terrain_cost(const uint8_t terrain) const
+    {
+        return _terrain_costs.empty() ? Value(1) : _terrain_costs[terrain];
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::clear_terrain()
+    {
+        std::vector<uint8_t>().swap(_terrain);
+        mark_all_tiles_changed();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::zero_obstacles(Cell * const buffer)
+    {
+        if (_obstacles.empty()) {
+            return;
+        }
+        
+        for (size_t y = 0; y < _height; y++) {
+            zero_obstacle_row(buffer + row_offset(y), y);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::zero_obstacle_row(Cell * const row, const size_t y) const
+    {
+        zero_obstacle_span(row, y, 0, _width);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::zero_obstacle_span(Cell * const span, const size_t y, const size_t begin, const size_t end) const
+    {
+        // span holds cells begin..end of row y.
+        if (_obstacles.empty()) {
+            return;
+        }
+        
+        const Cell zero = CellTraits<Cell>::encode(Value(0));
+        const uint64_t * const words = &_obstacles[y * _obstacle_stride];
+        for (size_t x = begin; x < end; x += 64) {
+            const size_t count = std::min(end - x, size_t(64));
+            const uint64_t mask = count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+            const uint64_t bits = detail::blocked_bits(words, x, count) & mask;
+            for (size_t bit = 0; bit < count && (bits >> bit) != 0; bit++) {
+                if ((bits >> bit) & 1) {
+                    span[x - begin + bit] = zero;
+                }
+            }
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Params BasicInfluenceMap<Cell, Clamp, Border>::row_params(const Params& params,
+                                                                                                                 const size_t y,
+                                                                                                                 const size_t begin) const
+    {
+        Params span_params = params;
+        if (!_obstacles.empty()) {
+            span_params.blocked = &_obstacles[y * _obstacle_stride];
+            span_params.blocked_bit = begin;
+        }
+        if (!_terrain.empty()) {
+            span_params.terrain = &_terrain[y * _width + begin];
+        }
+        if (_emitters && _emitters->size() > 0) {
+            span_params.floor = _emitters->row(y) + begin;
+        }
+        return span_params;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::set_sparse_propagation(const bool enabled)
+    {
+        _sparse_propagation = enabled;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    bool BasicInfluenceMap<Cell, Clamp, Border>::sparse_propagation() const
+    {
+        return _sparse_propagation;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMap<Cell, Clamp, Border>::num_active_tiles() const
+    {
+        return _num_active_tiles;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMap<Cell, Clamp, Border>::num_tiles() const
+    {
+        return _tiles_x * _tiles_y;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::mark_all_tiles_changed()
+    {
+        std::fill(_tile_changed.begin(), _tile_changed.end(), 1);
+        std::fill(_tile_stale.begin(), _tile_stale.end(), 1);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::mark_tiles_changed(const size_t x_begin,
+                                                                    const size_t y_begin,
+                                                                    const size_t x_end,
+                                                                    const size_t y_end)
+    {
+        // Marks every tile overlapping the cells [x_begin, x_end) x [y_begin, y_end).
+        if (x_begin >= x_end || y_begin >= y_end) {
+            return;
+        }
+        
+        for (size_t ty = y_begin / TILE_SIZE; ty <= (y_end - 1) / TILE_SIZE; ty++) {
+            for (size_t tx = x_begin / TILE_SIZE; tx <= (x_end - 1) / TILE_SIZE; tx++) {
+                _tile_changed[ty * _tiles_x + tx] = 1;
+                _tile_stale[ty * _tiles_x + tx] = 1;
+            }
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    const typename BasicInfluenceMap<Cell, Clamp, Border>::StampKernel& BasicInfluenceMap<Cell, Clamp, Border>::stamp_kernel(const size_t radius,
+                                                                                                                              const StampFalloff falloff)
+    {
+        return _stamp_kernels[detail::find_stamp_kernel(_stamp_kernels, radius, falloff)];
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::stamp_kernel_at(const size_t x,
+                                                                 const size_t y,
+                                                                 const StampKernel& kernel,
+                                                                 const Value strength,
+                                                                 const StampBlend blend,
+                                                                 const Kernels& kernels)
+    {
+        XASSERT(x < _width && y < _height, "stamp centre out of bounds");
+        
+        // Clip the disc to the map once, then hand each row to the kernel.
+        const size_t radius = kernel.radius;
+        const size_t diameter = 2 * radius + 1;
+        const size_t y_begin = y >= radius ? y - radius : 0;
+        const size_t y_end = std::min(y + radius + 1, _height);
+        const bool clamp = Clamp::clamps(_clamp_values_to_0_1);
+        
+        size_t x_begin = x;
+        size_t x_end = x + 1;
+        for (size_t row = y_begin; row < y_end; row++) {
+            const size_t kernel_row = row + radius - y;
+            const size_t half_width = kernel.half_widths[kernel_row];
+            const size_t begin = x >= half_width ? x - half_width : 0;
+            const size_t end = std::min(x + half_width + 1, _width);
+            const Value * const weights = &kernel.weights[kernel_row * diameter + (begin + radius - x)];
+            
+            Cell * const cells = _data + row_offset(row);
+            kernels.stamp_row(cells + begin, weights, end - begin, strength, blend,
+                              clamp, Clamp::template lowest<Value>(), Clamp::template highest<Value>());
+            zero_obstacle_span(cells + begin, row, begin, end);
+            
+            x_begin = std::min(x_begin, begin);
+            x_end = std::max(x_end, end);
+        }
+        
+        mark_tiles_changed(x_begin, y_begin, x_end, y_end);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::stamp(const size_t x,
+                                                       const size_t y,
+                                                       const size_t radius,
+                                                       const Value strength,
+                                                       const StampFalloff falloff,
+                                                       const StampBlend blend)
+    {
+        const Kernels kernels = detail::cell_kernels<Cell>();
+        claim_data();
+        stamp_kernel_at(x, y, stamp_kernel(radius, falloff), strength, blend, kernels);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::stamp_many(const StampSource * const sources, const size_t count, const StampBlend blend)
+    {
+        const Kernels kernels = detail::cell_kernels<Cell>();
+        claim_data();
+        
+        // Sources usually come in runs of the same size and falloff, so only
+        // look the kernel up when that changes.
+        const StampKernel* kernel = nullptr;
+        for (size_t i = 0; i < count; i++) {
+            const StampSource& source = sources[i];
+            if (!kernel || kernel->radius != source.radius || kernel->falloff != source.falloff) {
+                kernel = &stamp_kernel(source.radius, source.falloff);
+            }
+            stamp_kernel_at(source.x, source.y, *kernel, source.strength, blend, kernels);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::apply_emitters(const BasicEmitterField<Value>& field)
+    {
+        XASSERT(field.width() == _width && field.height() == _height, "emitter field is a different size");
+        
+        typedef BasicEmitterField<Value> Field;
+        const Kernels kernels = detail::cell_kernels<Cell>();
+        const bool clamp = Clamp::clamps(_clamp_values_to_0_1);
+        const size_t field_tiles_y = (_height + Field::TILE_SIZE - 1) / Field::TILE_SIZE;
+        claim_data();
+        
+        for (size_t ty = 0; ty < field_tiles_y; ty++) {
+            const size_t y_begin = ty * Field::TILE_SIZE;
+            const size_t y_end = std::min(y_begin + Field::TILE_SIZE, _height);
+            
+            // Runs of covered tiles along the row go to the kernel as one span.
+            for (size_t tx = 0; tx < field._tiles_x; tx++) {
+                if (!field.tile_covered(tx, ty)) {
+                    continue;
+                }
+                
+                const size_t begin = tx * Field::TILE_SIZE;
+                while (tx + 1 < field._tiles_x && field.tile_covered(tx + 1, ty)) {
+                    tx++;
+                }
+                const size_t end = std::min((tx + 1) * Field::TILE_SIZE, _width);
+                
+                for (size_t y = y_begin; y < y_end; y++) {
+                    Cell * const cells = _data + row_offset(y);
+                    kernels.stamp_row(cells + begin, field.row(y) + begin, end - begin, Value(1), StampMax,
+                                      clamp, Clamp::template lowest<Value>(), Clamp::template highest<Value>());
+                    zero_obstacle_span(cells + begin, y, begin, end);
+                }
+                mark_tiles_changed(begin, y_begin, end, y_end);
+            }
+        }
+        
+        const std::vector<CellRect>& dirty = field.dirty_rects();
+        for (size_t i = 0; i < dirty.size(); i++) {
+            mark_tiles_changed(dirty[i].x_begin, dirty[i].y_begin, dirty[i].x_end, dirty[i].y_end);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::EmitterHandle BasicInfluenceMap<Cell, Clamp, Border>::add_emitter(const StampSource& source)
+    {
+        if (!_emitters) {
+            _emitters.reset(new BasicEmitterField<Value>(_width, _height, StampMax));
+        }
+        
+        const EmitterHandle handle = _emitters->add(source);
+        mark_emitters_changed();
+        return handle;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::update_emitter(const EmitterHandle handle, const StampSource& source)
+    {
+        XASSERT(_emitters, "not a registered emitter");
+        _emitters->update(handle, source);
+        mark_emitters_changed();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::move_emitter(const EmitterHandle handle, const size_t x, const size_t y)
+    {
+        XASSERT(_emitters, "not a registered emitter");
+        _emitters->move(handle, x, y);
+        mark_emitters_changed();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::set_emitter_strength(const EmitterHandle handle, const Value strength)
+    {
+        XASSERT(_emitters, "not a registered emitter");
+        _emitters->set_strength(handle, strength);
+        mark_emitters_changed();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::remove_emitter(const EmitterHandle handle)
+    {
+        XASSERT(_emitters, "not a registered emitter");
+        _emitters->remove(handle);
+        mark_emitters_changed();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    const typename BasicInfluenceMap<Cell, Clamp, Border>::StampSource& BasicInfluenceMap<Cell, Clamp, Border>::emitter(const EmitterHandle handle) const
+    {
+        XASSERT(_emitters, "not a registered emitter");
+        return _emitters->source(handle);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMap<Cell, Clamp, Border>::num_emitters() const
+    {
+        return _emitters ? _emitters->size() : 0;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::mark_emitters_changed()
+    {
+        // Tiles sparse propagation has let settle must wake up to take a new
+        // floor, and to let go of an old one.
+        const std::vector<CellRect>& dirty = _emitters->dirty_rects();
+        for (size_t i = 0; i < dirty.size(); i++) {
+            mark_tiles_changed(dirty[i].x_begin, dirty[i].y_begin, dirty[i].x_end, dirty[i].y_end);
+        }
+        _emitters->clear_dirty();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::peak_influence() const
+    {
+        const Kernels kernels = detail::cell_kernels<Cell>();
+        Value peak = -INFINITY;
+        for (size_t y = 0; y < _height; y++) {
+            peak = kernels.max(_data + row_offset(y), _width, peak);
+        }
+        return peak;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::connections(const size_t x,
+                                                             const size_t y,
+                                                             Value * const connections_array,
+                                                             const Value influence_weight,
+                                                             const Value out_of_bounds_value) const
+    {
+        connections(_data, x, y, connections_array, influence_weight, out_of_bounds_value);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::connections(const size_t x,
+                                                             const size_t y,
+                                                             Value * const connections_array,
+                                                             const Value influence_weight) const
+    {
+        connections(_data, x, y, connections_array, influence_weight);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::add_connections(const size_t x,
+                                                                 const size_t y,
+                                                                 Value * const connections_array,
+                                                                 const Value influence_weight) const
+    {
+        add_connections(_data, x, y, connections_array, influence_weight);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::connections(const Cell * const cells,
+                                                             const size_t x,
+                                                             const size_t y,
+                                                             Value * const connections_array,
+                                                             const Value influence_weight,
+                                                             const Value out_of_bounds_value) const
+    {
+        typedef CellTraits<Cell> Traits;
+        
+        if (!Border::CONSTANT) {
+            connections(cells, x, y, connections_array, influence_weight);
+            return;
+        }
+        
+        // The halo makes every neighbour readable, so read all of them and only
+        // patch in out_of_bounds_value for cells on the edge of the map.
+        const size_t i = coords_to_linear(x, y);
+        const Cell * const above = cells + i - _stride;
+        const Cell * const row = cells + i;
+        const Cell * const below = cells + i + _stride;
+        
+        connections_array[ConnectionIndex::TopLeft]      = Traits::decode(above[-1]) * influence_weight;
+        connections_array[ConnectionIndex::TopMiddle]    = Traits::decode(above[0]) * influence_weight;
+        connections_array[ConnectionIndex::TopRight]     = Traits::decode(above[1]) * influence_weight;
+        connections_array[ConnectionIndex::MiddleRight]  = Traits::decode(row[1]) * influence_weight;
+        connections_array[ConnectionIndex::BottomRight]  = Traits::decode(below[1]) * influence_weight;
+        connections_array[ConnectionIndex::BottomMiddle] = Traits::decode(below[0]) * influence_weight;
+        connections_array[ConnectionIndex::BottomLeft]   = Traits::decode(below[-1]) * influence_weight;
+        connections_array[ConnectionIndex::MiddleLeft]   = Traits::decode(row[-1]) * influence_weight;
+        
+        if (is_interior(x, y)) {
+            return;
+        }
+        
+        if (y == 0) {
+            connections_array[ConnectionIndex::TopLeft]      = out_of_bounds_value;
+            connections_array[ConnectionIndex::TopMiddle]    = out_of_bounds_value;
+            connections_array[ConnectionIndex::TopRight]     = out_of_bounds_value;
+        }
+        if (y == _height - 1) {
+            connections_array[ConnectionIndex::BottomLeft]   = out_of_bounds_value;
+            connections_array[ConnectionIndex::BottomMiddle] = out_of_bounds_value;
+            connections_array[ConnectionIndex::BottomRight]  = out_of_bounds_value;
+        }
+        if (x == 0) {
+            connections_array[ConnectionIndex::TopLeft]      = out_of_bounds_value;
+            connections_array[ConnectionIndex::MiddleLeft]   = out_of_bounds_value;
+            connections_array[ConnectionIndex::BottomLeft]   = out_of_bounds_value;
+        }
+        if (x == _width - 1) {
+            connections_array[ConnectionIndex::TopRight]     = out_of_bounds_value;
+            connections_array[ConnectionIndex::MiddleRight]  = out_of_bounds_value;
+            connections_array[ConnectionIndex::BottomRight]  = out_of_bounds_value;
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::connections(const Cell * const cells,
+                                                             const size_t x,
+                                                             const size_t y,
+                                                             Value * const connections_array,
+                                                             const Value influence_weight) const
+    {
+        typedef CellTraits<Cell> Traits;
+        
+        if (is_interior(x, y)) {
+            const size_t i = coords_to_linear(x, y);
+            const Cell * const above = cells + i - _stride;
+            const Cell * const row = cells + i;
+            const Cell * const below = cells + i + _stride;
+            
+            connections_array[ConnectionIndex::TopLeft]      = Traits::decode(above[-1]) * influence_weight;
+            connections_array[ConnectionIndex::TopMiddle]    = Traits::decode(above[0]) * influence_weight;
+            connections_array[ConnectionIndex::TopRight]     = Traits::decode(above[1]) * influence_weight;
+            connections_array[ConnectionIndex::MiddleRight]  = Traits::decode(row[1]) * influence_weight;
+            connections_array[ConnectionIndex::BottomRight]  = Traits::decode(below[1]) * influence_weight;
+            connections_array[ConnectionIndex::BottomMiddle] = Traits::decode(below[0]) * influence_weight;
+            connections_array[ConnectionIndex::BottomLeft]   = Traits::decode(below[-1]) * influence_weight;
+            connections_array[ConnectionIndex::MiddleLeft]   = Traits::decode(row[-1]) * influence_weight;
+            return;
+        }
+        
+        // The halo is only refreshed when propagating, so edge cells ask the
+        // border directly.
+        connections_array[ConnectionIndex::TopLeft]      = border_connection(cells, x, y, -1, -1, influence_weight);
+        connections_array[ConnectionIndex::TopMiddle]    = border_connection(cells, x, y,  0, -1, influence_weight);
+        connections_array[ConnectionIndex::TopRight]     = border_connection(cells, x, y,  1, -1, influence_weight);
+        connections_array[ConnectionIndex::MiddleRight]  = border_connection(cells, x, y,  1,  0, influence_weight);
+        connections_array[ConnectionIndex::BottomRight]  = border_connection(cells, x, y,  1,  1, influence_weight);
+        connections_array[ConnectionIndex::BottomMiddle] = border_connection(cells, x, y,  0,  1, influence_weight);
+        connections_array[ConnectionIndex::BottomLeft]   = border_connection(cells, x, y, -1,  1, influence_weight);
+        connections_array[ConnectionIndex::MiddleLeft]   = border_connection(cells, x, y, -1,  0, influence_weight);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::border_connection(const Cell * const cells,
+                                                                                                                     const size_t x,
+                                                                                                                     const size_t y,
+                                                                                                                     const int dx,
+                                                                                                                     const int dy,
+                                                                                                                     const Value influence_weight) const
+    {
+        ptrdiff_t neighbour_x = ptrdiff_t(x) + dx;
+        ptrdiff_t neighbour_y = ptrdiff_t(y) + dy;
+        
+        if (Border::resolve(neighbour_x, _width) && Border::resolve(neighbour_y, _height)) {
+            return CellTraits<Cell>::decode(cells[coords_to_linear(size_t(neighbour_x), size_t(neighbour_y))]) * influence_weight;
+        }
+        return Border::template value<Value>() * influence_weight;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::add_connections(const Cell * const cells,
+                                                                 const size_t x,
+                                                                 const size_t y,
+                                                                 Value * const connections_array,
+                                                                 const Value influence_weight) const
+    {
+        typedef CellTraits<Cell> Traits;
+        
+        const size_t i = coords_to_linear(x, y);
+        
+        if (is_interior(x, y)) {
+            const Cell * const above = cells + i - _stride;
+            const Cell * const row = cells + i;
+            const Cell * const below = cells + i + _stride;
+            
+            connections_array[ConnectionIndex::TopLeft]      = Traits::decode(above[-1]) * influence_weight + connections_array[ConnectionIndex::TopLeft];
+            connections_array[ConnectionIndex::TopMiddle]    = Traits::decode(above[0]) * influence_weight + connections_array[ConnectionIndex::TopMiddle];
+            connections_array[ConnectionIndex::TopRight]     = Traits::decode(above[1]) * influence_weight + connections_array[ConnectionIndex::TopRight];
+            connections_array[ConnectionIndex::MiddleRight]  = Traits::decode(row[1]) * influence_weight + connections_array[ConnectionIndex::MiddleRight];
+            connections_array[ConnectionIndex::BottomRight]  = Traits::decode(below[1]) * influence_weight + connections_array[ConnectionIndex::BottomRight];
+            connections_array[ConnectionIndex::BottomMiddle] = Traits::decode(below[0]) * influence_weight + connections_array[ConnectionIndex::BottomMiddle];
+            connections_array[ConnectionIndex::BottomLeft]   = Traits::decode(below[-1]) * influence_weight + connections_array[ConnectionIndex::BottomLeft];
+            connections_array[ConnectionIndex::MiddleLeft]   = Traits::decode(row[-1]) * influence_weight + connections_array[ConnectionIndex::MiddleLeft];
+            return;
+        }
+        
+        if (!Border::CONSTANT) {
+            static const int offsets[CONNECTIONS_ARRAY_LENGTH][2] = {
+                { -1, -1 }, { 0, -1 }, { 1, -1 }, { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }
+            };
+            for (size_t c = 0; c < CONNECTIONS_ARRAY_LENGTH; c++) {
+                ptrdiff_t neighbour_x = ptrdiff_t(x) + offsets[c][0];
+                ptrdiff_t neighbour_y = ptrdiff_t(y) + offsets[c][1];
+                if (Border::resolve(neighbour_x, _width) && Border::resolve(neighbour_y, _height)) {
+                    const Value influence = Traits::decode(cells[coords_to_linear(size_t(neighbour_x), size_t(neighbour_y))]);
+                    connections_array[c] = influence * influence_weight + connections_array[c];
+                }
+            }
+            return;
+        }
+        
+        // Adding the halo's zeros would be almost the same as skipping out of
+        // bounds cells, but not for -0 sums or infinite weights.
+        if (y > 0) {
+            if (x > 0) connections_array[ConnectionIndex::TopLeft] = Traits::decode(cells[i - _stride - 1]) * influence_weight + connections_array[ConnectionIndex::TopLeft];
+            connections_array[ConnectionIndex::TopMiddle] = Traits::decode(cells[i - _stride]) * influence_weight + connections_array[ConnectionIndex::TopMiddle];
+            if (x < _width - 1) connections_array[ConnectionIndex::TopRight] = Traits::decode(cells[i - _stride + 1]) * influence_weight + connections_array[ConnectionIndex::TopRight];
+        }
+        
+        if (x > 0) connections_array[ConnectionIndex::MiddleLeft] = Traits::decode(cells[i - 1]) * influence_weight + connections_array[ConnectionIndex::MiddleLeft];
+        if (x < _width - 1) connections_array[ConnectionIndex::MiddleRight] = Traits::decode(cells[i + 1]) * influence_weight + connections_array[ConnectionIndex::MiddleRight];
+        
+        if (y < _height - 1) {
+            if (x > 0) connections_array[ConnectionIndex::BottomLeft] = Traits::decode(cells[i + _stride - 1]) * influence_weight + connections_array[ConnectionIndex::BottomLeft];
+            connections_array[ConnectionIndex::BottomMiddle] = Traits::decode(cells[i + _stride]) * influence_weight + connections_array[ConnectionIndex::BottomMiddle];
+            if (x < _width - 1) connections_array[ConnectionIndex::BottomRight] = Traits::decode(cells[i + _stride + 1]) * influence_weight + connections_array[ConnectionIndex::BottomRight];
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::propagate_span(const size_t y,
+                                                                                                                  const size_t begin,
+                                                                                                                  const size_t end,
+                                                                                                                  const Kernels& kernels,
+                                                                                                                  const Params& params,
+                                                                                                                  const bool measure_residual)
+    {
+        // Out of bounds neighbours read the halo, which holds whatever the Border
+        // policy puts beyond the edge, so edge cells need no special case.
+        const size_t i = row_offset(y) + begin;
+        const Cell * const above = _data + i - _stride;
+        const Cell * const row = _data + i;
+        const Cell * const below = _data + i + _stride;
+        const Params span_params = row_params(params, y, begin);
+        
+        if (measure_residual) {
+            return kernels.propagate_row_residual(above, row, below, _copy + i, end - begin, span_params);
+        }
+        
+        kernels.propagate_row(above, row, below, _copy + i, end - begin, span_params);
+        return 0;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::propagate_rows(const size_t begin,
+                                                                                                                  const size_t end,
+                                                                                                                  const Kernels& kernels,
+                                                                                                                  const Params& params,
+                                                                                                                  const bool measure_residual)
+    {
+        Value residual = 0;
+        for (size_t y = begin; y < end; y++) {
+            residual = detail::max_of(propagate_span(y, 0, _width, kernels, params, measure_residual), residual);
+        }
+        return residual;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Params BasicInfluenceMap<Cell, Clamp, Border>::propagate_params(const Value momentum, const Value decay)
+    {
+        return propagate_params(momentum, decay, _edge_factors, _corner_factors, _factors_decay);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Params BasicInfluenceMap<Cell, Clamp, Border>::propagate_params(const Value momentum,
+                                                                                                                       const Value decay,
+                                                                                                                       std::vector<Value>& edge_factors,
+                                                                                                                       std::vector<Value>& corner_factors,
+                                                                                                                       Value& factors_decay) const
+    {
+        const Value edge_distance = Value(1);
+        const Value corner_distance = Value(1.414);
+        const Value edge = std::exp(-edge_distance * decay);
+        const Value corner = std::exp(-corner_distance * decay);
+        
+        Params params = {
+            momentum, edge, corner,
+            Clamp::clamps(_clamp_values_to_0_1), Clamp::template lowest<Value>(), Clamp::template highest<Value>(),
+            nullptr, 0, nullptr, nullptr, nullptr, 0, nullptr
+        };
+        
+        if (!_terrain.empty()) {
+            // A cost of 1 multiplies decay exactly, so plain terrain gets the same
+            // weights as uniform decay, bit for bit.
+            if (!(decay == factors_decay)) {
+                edge_factors.resize(NUM_TERRAIN_TYPES);
+                corner_factors.resize(NUM_TERRAIN_TYPES);
+                for (size_t terrain = 0; terrain < NUM_TERRAIN_TYPES; terrain++) {
+                    const Value terrain_decay = decay * _terrain_costs[terrain];
+                    edge_factors[terrain] = std::exp(-edge_distance * terrain_decay);
+                    corner_factors[terrain] = std::exp(-corner_distance * terrain_decay);
+                }
+                factors_decay = decay;
+            }
+            params.edge_factors = &edge_factors[0];
+            params.corner_factors = &corner_factors[0];
+            params.terrain_types = _terrain_types;
+        }
+        
+        return params;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::propagate(const Value momentum, const Value decay)
+    {
+        propagate_all(momentum, decay, false);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::propagate_with_residual(const Value momentum, const Value decay)
+    {
+        return propagate_all(momentum, decay, true);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Convergence BasicInfluenceMap<Cell, Clamp, Border>::propagate_until_stable(const Value momentum,
+                                                                                                                                const Value decay,
+                                                                                                                                const Value epsilon,
+                                                                                                                                const size_t max_iterations)
+    {
+        Convergence convergence = { 0, INFINITY };
+        
+        while (convergence.iterations < max_iterations && !(convergence.residual <= epsilon)) {
+            convergence.residual = propagate_with_residual(momentum, decay);
+            convergence.iterations++;
+        }
+        
+        return convergence;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::propagate_all(const Value momentum, const Value decay, const bool measure_residual)
+    {
+        const Kernels kernels = detail::cell_kernels<Cell>();
+        const Params params = begin_step(momentum, decay);
+        
+        if (_sparse_propagation) {
+            return propagate_sparse(kernels, params);
+        }
+        
+        Value residual = 0;
+        
+        if (_thread_pool && _thread_pool->num_threads() > 1 && _height >= MIN_ROWS_PER_BAND * 2) {
+            // Each output row only reads three input rows and nothing writes the
+            // input, so bands can run in any order. Several bands per thread
+            // evens out threads that get descheduled.
+            const size_t max_bands = _thread_pool->num_threads() * 4;
+            const size_t num_bands = std::min(max_bands, _height / MIN_ROWS_PER_BAND);
+            const size_t rows_per_band = (_height + num_bands - 1) / num_bands;
+            std::vector<Value> band_residuals(num_bands, Value(0));
+            
+            _thread_pool->parallel_for(num_bands, [&](const size_t band) {
+                const size_t begin = band * rows_per_band;
+                const size_t end = std::min(begin + rows_per_band, _height);
+                band_residuals[band] = propagate_rows(begin, end, kernels, params, measure_residual);
+            });
+            
+            for (size_t band = 0; band < num_bands; band++) {
+                residual = detail::max_of(band_residuals[band], residual);
+            }
+        } else {
+            residual = propagate_rows(0, _height, kernels, params, measure_residual);
+        }
+        
+        finish_step();
+        return residual;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Params BasicInfluenceMap<Cell, Clamp, Border>::begin_step(const Value momentum, const Value decay)
+    {
+        const Params params = propagate_params(momentum, decay);
+        claim_back_buffer();
+        
+        if (!Border::CONSTANT) {
+            refresh_halo();
+        }
+        
+        return params;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::finish_step()
+    {
+        swap_buffers();
+        
+        mark_all_tiles_changed();
+        _num_active_tiles = num_tiles();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::propagate_sparse(const Kernels& kernels, const Params& params)
+    {
+        // A cell's next value depends only on its own value and its neighbours'
+        // under fixed parameters. So a tile whose cells all came out of the last
+        // step unchanged, and whose neighbouring tiles did too, is at a fixed
+        // point and would come out of this step unchanged again.
+        _num_active_tiles = find_active_tiles(params, _sparse_params, _tile_changed, _tile_active);
+        
+        Value residual = 0;
+        
+        if (_thread_pool && _thread_pool->num_threads() > 1 && _tiles_y > 1) {
+            std::vector<Value> row_residuals(_tiles_y, Value(0));
+            
+            _thread_pool->parallel_for(_tiles_y, [&](const size_t tile_y) {
+                row_residuals[tile_y] = propagate_tile_row(tile_y, kernels, params);
+            });
+            
+            for (size_t tile_y = 0; tile_y < _tiles_y; tile_y++) {
+                residual = detail::max_of(row_residuals[tile_y], residual);
+            }
+        } else {
+            for (size_t tile_y = 0; tile_y < _tiles_y; tile_y++) {
+                residual = detail::max_of(propagate_tile_row(tile_y, kernels, params), residual);
+            }
+        }
+        
+        swap_buffers();
+        
+        return residual;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMap<Cell, Clamp, Border>::find_active_tiles(const Params& params,
+                                                                     Params& last_params,
+                                                                     std::vector<unsigned char>& changed,
+                                                                     std::vector<unsigned char>& active) const
+    {
+        if (params.momentum != last_params.momentum ||
+            params.edge != last_params.edge ||
+            params.corner != last_params.corner) {
+            std::fill(changed.begin(), changed.end(), 1);
+            last_params = params;
+        }
+        
+        // Neighbouring tiles are found the same way as neighbouring cells, so
+        // on a WrapBorder map tiles on opposite edges are neighbours. The last
+        // tile in a row or column may be partial, but it holds the last cell,
+        // which is the one that wraps around.
+        size_t num_active = 0;
+        for (size_t ty = 0; ty < _tiles_y; ty++) {
+            for (size_t tx = 0; tx < _tiles_x; tx++) {
+                unsigned char tile_active = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    ptrdiff_t ny = ptrdiff_t(ty) + dy;
+                    if (!Border::resolve(ny, _tiles_y)) continue;
+                    for (int dx = -1; dx <= 1; dx++) {
+                        ptrdiff_t nx = ptrdiff_t(tx) + dx;
+                        if (!Border::resolve(nx, _tiles_x)) continue;
+                        tile_active |= changed[size_t(ny) * _tiles_x + size_t(nx)];
+                    }
+                }
+                active[ty * _tiles_x + tx] = tile_active;
+                num_active += tile_active;
+            }
+        }
+        return num_active;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::propagate_tile_row(const size_t tile_y,
+                                                                                                                      const Kernels& kernels,
+                                                                                                                      const Params& params)
+    {
+        const size_t y_begin = tile_y * TILE_SIZE;
+        const size_t y_end = std::min(y_begin + TILE_SIZE, _height);
+        Value residual = 0;
+        
+        for (size_t tile_x = 0; tile_x < _tiles_x; tile_x++) {
+            const size_t tile = tile_y * _tiles_x + tile_x;
+            const size_t x_begin = tile_x * TILE_SIZE;
+            const size_t x_end = std::min(x_begin + TILE_SIZE, _width);
+            
+            if (_tile_active[tile]) {
+                Value tile_residual = 0;
+                for (size_t y = y_begin; y < y_end; y++) {
+                    tile_residual = detail::max_of(propagate_span(y, x_begin, x_end, kernels, params, true), tile_residual);
+                }
+                
+                // A NaN cell stays NaN without affecting its neighbours, so it
+                // does not keep its tile active. A cell going from -0 to +0
+                // changes without adding to the residual, so a tile only
+                // settles once its cells come out the same bits as before.
+                bool tile_changed = tile_residual > 0;
+                for (size_t y = y_begin; !tile_changed && y < y_end; y++) {
+                    const size_t offset = row_offset(y) + x_begin;
+                    tile_changed = memcmp(_data + offset, _copy + offset, (x_end - x_begin) * sizeof(Cell)) != 0;
+                }
+                _tile_changed[tile] = tile_changed;
+                _tile_stale[tile] = 1;
+                residual = detail::max_of(tile_residual, residual);
+            } else if (_tile_stale[tile]) {
+                // The back buffer still holds this tile from an earlier step.
+                for (size_t y = y_begin; y < y_end; y++) {
+                    std::copy(_data + row_offset(y) + x_begin, _data + row_offset(y) + x_end, _copy + row_offset(y) + x_begin);
+                }
+                _tile_stale[tile] = 0;
+            }
+        }
+        
+        return residual;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::propagate_steps(const size_t steps, const Value momentum, const Value decay)
+    {
+        if (!Border::CONSTANT) {
+            // Column blocks only see their own columns, so they can't follow a
+            // border that maps onto cells elsewhere in the map.
+            for (size_t step = 0; step < steps; step++) {
+                propagate(momentum, decay);
+            }
+            return;
+        }
+        
+        size_t remaining = steps;
+        while (remaining > 0) {
+            const size_t pass_steps = std::min(remaining, MAX_STEPS_PER_PASS);
+            if (pass_steps == 1) {
+                propagate(momentum, decay);
+            } else {
+                propagate_blocked(pass_steps, momentum, decay);
+            }
+            remaining -= pass_steps;
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::propagate_blocked(const size_t steps, const Value momentum, const Value decay)
+    {
+        const Kernels kernels = detail::cell_kernels<Cell>();
+        const Params params = propagate_params(momentum, decay);
+        claim_back_buffer();
+        
+        // Each column block keeps three rows per step in flight, sized so that
+        // all of them stay in cache. Blocks overlap by `steps` columns either
+        // side, so narrow blocks waste work; never go below a sensible minimum.
+        const size_t ring_cells = TEMPORAL_BLOCK_BYTES / (sizeof(Cell) * 3 * steps);
+        const size_t max_block_width = std::max(ring_cells > 2 * steps + 2 ? ring_cells - 2 * steps - 2 : 0,
+                                                MIN_TEMPORAL_BLOCK_WIDTH);
+        const size_t num_blocks = (_width + max_block_width - 1) / max_block_width;
+        const size_t block_width = (_width + num_blocks - 1) / num_blocks;
+        
+        // Each block only ever touches its own scratch, whichever thread
+        // runs it.
+        if (_block_scratch.size() < num_blocks) {
+            _block_scratch.resize(num_blocks);
+        }
+        
+        auto run_block = [&](const size_t block) {
+            const size_t begin = block * block_width;
+            const size_t end = std::min(begin + block_width, _width);
+            propagate_column_block(begin, end, steps, kernels, params, _block_scratch[block]);
+        };
+        
+        if (_thread_pool && _thread_pool->num_threads() > 1 && num_blocks > 1) {
+            _thread_pool->parallel_for(num_blocks, run_block);
+        } else {
+            for (size_t block = 0; block < num_blocks; block++) {
+                run_block(block);
+            }
+        }
+        
+        swap_buffers();
+        
+        mark_all_tiles_changed();
+        _num_active_tiles = num_tiles();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::propagate_column_block(const size_t begin,
+                                                                        const size_t end,
+                                                                        const size_t steps,
+                                                                        const Kernels& kernels,
+                                                                        const Params& params,
+                                                                        std::vector<Cell>& scratch)
+    {
+        // Step s of this block covers `steps - s` extra columns either side of
+        // [begin, end), which is exactly what step s + 1 reads, so the last step
+        // comes out identical to running propagate() over the whole map `steps`
+        // times. Step 0 is a copy of the input.
+        //
+        // Rather than whole maps, each step keeps a ring of its three most
+        // recent rows. Steps lag one row behind the step before them, so on
+        // iteration i step s produces row i - s from rows i - s - 1 .. i - s + 1
+        // of step s - 1, the newest of which was produced earlier in the same
+        // iteration.
+        //
+        // Ring rows have a spare border cell past each end, and anything outside
+        // the map is never written, so it reads as the border just like the
+        // halo does. Rows above and below the map are a shared border row.
+        const ptrdiff_t origin = ptrdiff_t(begin) - ptrdiff_t(steps) - 1;
+        const size_t row_length = (end - begin) + 2 * steps + 2;
+        
+        scratch.assign((3 * steps + 1) * row_length, CellTraits<Cell>::encode(Border::template value<Value>()));
+        const Cell * const border_row = &scratch[3 * steps * row_length];
+        
+        for (size_t i = 0; i < _height + steps; i++) {
+            if (i < _height) {
+                const size_t lo = size_t(std::max(ptrdiff_t(0), ptrdiff_t(begin) - ptrdiff_t(steps)));
+                const size_t hi = std::min(end + steps, _width);
+                Cell * const ring_row = &scratch[(i % 3) * row_length];
+                std::copy(_data + row_offset(i) + lo, _data + row_offset(i) + hi, ring_row + (ptrdiff_t(lo) - origin));
+            }
+            
+            for (size_t s = 1; s <= steps && s <= i; s++) {
+                const size_t y = i - s;
+                if (y >= _height) continue;
+                
+                const size_t lo = size_t(std::max(ptrdiff_t(0), ptrdiff_t(begin) - ptrdiff_t(steps - s)));
+                const size_t hi = std::min(end + (steps - s), _width);
+                const ptrdiff_t offset = ptrdiff_t(lo) - origin;
+                
+                const Cell * const previous = &scratch[3 * (s - 1) * row_length];
+                const Cell * const above = y > 0 ? previous + ((y - 1) % 3) * row_length : border_row;
+                const Cell * const row = previous + (y % 3) * row_length;
+                const Cell * const below = y + 1 < _height ? previous + ((y + 1) % 3) * row_length : border_row;
+                
+                Cell * const out = s == steps
+                    ? _copy + row_offset(y) + lo
+                    : &scratch[(3 * s + y % 3) * row_length] + offset;
+                
+                kernels.propagate_row(above + offset, row + offset, below + offset, out, hi - lo, row_params(params, y, lo));
+            }
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::solve_steady_state(const Value decay)
+    {
+        typedef CellTraits<Cell> Traits;
+        
+        XASSERT(decay >= Value(0), "decay must not be negative or there is no steady state");
+        
+        if (_width == 0) {
+            return;
+        }
+        
+        const Params params = propagate_params(Value(1), decay);
+        claim_data();
+        
+        // The weights for influence entering cell x of a row, which only vary
+        // along the row with terrain.
+        auto edge_at = [&](const uint8_t * const terrain, const size_t x) {
+            return terrain ? params.edge_factors[terrain[x]] : params.edge;
+        };
+        auto corner_at = [&](const uint8_t * const terrain, const size_t x) {
+            return terrain ? params.corner_factors[terrain[x]] : params.corner;
+        };
+        auto terrain_row = [&](const size_t y) -> const uint8_t * {
+            return _terrain.empty() ? nullptr : &_terrain[y * _width];
+        };
+        
+        // A constant border is a source just beyond every edge cell, and the
+        // nearest part of it is always an edge away.
+        const Value border = Border::template value<Value>();
+        if (Border::CONSTANT && border > Value(0)) {
+            for (size_t y = 0; y < _height; y++) {
+                Cell * const row = _data + row_offset(y);
+                const uint8_t * const terrain = terrain_row(y);
+                const size_t step = (y == 0 || y + 1 == _height) ? 1 : _width - 1;
+                for (size_t x = 0; x < _width; x += std::max(step, size_t(1))) {
+                    row[x] = Traits::encode(detail::max_of(border * edge_at(terrain, x), Traits::decode(row[x])));
+                }
+            }
+            zero_obstacles(_data);
+        }
+        
+        // Two chamfer sweeps. The forward sweep carries influence down and to the
+        // right, the backward sweep up and to the left, and between them every
+        // shortest 8-connected path is covered because the corner weight is less
+        // than two edge weights. Multiplying by exp(-decay * distance) factors is
+        // the usual distance addition done in log space.
+        //
+        // Within a row the neighbours from the previous row are folded in first,
+        // which vectorizes, then a scan carries influence along the row.
+        //
+        // A constant border leaves out of bounds neighbours out. Any other border
+        // is read through the halo, which only changes between pairs of sweeps,
+        // so each pair carries influence across the wrapping edges once more. A
+        // shortest path on a torus crosses each edge at most once, so three pairs
+        // always suffice, and the halo stops changing sooner when nothing wraps.
+        //
+        // Terrain breaks the shortest path guarantee, since the cheapest route
+        // may wind back and forth, so with terrain pairs of sweeps repeat until
+        // one changes nothing. Each pair follows every path that turns back at
+        // most once more, so this takes a few pairs on real maps.
+        //
+        // Obstacles are set back to zero as soon as they are written, so they
+        // never pass anything on within a sweep either.
+        const bool read_halo = !Border::CONSTANT;
+        const bool uniform = _terrain.empty();
+        const size_t max_passes = !uniform ? _width + _height : read_halo ? 3 : 1;
+        const Cell zero = Traits::encode(Value(0));
+        bool changed = false;
+        auto settle = [&](Cell& cell, const uint64_t * const obstacles, const size_t x, const Value influence) {
+            const Cell settled = obstacles && (detail::blocked_bits(obstacles, x, 1) & 1) ? zero : Traits::encode(influence);
+            if (!uniform && memcmp(&cell, &settled, sizeof(Cell)) != 0) {
+                changed = true;
+            }
+            cell = settled;
+        };
+        
+        if (read_halo) {
+            refresh_halo();
+        }
+        
+        for (size_t pass = 0; pass < max_passes; pass++) {
+            changed = false;
+            
+            for (size_t y = 0; y < _height; y++) {
+                Cell * const row = _data + row_offset(y);
+                const uint64_t * const obstacles = _obstacles.empty() ? nullptr : &_obstacles[y * _obstacle_stride];
+                const uint8_t * const terrain = terrain_row(y);
+                
+                if (y > 0 || read_halo) {
+                    const Cell * const above = row - _stride;
+                    for (size_t x = 0; x < _width; x++) {
+                        const Value edge = edge_at(terrain, x);
+                        const Value corner = corner_at(terrain, x);
+                        Value influence = Traits::decode(row[x]);
+                        if (x > 0 || read_halo) influence = detail::max_of(Traits::decode(above[ptrdiff_t(x) - 1]) * corner, influence);
+                        influence = detail::max_of(Traits::decode(above[x]) * edge, influence);
+                        if (x + 1 < _width || read_halo) influence = detail::max_of(Traits::decode(above[x + 1]) * corner, influence);
+                        settle(row[x], obstacles, x, influence);
+                    }
+                }
+                
+                for (size_t x = read_halo ? 0 : 1; x < _width; x++) {
+                    settle(row[x], obstacles, x, detail::max_of(Traits::decode(row[ptrdiff_t(x) - 1]) * edge_at(terrain, x), Traits::decode(row[x])));
+                }
+            }
+            
+            for (size_t y = _height; y-- > 0;) {
+                Cell * const row = _data + row_offset(y);
+                const uint64_t * const obstacles = _obstacles.empty() ? nullptr : &_obstacles[y * _obstacle_stride];
+                const uint8_t * const terrain = terrain_row(y);
+                
+                if (y + 1 < _height || read_halo) {
+                    const Cell * const below = row + _stride;
+                    for (size_t x = 0; x < _width; x++) {
+                        const Value edge = edge_at(terrain, x);
+                        const Value corner = corner_at(terrain, x);
+                        Value influence = Traits::decode(row[x]);
+                        if (x > 0 || read_halo) influence = detail::max_of(Traits::decode(below[ptrdiff_t(x) - 1]) * corner, influence);
+                        influence = detail::max_of(Traits::decode(below[x]) * edge, influence);
+                        if (x + 1 < _width || read_halo) influence = detail::max_of(Traits::decode(below[x + 1]) * corner, influence);
+                        settle(row[x], obstacles, x, influence);
+                    }
+                }
+                
+                for (size_t x = read_halo ? _width : _width - 1; x-- > 0;) {
+                    settle(row[x], obstacles, x, detail::max_of(Traits::decode(row[x + 1]) * edge_at(terrain, x), Traits::decode(row[x])));
+                }
+                
+                for (size_t x = 0; x < _width; x++) {
+                    row[x] = Traits::encode(clamp_influence(Traits::decode(row[x])));
+                }
+            }
+            
+            const bool halo_changed = read_halo && refresh_halo();
+            if (!halo_changed && !changed) {
+                break;
+            }
+        }
+        
+        mark_all_tiles_changed();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::set_thread_pool(ThreadPool * const thread_pool)
+    {
+        _thread_pool = thread_pool;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    ThreadPool* BasicInfluenceMap<Cell, Clamp, Border>::thread_pool() const
+    {
+        return _thread_pool;
     }
 
-    inline void InfluenceMap::set_influence(const size_t x, const size_t y, const float influence)
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::Snapshot() :
+        _map(nullptr), _buffer(0), _count(0)
+    {
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::Snapshot(const BasicInfluenceMap * const map,
+                                                               const size_t buffer,
+                                                               const size_t count) :
+        _map(map), _buffer(buffer), _count(count)
+    {
+        // snapshot() or pin_snapshot() has already counted this reader in.
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::Snapshot(const Snapshot& other) :
+        _map(other._map), _buffer(other._buffer), _count(other._count)
+    {
+        if (_map) {
+            _map->_snapshots->readers[_buffer].fetch_add(_count);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Snapshot& BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::operator=(const Snapshot& other)
+    {
+        if (other._map) {
+            other._map->_snapshots->readers[other._buffer].fetch_add(other._count);
+        }
+        release();
+        _map = other._map;
+        _buffer = other._buffer;
+        _count = other._count;
+        return *this;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::~Snapshot()
+    {
+        release();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    bool BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::valid() const
+    {
+        return _map != nullptr;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::release()
+    {
+        if (_map) {
+            _map->_snapshots->readers[_buffer].fetch_sub(_count);
+            _map = nullptr;
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::width() const
+    {
+        XASSERT(_map, "snapshot has been released");
+        return _map->_width;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::height() const
+    {
+        XASSERT(_map, "snapshot has been released");
+        return _map->_height;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    const Cell* BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::cells() const
+    {
+        XASSERT(_map, "snapshot has been released");
+        return _map->_snapshots->buffers[_buffer];
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Value BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::influence(const size_t x, const size_t y) const
+    {
+        return CellTraits<Cell>::decode(cells()[_map->coords_to_linear(x, y)]);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::connections(const size_t x,
+                                                                       const size_t y,
+                                                                       Value * const connections_array,
+                                                                       const Value influence_weight,
+                                                                       const Value out_of_bounds_value) const
     {
-        _data[coords_to_linear(x, y)] = clamp_influence(influence);
+        _map->connections(cells(), x, y, connections_array, influence_weight, out_of_bounds_value);
     }
     
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::connections(const size_t x,
+                                                                       const size_t y,
+                                                                       Value * const connections_array,
+                                                                       const Value influence_weight) const
+    {
+        _map->connections(cells(), x, y, connections_array, influence_weight);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::Snapshot::add_connections(const size_t x,
+                                                                           const size_t y,
+                                                                           Value * const connections_array,
+                                                                           const Value influence_weight) const
+    {
+        _map->add_connections(cells(), x, y, connections_array, influence_weight);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::enable_snapshots()
+    {
+        if (_snapshots) {
+            return;
+        }
+        
+        Cell * const spare = allocate_buffer();
+        XASSERT(spare, "out of memory allocating influence map");
+        if (Border::CONSTANT && Border::template value<Value>() != Value(0)) {
+            fill_halo(spare, Border::template value<Value>());
+        }
+        
+        _snapshots.reset(new SnapshotState());
+        _snapshots->buffers[0] = _data;
+        _snapshots->buffers[1] = _copy;
+        _snapshots->buffers[2] = spare;
+        _snapshots->published.store(0);
+        for (size_t i = 0; i < SnapshotState::NUM_BUFFERS; i++) {
+            _snapshots->readers[i].store(0);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    bool BasicInfluenceMap<Cell, Clamp, Border>::snapshots_enabled() const
+    {
+        return _snapshots != nullptr;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Snapshot BasicInfluenceMap<Cell, Clamp, Border>::snapshot() const
+    {
+        XASSERT(_snapshots, "snapshots are not enabled");
+        SnapshotState& state = *_snapshots;
+        
+        // Count in on the published buffer, then check it is still the one
+        // published. If it is, no step can have claimed it since: the writer
+        // publishes before it looks at the count, and we count in before we
+        // look again. If it isn't, a step published in between and may be
+        // writing it, so count out and try the new one.
+        for (;;) {
+            const size_t buffer = state.published.load();
+            state.readers[buffer].fetch_add(1);
+            if (state.published.load() == buffer) {
+                return Snapshot(this, buffer, 1);
+            }
+            state.readers[buffer].fetch_sub(1);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMap<Cell, Clamp, Border>::Snapshot BasicInfluenceMap<Cell, Clamp, Border>::pin_snapshot() const
+    {
+        // Readers of snapshot() go on seeing the last step: the front buffer
+        // is only read here, and the next write copies it before changing it,
+        // as it does for any buffer being read.
+        XASSERT(_snapshots, "snapshots are not enabled");
+        const size_t buffer = buffer_index(_data);
+        _snapshots->readers[buffer].fetch_add(SnapshotState::PIN);
+        return Snapshot(this, buffer, SnapshotState::PIN);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::publish()
+    {
+        if (_snapshots) {
+            _snapshots->published.store(buffer_index(_data));
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMap<Cell, Clamp, Border>::buffer_index(const Cell * const buffer) const
+    {
+        for (size_t i = 0; i < SnapshotState::NUM_BUFFERS; i++) {
+            if (_snapshots->buffers[i] == buffer) {
+                return i;
+            }
+        }
+        XASSERT(false, "not one of the map's buffers");
+        return 0;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    bool BasicInfluenceMap<Cell, Clamp, Border>::buffer_writable(const size_t buffer) const
+    {
+        return _snapshots->published.load() != buffer && _snapshots->readers[buffer].load() == 0;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    bool BasicInfluenceMap<Cell, Clamp, Border>::buffer_held_by_map(const size_t buffer) const
+    {
+        // Whether only the map itself could let go of the buffer: it is
+        // published, which only the map changes, or only its forks read it.
+        const size_t readers = _snapshots->readers[buffer].load();
+        return _snapshots->published.load() == buffer || (readers != 0 && readers % SnapshotState::PIN == 0);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMap<Cell, Clamp, Border>::wait_for_writable(const size_t first, const size_t second) const
+    {
+        // Snapshots held on other threads are let go of in time. Ones that
+        // never are would leave the map waiting forever, so give up loudly,
+        // and right away if the map's own forks are what it is waiting for.
+        const std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(MAX_SNAPSHOT_WAIT_SECONDS);
+        for (;;) {
+            if (buffer_writable(first)) {
+                return first;
+            }
+            if (buffer_writable(second)) {
+                return second;
+            }
+            XASSERT(!buffer_held_by_map(first) || !buffer_held_by_map(second), "every buffer is held by the map or its forks; forks must not be held across steps");
+            XASSERT(std::chrono::steady_clock::now() < deadline, "every buffer is still held by a snapshot; snapshots must not be held across steps");
+            std::this_thread::yield();
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::claim_data()
+    {
+        // Cells are about to be changed in place, which readers of the
+        // published buffer mustn't see. So change a copy instead: what was
+        // published is left as the back buffer, which the next step won't
+        // write while it is still published or read.
+        if (!_snapshots || buffer_writable(buffer_index(_data))) {
+            return;
+        }
+        
+        const size_t data = buffer_index(_data);
+        const size_t copy = buffer_index(_copy);
+        const size_t spare = SnapshotState::NUM_BUFFERS - data - copy;
+        Cell * const claimed = _snapshots->buffers[wait_for_writable(copy, spare)];
+        std::copy(_data, _data + buffer_cells(), claimed);
+        _copy = _data;
+        _data = claimed;
+                    
+        // The back buffer is now a copy of the front one, so no tile of it is
+        // behind.
+        std::fill(_tile_stale.begin(), _tile_stale.end(), 0);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::claim_back_buffer()
+    {
+        // A step writes the back buffer, which a snapshot from two steps ago
+        // may still be reading. The third buffer is then free, unless a
+        // snapshot of the step before that is still held too, in which case
+        // wait for a reader to let go of one of them.
+        if (!_snapshots) {
+            return;
+        }
+        
+        // Changes since the last step are published with this one. Doing so
+        // now frees the buffer published before them, which is the back
+        // buffer if they were copied to the third.
+        publish();
+        
+        const size_t data = buffer_index(_data);
+        const size_t copy = buffer_index(_copy);
+        if (buffer_writable(copy)) {
+            return;
+        }
+        
+        const size_t spare = SnapshotState::NUM_BUFFERS - data - copy;
+        if (wait_for_writable(spare, copy) == spare) {
+            _copy = _snapshots->buffers[spare];
+            
+            // Sparse propagation only writes the tiles that change, and this
+            // buffer is some steps behind.
+            std::fill(_tile_stale.begin(), _tile_stale.end(), 1);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMap<Cell, Clamp, Border>::swap_buffers()
+    {
+        Cell * const tmp = _copy;
+        _copy = _data;
+        _data = tmp;
+        
+        // Publishing after every write of the step, which were all made on
+        // this thread or joined by it, lets readers that load this see them.
+        publish();
+    }
+
 } // namespace influence_map
@@ -0,0 +1,7 @@
+#include "influence_map_fork.h"
+
+namespace influence_map {
+    
+    template class BasicInfluenceMapFork<float>;
+
+} // namespace influence_map
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "influence_map.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace influence_map {
+    
+    /**
+     * A copy of a map to try things out on, such as where units might go, and
+     * propagate to see what follows. Forking copies no cells: a fork reads the
+     * map's until it changes them, one of the map's tiles at a time. Copying a
+     * fork forks it again, and the two share every tile, reference counted,
+     * until one of them changes it. So forking costs O(tiles), and a fork
+     * only ever copies the tiles it changes.
+     *
+     * Forks propagate like a map with sparse propagation, and come out with
+     * the same cells: only tiles that changed in the last step, or next to one
+     * that did, are worked out again. They start from the tiles the map last
+     * saw change. Forks of a map that propagates sparsely and has mostly
+     * settled are cheap to propagate, while the first step of a fork of a map
+     * just propagated densely works out every tile.
+     *
+     * A fork starts from the map's cells as they are, changes since the last
+     * step included, so nothing may be changing the map while it is forked.
+     * A fork reads the map's obstacles, terrain and emitters rather than
+     * copying them, so the map must outlive its forks and leave those alone
+     * meanwhile. It may go on changing its cells if snapshots are enabled:
+     * the fork then pins the map's cells as it found them, without publishing
+     * them, and the map copies them before writing again. A pin counts as a
+     * snapshot held across steps, except that a step held up only by the
+     * map's own forks asserts at once rather than waiting for them.
+     * Without snapshots the map must leave its cells alone too. Different
+     * forks can be used on different threads at once.
+     *
+     * Forks given a Workspace take their scratch space and tiles from it, so
+     * that forking and propagating over and over stops allocating.
+     */
+    template <typename Cell, typename Clamp = RuntimeClamp01, typename Border = ZeroBorder>
+    class BasicInfluenceMapFork
+    {
+    public:
+        typedef BasicInfluenceMap<Cell, Clamp, Border> Map;
+        typedef typename Map::Value Value;
+        typedef typename Map::StampSource StampSource;
+        
+        /**
+         * Scratch space and spare tiles shared by forks on one thread. Tiles
+         * the forks let go of are kept for the next ones rather than freed.
+         * The workspace must outlive the forks using it, and those forks,
+         * with every copy of them, must only be used on one thread at a time.
+         */
+        class Workspace
+        {
+        public:
+            Workspace();
+            Workspace(const Workspace&) = delete;
+            Workspace& operator=(const Workspace&) = delete;
+            ~Workspace();
+            
+            size_t num_spare_tiles() const;
+        
+        private:
+            friend class BasicInfluenceMapFork;
+            
+            typedef std::shared_ptr<Cell> Tile;
+            
+            std::vector<Cell> _window;
+            std::vector<std::pair<size_t, Tile> > _changed;
+            std::vector<Cell*> _spare_tiles;
+            std::vector<typename Map::StampKernel> _stamp_kernels;
+        };
+        
+        explicit BasicInfluenceMapFork(const Map& map, Workspace * const workspace = nullptr);
+        
+        size_t width() const;
+        size_t height() const;
+        
+        Value influence(const size_t x, const size_t y) const;
+        
+        // As the map's own functions of the same names.
+        void set_influence(const size_t x, const size_t y, const Value influence);
+        void stamp(const size_t x,
+                   const size_t y,
+                   const size_t radius,
+                   const Value strength,
+                   const StampFalloff falloff,
+                   const StampBlend blend = StampMax);
+        void stamp_many(const StampSource * const sources, const size_t count, const StampBlend blend = StampMax);
+        void propagate(const Value momentum, const Value decay);
+        
+        /**
+         * The number of tiles this fork no longer reads from the map, whether
+         * or not it shares them with other forks.
+         */
+        size_t num_copied_tiles() const;
+        size_t num_active_tiles() const;
+        size_t num_tiles() const;
+    
+    private:
+        typedef typename Map::Kernels Kernels;
+        typedef typename Map::Params Params;
+        typedef typename Map::StampKernel StampKernel;
+        
+        // TILE_SIZE * TILE_SIZE cells, row by row, of which a partial tile on
+        // the right or bottom edge only uses the top left.
+        typedef std::shared_ptr<Cell> Tile;
+        
+        // Hands a tile's cells back to the workspace it came from, if any.
+        struct TileDeleter
+        {
+            Workspace* workspace;
+            
+            void operator()(Cell * const cells) const;
+        };
+        
+        static const size_t TILE_SIZE = Map::TILE_SIZE;
+        
+        const Map* _map;
+        Workspace* _workspace;
+        typename Map::Snapshot _snapshot;
+        const Cell* _cells;
+        
+        // The tiles copied from the map, null where it is still read.
+        std::vector<Tile> _tiles;
+        
+        std::vector<unsigned char> _tile_changed;
+        std::vector<unsigned char> _tile_active;
+        size_t _num_active_tiles;
+        Params _sparse_params;
+        
+        std::vector<Value> _edge_factors;
+        std::vector<Value> _corner_factors;
+        Value _factors_decay;
+        std::vector<StampKernel> _stamp_kernels;
+        
+        Tile new_tile();
+        
+        size_t tile_index(const size_t x, const size_t y) const;
+        size_t tile_width(const size_t tile) const;
+        size_t tile_height(const size_t tile) const;
+        const Cell* cells_at(const size_t x, const size_t y) const;
+        Cell cell_at(ptrdiff_t x, const size_t y) const;
+        Cell* writable_cells_at(const size_t x, const size_t y);
+        void load_window(const size_t x_begin, const size_t y_begin, const size_t width, const size_t height, Cell * const window) const;
+        void mark_tiles_changed(const size_t x_begin, const size_t y_begin, const size_t x_end, const size_t y_end);
+        const StampKernel& stamp_kernel(const size_t radius, const StampFalloff falloff);
+        void stamp_kernel_at(const size_t x,
+                             const size_t y,
+                             const StampKernel& kernel,
+                             const Value strength,
+                             const StampBlend blend,
+                             const Kernels& kernels);
+    };
+    
+    typedef BasicInfluenceMapFork<float> InfluenceMapFork;
+    
+    // The common float fork is built once, in influence_map_fork.cpp.
+    extern template class BasicInfluenceMapFork<float>;
+
+} // namespace influence_map
+
+#include "influence_map_fork.inl"
@@ -0,0 +1,359 @@
+#include "xassert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace influence_map {
+    
+    template <typename Cell, typename Clamp, typename Border>
+    const size_t BasicInfluenceMapFork<Cell, Clamp, Border>::TILE_SIZE;
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMapFork<Cell, Clamp, Border>::Workspace::Workspace()
+    {
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMapFork<Cell, Clamp, Border>::Workspace::~Workspace()
+    {
+        for (size_t i = 0; i < _spare_tiles.size(); i++) {
+            detail::free_cells(_spare_tiles[i]);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMapFork<Cell, Clamp, Border>::Workspace::num_spare_tiles() const
+    {
+        return _spare_tiles.size();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMapFork<Cell, Clamp, Border>::TileDeleter::operator()(Cell * const cells) const
+    {
+        if (workspace) {
+            workspace->_spare_tiles.push_back(cells);
+        } else {
+            detail::free_cells(cells);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicInfluenceMapFork<Cell, Clamp, Border>::BasicInfluenceMapFork(const Map& map, Workspace * const workspace) :
+        _map(&map),
+        _workspace(workspace),
+        _snapshot(map.snapshots_enabled() ? map.pin_snapshot() : typename Map::Snapshot()),
+        _cells(_snapshot.valid() ? _snapshot.cells() : map._data),
+        _tiles(map.num_tiles()),
+        _tile_changed(map._tile_changed),
+        _tile_active(map.num_tiles(), 0),
+        _num_active_tiles(0),
+        _sparse_params(map._sparse_params),
+        _factors_decay(NAN)
+    {
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMapFork<Cell, Clamp, Border>::width() const
+    {
+        return _map->_width;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMapFork<Cell, Clamp, Border>::height() const
+    {
+        return _map->_height;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMapFork<Cell, Clamp, Border>::Value BasicInfluenceMapFork<Cell, Clamp, Border>::influence(const size_t x, const size_t y) const
+    {
+        XASSERT(x < _map->_width, "x is greater than map width");
+        XASSERT(y < _map->_height, "y is greater than map height");
+        return CellTraits<Cell>::decode(*cells_at(x, y));
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMapFork<Cell, Clamp, Border>::set_influence(const size_t x, const size_t y, const Value influence)
+    {
+        XASSERT(x < _map->_width, "x is greater than map width");
+        XASSERT(y < _map->_height, "y is greater than map height");
+        
+        const bool obstacle = !_map->_obstacles.empty() && _map->is_obstacle(x, y);
+        *writable_cells_at(x, y) = CellTraits<Cell>::encode(obstacle ? Value(0) : _map->clamp_influence(influence));
+        _tile_changed[tile_index(x, y)] = 1;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMapFork<Cell, Clamp, Border>::stamp(const size_t x,
+                                                           const size_t y,
+                                                           const size_t radius,
+                                                           const Value strength,
+                                                           const StampFalloff falloff,
+                                                           const StampBlend blend)
+    {
+        const Kernels kernels = detail::cell_kernels<Cell>();
+        stamp_kernel_at(x, y, stamp_kernel(radius, falloff), strength, blend, kernels);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMapFork<Cell, Clamp, Border>::stamp_many(const StampSource * const sources, const size_t count, const StampBlend blend)
+    {
+        const Kernels kernels = detail::cell_kernels<Cell>();
+        for (size_t i = 0; i < count; i++) {
+            const StampSource& source = sources[i];
+            stamp_kernel_at(source.x, source.y, stamp_kernel(source.radius, source.falloff), source.strength, blend, kernels);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    const typename BasicInfluenceMapFork<Cell, Clamp, Border>::StampKernel& BasicInfluenceMapFork<Cell, Clamp, Border>::stamp_kernel(const size_t radius, const StampFalloff falloff)
+    {
+        std::vector<StampKernel>& cache = _workspace ? _workspace->_stamp_kernels : _stamp_kernels;
+        return cache[detail::find_stamp_kernel(cache, radius, falloff)];
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMapFork<Cell, Clamp, Border>::stamp_kernel_at(const size_t x,
+                                                                     const size_t y,
+                                                                     const StampKernel& kernel,
+                                                                     const Value strength,
+                                                                     const StampBlend blend,
+                                                                     const Kernels& kernels)
+    {
+        XASSERT(x < _map->_width && y < _map->_height, "stamp centre out of bounds");
+        
+        const size_t radius = kernel.radius;
+        const size_t diameter = 2 * radius + 1;
+        const size_t y_begin = y >= radius ? y - radius : 0;
+        const size_t y_end = std::min(y + radius + 1, _map->_height);
+        const bool clamp = Clamp::clamps(_map->_clamp_values_to_0_1);
+        
+        size_t x_begin = x;
+        size_t x_end = x + 1;
+        for (size_t row = y_begin; row < y_end; row++) {
+            const size_t kernel_row = row + radius - y;
+            const size_t half_width = kernel.half_widths[kernel_row];
+            const size_t begin = x >= half_width ? x - half_width : 0;
+            const size_t end = std::min(x + half_width + 1, _map->_width);
+            const Value * const weights = &kernel.weights[kernel_row * diameter + (begin + radius - x)];
+            
+            // The row is split where it crosses into another tile.
+            for (size_t span_begin = begin; span_begin < end; ) {
+                const size_t span_end = std::min((span_begin / TILE_SIZE + 1) * TILE_SIZE, end);
+                Cell * const cells = writable_cells_at(span_begin, row);
+                kernels.stamp_row(cells, weights + (span_begin - begin), span_end - span_begin, strength, blend,
+                                  clamp, Clamp::template lowest<Value>(), Clamp::template highest<Value>());
+                _map->zero_obstacle_span(cells, row, span_begin, span_end);
+                span_begin = span_end;
+            }
+            
+            x_begin = std::min(x_begin, begin);
+            x_end = std::max(x_end, end);
+        }
+        
+        mark_tiles_changed(x_begin, y_begin, x_end, y_end);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMapFork<Cell, Clamp, Border>::propagate(const Value momentum, const Value decay)
+    {
+        const Kernels kernels = detail::cell_kernels<Cell>();
+        const Params params = _map->propagate_params(momentum, decay, _edge_factors, _corner_factors, _factors_decay);
+        _num_active_tiles = _map->find_active_tiles(params, _sparse_params, _tile_changed, _tile_active);
+        
+        // Every active tile is worked out into a new tile from the old ones
+        // around it, so none can be replaced until they all have been. Tiles
+        // that come out the same are left shared.
+        const size_t window_stride = TILE_SIZE + 2;
+        std::vector<Cell> own_window;
+        std::vector<std::pair<size_t, Tile> > own_changed;
+        std::vector<Cell>& window = _workspace ? _workspace->_window : own_window;
+        std::vector<std::pair<size_t, Tile> >& changed = _workspace ? _workspace->_changed : own_changed;
+        window.resize(window_stride * window_stride);
+        changed.clear();
+        
+        for (size_t tile = 0; tile < _tiles.size(); tile++) {
+            if (!_tile_active[tile]) {
+                continue;
+            }
+            
+            const size_t x_begin = (tile % _map->_tiles_x) * TILE_SIZE;
+            const size_t y_begin = (tile / _map->_tiles_x) * TILE_SIZE;
+            const size_t width = tile_width(tile);
+            const size_t height = tile_height(tile);
+            load_window(x_begin, y_begin, width, height, &window[0]);
+            
+            const Tile next = new_tile();
+            Value residual = 0;
+            for (size_t row = 0; row < height; row++) {
+                const Cell * const above = &window[row * window_stride + 1];
+                residual = detail::max_of(kernels.propagate_row_residual(above,
+                                                                         above + window_stride,
+                                                                         above + 2 * window_stride,
+                                                                         next.get() + row * TILE_SIZE,
+                                                                         width,
+                                                                         _map->row_params(params, y_begin + row, x_begin)),
+                                          residual);
+            }
+            
+            // As in the map, a NaN cell does not keep its tile active, and a
+            // tile only settles once its cells come out the same bits.
+            bool tile_changed = residual > 0;
+            for (size_t row = 0; !tile_changed && row < height; row++) {
+                tile_changed = memcmp(next.get() + row * TILE_SIZE, &window[(row + 1) * window_stride + 1], width * sizeof(Cell)) != 0;
+            }
+            _tile_changed[tile] = tile_changed;
+            if (tile_changed) {
+                changed.push_back(std::make_pair(tile, next));
+            }
+        }
+        
+        for (size_t i = 0; i < changed.size(); i++) {
+            _tiles[changed[i].first] = changed[i].second;
+        }
+        changed.clear();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMapFork<Cell, Clamp, Border>::num_copied_tiles() const
+    {
+        size_t copied = 0;
+        for (size_t tile = 0; tile < _tiles.size(); tile++) {
+            copied += _tiles[tile] ? 1 : 0;
+        }
+        return copied;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMapFork<Cell, Clamp, Border>::num_active_tiles() const
+    {
+        return _num_active_tiles;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMapFork<Cell, Clamp, Border>::num_tiles() const
+    {
+        return _tiles.size();
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    typename BasicInfluenceMapFork<Cell, Clamp, Border>::Tile BasicInfluenceMapFork<Cell, Clamp, Border>::new_tile()
+    {
+        Cell* cells = nullptr;
+        if (_workspace && !_workspace->_spare_tiles.empty()) {
+            cells = _workspace->_spare_tiles.back();
+            _workspace->_spare_tiles.pop_back();
+        } else {
+            cells = detail::allocate_cells<Cell>(TILE_SIZE * TILE_SIZE);
+            XASSERT(cells, "out of memory allocating influence map tile");
+        }
+        
+        const TileDeleter deleter = { _workspace };
+        return Tile(cells, deleter);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMapFork<Cell, Clamp, Border>::tile_index(const size_t x, const size_t y) const
+    {
+        return _map->tile_index(x, y);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMapFork<Cell, Clamp, Border>::tile_width(const size_t tile) const
+    {
+        const size_t x_begin = (tile % _map->_tiles_x) * TILE_SIZE;
+        return std::min(x_begin + TILE_SIZE, _map->_width) - x_begin;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    size_t BasicInfluenceMapFork<Cell, Clamp, Border>::tile_height(const size_t tile) const
+    {
+        const size_t y_begin = (tile / _map->_tiles_x) * TILE_SIZE;
+        return std::min(y_begin + TILE_SIZE, _map->_height) - y_begin;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    const Cell* BasicInfluenceMapFork<Cell, Clamp, Border>::cells_at(const size_t x, const size_t y) const
+    {
+        // Cells from x to the end of its tile are contiguous.
+        const Tile& tile = _tiles[tile_index(x, y)];
+        if (tile) {
+            return tile.get() + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+        }
+        return _cells + _map->row_offset(y) + x;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    Cell BasicInfluenceMapFork<Cell, Clamp, Border>::cell_at(ptrdiff_t x, const size_t y) const
+    {
+        if (!Border::resolve(x, _map->_width)) {
+            return CellTraits<Cell>::encode(Border::template value<Value>());
+        }
+        return *cells_at(size_t(x), y);
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    Cell* BasicInfluenceMapFork<Cell, Clamp, Border>::writable_cells_at(const size_t x, const size_t y)
+    {
+        // Copy the tile first if the map or another fork can still see it.
+        const size_t index = tile_index(x, y);
+        Tile& tile = _tiles[index];
+        if (!tile || tile.use_count() > 1) {
+            const size_t x_begin = x - x % TILE_SIZE;
+            const size_t y_begin = y - y % TILE_SIZE;
+            const size_t width = tile_width(index);
+            const size_t height = tile_height(index);
+            
+            const Tile copy = new_tile();
+            for (size_t row = 0; row < height; row++) {
+                const Cell * const cells = cells_at(x_begin, y_begin + row);
+                std::copy(cells, cells + width, copy.get() + row * TILE_SIZE);
+            }
+            tile = copy;
+        }
+        return tile.get() + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMapFork<Cell, Clamp, Border>::load_window(const size_t x_begin,
+                                                                 const size_t y_begin,
+                                                                 const size_t width,
+                                                                 const size_t height,
+                                                                 Cell * const window) const
+    {
+        // Gathers the cells of a tile and the ring around it, the neighbours
+        // its cells propagate from, into rows TILE_SIZE + 2 apart. Beyond the
+        // edge the ring holds what the border says, as the map's halo does.
+        const size_t window_stride = TILE_SIZE + 2;
+        const Cell border = CellTraits<Cell>::encode(Border::template value<Value>());
+        
+        for (size_t row = 0; row < height + 2; row++) {
+            Cell * const out = window + row * window_stride;
+            ptrdiff_t y = ptrdiff_t(y_begin + row) - 1;
+            if (!Border::resolve(y, _map->_height)) {
+                std::fill(out, out + width + 2, border);
+                continue;
+            }
+            
+            const Cell * const cells = cells_at(x_begin, size_t(y));
+            std::copy(cells, cells + width, out + 1);
+            out[0] = cell_at(ptrdiff_t(x_begin) - 1, size_t(y));
+            out[width + 1] = cell_at(ptrdiff_t(x_begin + width), size_t(y));
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    void BasicInfluenceMapFork<Cell, Clamp, Border>::mark_tiles_changed(const size_t x_begin,
+                                                                        const size_t y_begin,
+                                                                        const size_t x_end,
+                                                                        const size_t y_end)
+    {
+        for (size_t ty = y_begin / TILE_SIZE; ty <= (y_end - 1) / TILE_SIZE; ty++) {
+            for (size_t tx = x_begin / TILE_SIZE; tx <= (x_end - 1) / TILE_SIZE; tx++) {
+                _tile_changed[ty * _map->_tiles_x + tx] = 1;
+            }
+        }
+    }
+
+} // namespace influence_map
@@ -0,0 +1,224 @@
+#include "layered_influence_map.h"
+#include "cell_buffer.h"
+#include "cell_types.h"
+#include "map_kernels.h"
+#include "thread_pool.h"
+#include "xassert.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace influence_map {
+    
+    namespace {
+        
+        const size_t FLOATS_PER_CACHE_LINE = detail::CACHE_LINE_BYTES / sizeof(float);
+        
+        size_t round_up_to_line(const size_t floats)
+        {
+            return (floats + FLOATS_PER_CACHE_LINE - 1) / FLOATS_PER_CACHE_LINE * FLOATS_PER_CACHE_LINE;
+        }
+        
+    } // namespace
+    
+    const size_t LayeredInfluenceMap::MIN_ROWS_PER_BAND;
+    
+    LayeredInfluenceMap::LayeredInfluenceMap(const size_t width,
+                                             const size_t height,
+                                             const size_t num_channels,
+                                             const bool clamp_values_to_0_1,
+                                             const float initial_influence) :
+        _width(width), _height(height), _channels(num_channels), _clamp_values_to_0_1(clamp_values_to_0_1),
+        _stride(padded_stride(width, num_channels)), _origin(_stride + round_up_to_line(num_channels)),
+        _momentum_pattern(num_channels + detail::MAX_SIMD_LANES),
+        _edge_pattern(num_channels + detail::MAX_SIMD_LANES),
+        _corner_pattern(num_channels + detail::MAX_SIMD_LANES),
+        _thread_pool(nullptr)
+    {
+        XASSERT(num_channels > 0, "a layered map needs at least one channel");
+        
+        // Both buffers start zeroed, which is the halo.
+        _data = detail::allocate_cells<float>(buffer_floats());
+        _copy = detail::allocate_cells<float>(buffer_floats());
+        XASSERT(_data && _copy, "out of memory allocating influence map");
+        
+        const float clamped_influence = clamp_influence(initial_influence);
+        const detail::KernelTable& kernels = detail::kernels();
+        for (size_t y = 0; y < _height; y++) {
+            kernels.fill(_data + row_offset(y), _width * _channels, clamped_influence);
+            kernels.fill(_copy + row_offset(y), _width * _channels, clamped_influence);
+        }
+    }
+    
+    LayeredInfluenceMap::~LayeredInfluenceMap()
+    {
+        detail::free_cells(_data);
+        detail::free_cells(_copy);
+    }
+    
+    size_t LayeredInfluenceMap::padded_stride(const size_t width, const size_t channels)
+    {
+        // As InfluenceMap, but a halo cell is channels floats wide: the left
+        // one ends a run of padding that keeps rows on cache lines, the right
+        // one follows the row.
+        return round_up_to_line(round_up_to_line(channels) + (width + 1) * channels);
+    }
+    
+    size_t LayeredInfluenceMap::buffer_floats() const
+    {
+        return _stride * (_height + 2);
+    }
+    
+    size_t LayeredInfluenceMap::row_offset(const size_t y) const
+    {
+        return _origin + _stride * y;
+    }
+    
+    size_t LayeredInfluenceMap::coords_to_linear(const size_t x, const size_t y, const size_t channel) const
+    {
+        XASSERT(x < _width, "x is greater than map width");
+        XASSERT(y < _height, "y is greater than map height");
+        XASSERT(channel < _channels, "channel is greater than the number of channels");
+        
+        return row_offset(y) + x * _channels + channel;
+    }
+    
+    float LayeredInfluenceMap::clamp_influence(const float influence) const
+    {
+        if (!_clamp_values_to_0_1) {
+            return influence;
+        }
+        return detail::clamp_to(influence, 0.0f, 1.0f);
+    }
+    
+    size_t LayeredInfluenceMap::num_cells() const
+    {
+        return _width * _height;
+    }
+    
+    size_t LayeredInfluenceMap::width() const
+    {
+        return _width;
+    }
+    
+    size_t LayeredInfluenceMap::height() const
+    {
+        return _height;
+    }
+    
+    size_t LayeredInfluenceMap::num_channels() const
+    {
+        return _channels;
+    }
+    
+    float LayeredInfluenceMap::influence(const size_t x, const size_t y, const size_t channel) const
+    {
+        return _data[coords_to_linear(x, y, channel)];
+    }
+    
+    void LayeredInfluenceMap::set_influence(const size_t x, const size_t y, const size_t channel, const float influence)
+    {
+        _data[coords_to_linear(x, y, channel)] = clamp_influence(influence);
+    }
+    
+    void LayeredInfluenceMap::fill(const size_t channel, const float influence)
+    {
+        XASSERT(channel < _channels, "channel is greater than the number of channels");
+        
+        const float clamped_influence = clamp_influence(influence);
+        for (size_t y = 0; y < _height; y++) {
+            float * const row = _data + row_offset(y) + channel;
+            for (size_t x = 0; x < _width; x++) {
+                row[x * _channels] = clamped_influence;
+            }
+        }
+    }
+    
+    float LayeredInfluenceMap::peak_influence(const size_t channel) const
+    {
+        XASSERT(channel < _channels, "channel is greater than the number of channels");
+        
+        float peak = -INFINITY;
+        for (size_t y = 0; y < _height; y++) {
+            const float * const row = _data + row_offset(y) + channel;
+            for (size_t x = 0; x < _width; x++) {
+                peak = detail::max_of(row[x * _channels], peak);
+            }
+        }
+        return peak;
+    }
+    
+    void LayeredInfluenceMap::propagate(const float momentum, const float decay)
+    {
+        const std::vector<float> momentums(_channels, momentum);
+        const std::vector<float> decays(_channels, decay);
+        propagate(&momentums[0], &decays[0]);
+    }
+    
+    void LayeredInfluenceMap::propagate(const float * const momentums, const float * const decays)
+    {
+        // The same weights InfluenceMap works out, so every channel matches it.
+        const float edge_distance = 1.0f;
+        const float corner_distance = 1.414f;
+        
+        for (size_t i = 0; i < _momentum_pattern.size(); i++) {
+            const size_t channel = i % _channels;
+            _momentum_pattern[i] = momentums[channel];
+            _edge_pattern[i] = std::exp(-edge_distance * decays[channel]);
+            _corner_pattern[i] = std::exp(-corner_distance * decays[channel]);
+        }
+        
+        propagate_all();
+    }
+    
+    void LayeredInfluenceMap::propagate_all()
+    {
+        const detail::KernelTable& kernels = detail::kernels();
+        const detail::PropagateChannelsParams params = {
+            &_momentum_pattern[0], &_edge_pattern[0], &_corner_pattern[0], _channels, 0,
+            _clamp_values_to_0_1, 0.0f, 1.0f
+        };
+        const size_t count = _width * _channels;
+        
+        const auto propagate_rows = [&](const size_t begin, const size_t end) {
+            for (size_t y = begin; y < end; y++) {
+                const size_t offset = row_offset(y);
+                kernels.propagate_channels(_data + offset - _stride,
+                                           _data + offset,
+                                           _data + offset + _stride,
+                                           _copy + offset,
+                                           count,
+                                           params);
+            }
+        };
+        
+        if (_thread_pool && _thread_pool->num_threads() > 1 && _height >= MIN_ROWS_PER_BAND * 2) {
+            const size_t max_bands = _thread_pool->num_threads() * 4;
+            const size_t num_bands = std::min(max_bands, _height / MIN_ROWS_PER_BAND);
+            const size_t rows_per_band = (_height + num_bands - 1) / num_bands;
+            
+            _thread_pool->parallel_for(num_bands, [&](const size_t band) {
+                const size_t begin = band * rows_per_band;
+                propagate_rows(begin, std::min(begin + rows_per_band, _height));
+            });
+        } else {
+            propagate_rows(0, _height);
+        }
+        
+        // Swap the buffers
+        float * const tmp = _copy;
+        _copy = _data;
+        _data = tmp;
+    }
+    
+    void LayeredInfluenceMap::set_thread_pool(ThreadPool * const thread_pool)
+    {
+        _thread_pool = thread_pool;
+    }
+    
+    ThreadPool* LayeredInfluenceMap::thread_pool() const
+    {
+        return _thread_pool;
+    }
+
+} // namespace influence_map
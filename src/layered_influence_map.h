@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace influence_map {
+    
+    class ThreadPool;
+    
+    /**
+     * A stack of float influence maps of the same size, one per channel, such as
+     * one per faction. The channels of each cell are stored side by side, so
+     * propagate() updates every channel in a single pass over memory instead of
+     * one pass per map, and a cell's channels share the cache lines they are
+     * read from.
+     *
+     * Each channel propagates exactly as an InfluenceMap of its own would, bit
+     * for bit, and can have its own momentum and decay. The border is zero and
+     * there are no obstacles, terrain or sparse propagation.
+     */
+    class LayeredInfluenceMap
+    {
+    public:
+        LayeredInfluenceMap(const size_t width,
+                            const size_t height,
+                            const size_t num_channels,
+                            const bool clamp_values_to_0_1,
+                            const float initial_influence);
+        LayeredInfluenceMap(const LayeredInfluenceMap&) = delete;
+        LayeredInfluenceMap& operator=(const LayeredInfluenceMap&) = delete;
+        ~LayeredInfluenceMap();
+        
+        size_t num_cells() const;
+        size_t width() const;
+        size_t height() const;
+        size_t num_channels() const;
+        
+        float influence(const size_t x, const size_t y, const size_t channel) const;
+        void set_influence(const size_t x, const size_t y, const size_t channel, const float influence);
+        
+        /**
+         * Sets every cell of one channel to influence, clamped as for
+         * set_influence().
+         */
+        void fill(const size_t channel, const float influence);
+        
+        /**
+         * The largest influence of any cell in a channel, ignoring NaNs. Returns
+         * -INFINITY for a map with no cells.
+         */
+        float peak_influence(const size_t channel) const;
+        
+        /**
+         * Propagates every channel with the same momentum and decay.
+         */
+        void propagate(const float momentum, const float decay);
+        
+        /**
+         * Propagates channel c with momentums[c] and decays[c]. Both arrays hold
+         * num_channels() values.
+         */
+        void propagate(const float * const momentums, const float * const decays);
+        
+        /**
+         * As InfluenceMap::set_thread_pool(). The pool must outlive the map or be
+         * detached by passing nullptr.
+         */
+        void set_thread_pool(ThreadPool * const thread_pool);
+        ThreadPool* thread_pool() const;
+    
+    private:
+        const size_t _width;
+        const size_t _height;
+        const size_t _channels;
+        const bool _clamp_values_to_0_1;
+        
+        // Rows of _width cells of _channels floats, _stride floats apart, with a
+        // halo of zero cells on every side. Cell (0, 0) is _origin floats into
+        // each buffer and every row starts on a cache line.
+        const size_t _stride;
+        const size_t _origin;
+        
+        float* _data;
+        float* _copy;
+        
+        // The per-channel weights, each repeated to fill a vector from any
+        // channel, as PropagateChannelsParams wants them.
+        std::vector<float> _momentum_pattern;
+        std::vector<float> _edge_pattern;
+        std::vector<float> _corner_pattern;
+        
+        ThreadPool* _thread_pool;
+        
+        // Below this a band costs less than waking a worker for it.
+        static const size_t MIN_ROWS_PER_BAND = 16;
+        
+        size_t coords_to_linear(const size_t x, const size_t y, const size_t channel) const;
+        size_t row_offset(const size_t y) const;
+        float clamp_influence(const float influence) const;
+        
+        static size_t padded_stride(const size_t width, const size_t channels);
+        size_t buffer_floats() const;
+        void propagate_all();
+    };
+
+} // namespace influence_map
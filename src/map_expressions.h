@@ -0,0 +1,397 @@
+#pragma once
+
+#include "influence_map.h"
+#include "map_kernels.h"
+#include "thread_pool.h"
+#include "xassert.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace influence_map {
+    
+    /**
+     * A combination of InfluenceMaps that has not been worked out yet. Adding,
+     * subtracting and multiplying maps, expressions and numbers, and calling
+     * min(), max(), threshold() and clamp() on them, builds a tree of these:
+     *
+     *      assign(danger, 0.6f * enemy + 0.4f * artillery - friendly);
+     *      propagate_from(danger, clamp(enemy - friendly, 0.0f, 1.0f), 0.5f, 0.1f);
+     *
+     * Nothing is computed until the tree reaches assign() or propagate_from(),
+     * which evaluate it in a single pass over the map. Each node works through
+     * the map a block of cells at a time with the vector kernels, keeping its
+     * block on the stack, so no intermediate map is ever allocated.
+     *
+     * Expressions hold pointers to their maps, so use them before the maps go
+     * away. Every map in an expression must be the same size.
+     */
+    template <typename Node>
+    struct MapExpression
+    {
+        Node node;
+    };
+
+namespace detail {
+    
+    // Cells an expression node works on at once. Every combining node keeps
+    // a block of this many floats on the stack while it evaluates.
+    static const size_t EXPRESSION_BLOCK = 256;
+    
+    // Each node can say whether it fits a map of a size, and evaluate count
+    // cells of row y from column x. evaluate() returns where the cells are,
+    // which is either scratch or a map's own row.
+    
+    struct MapNode
+    {
+        const InfluenceMap* map;
+        
+        bool fits(const size_t width, const size_t height) const
+        {
+            return map->width() == width && map->height() == height;
+        }
+        
+        const float* evaluate(const KernelTable& kernels, const size_t y, const size_t x, const size_t count, float * const scratch) const;
+    };
+    
+    struct ScalarNode
+    {
+        float value;
+        
+        bool fits(const size_t, const size_t) const
+        {
+            return true;
+        }
+        
+        const float* evaluate(const KernelTable& kernels, const size_t, const size_t, const size_t count, float * const scratch) const
+        {
+            kernels.fill(scratch, count, value);
+            return scratch;
+        }
+    };
+    
+    template <typename Left, typename Right>
+    struct CombineNode
+    {
+        CombineOp op;
+        Left left;
+        Right right;
+        
+        bool fits(const size_t width, const size_t height) const
+        {
+            return left.fits(width, height) && right.fits(width, height);
+        }
+        
+        const float* evaluate(const KernelTable& kernels, const size_t y, const size_t x, const size_t count, float * const scratch) const
+        {
+            float block[EXPRESSION_BLOCK];
+            const float * const a = left.evaluate(kernels, y, x, count, scratch);
+            const float * const b = right.evaluate(kernels, y, x, count, block);
+            kernels.combine(op, a, b, scratch, count);
+            return scratch;
+        }
+    };
+    
+    template <typename Inner>
+    struct ClampNode
+    {
+        Inner inner;
+        float lowest;
+        float highest;
+        
+        bool fits(const size_t width, const size_t height) const
+        {
+            return inner.fits(width, height);
+        }
+        
+        const float* evaluate(const KernelTable& kernels, const size_t y, const size_t x, const size_t count, float * const scratch) const
+        {
+            const float * const values = inner.evaluate(kernels, y, x, count, scratch);
+            kernels.clamp(values, scratch, count, lowest, highest);
+            return scratch;
+        }
+    };
+    
+    /**
+     * How each kind of operand becomes a node. Maps and expressions are
+     * IS_MAP; numbers become ScalarNodes. Anything else is not an operand, so
+     * the operators below ignore it.
+     */
+    template <typename T, bool Arithmetic = std::is_arithmetic<T>::value>
+    struct Operand
+    {
+        static const bool VALID = false;
+        static const bool IS_MAP = false;
+    };
+    
+    template <typename T>
+    struct Operand<T, true>
+    {
+        static const bool VALID = true;
+        static const bool IS_MAP = false;
+        typedef ScalarNode Node;
+        static Node node(const T value) { const Node node = { float(value) }; return node; }
+    };
+    
+    template <>
+    struct Operand<InfluenceMap, false>
+    {
+        static const bool VALID = true;
+        static const bool IS_MAP = true;
+        typedef MapNode Node;
+        static Node node(const InfluenceMap& map) { const Node node = { &map }; return node; }
+    };
+    
+    template <typename N>
+    struct Operand<MapExpression<N>, false>
+    {
+        static const bool VALID = true;
+        static const bool IS_MAP = true;
+        typedef N Node;
+        static Node node(const MapExpression<N>& expression) { return expression.node; }
+    };
+    
+    // The Type of the expression combining A and B, only if both are operands
+    // and at least one of them is a map.
+    template <typename A, typename B, bool Enabled = Operand<A>::VALID && Operand<B>::VALID && (Operand<A>::IS_MAP || Operand<B>::IS_MAP)>
+    struct Combined
+    {
+    };
+    
+    template <typename A, typename B>
+    struct Combined<A, B, true>
+    {
+        typedef MapExpression<CombineNode<typename Operand<A>::Node, typename Operand<B>::Node> > Type;
+    };
+    
+    template <typename A, typename B>
+    typename Combined<A, B>::Type combine(const CombineOp op, const A& a, const B& b)
+    {
+        const typename Combined<A, B>::Type expression = { { op, Operand<A>::node(a), Operand<B>::node(b) } };
+        return expression;
+    }
+    
+    /**
+     * Reaches into maps for the expression evaluators.
+     */
+    struct ExpressionAccess
+    {
+        static const float* row(const InfluenceMap& map, const size_t y)
+        {
+            return map._data + map.row_offset(y);
+        }
+        
+        // Evaluates row y of node into out, clamping it as map does. Unless
+        // nothing in the expression can read out, blocks are evaluated on the
+        // side first.
+        template <typename Node>
+        static void evaluate_row(const InfluenceMap& map,
+                                 const Node& node,
+                                 const KernelTable& kernels,
+                                 const size_t y,
+                                 float * const out,
+                                 const bool out_is_private)
+        {
+            float block[EXPRESSION_BLOCK];
+            for (size_t x = 0; x < map._width; x += EXPRESSION_BLOCK) {
+                const size_t count = std::min(EXPRESSION_BLOCK, map._width - x);
+                const float * const values = node.evaluate(kernels, y, x, count, out_is_private ? out + x : block);
+                if (map._clamp_values_to_0_1) {
+                    kernels.clamp(values, out + x, count, 0.0f, 1.0f);
+                } else if (values != out + x) {
+                    memcpy(out + x, values, count * sizeof(float));
+                }
+            }
+        }
+        
+        // Calls rows(begin, end) over bands of the map's rows, spread over its
+        // thread pool if it has one.
+        template <typename RowFn>
+        static void for_each_band(const InfluenceMap& map, const RowFn& rows)
+        {
+            ThreadPool * const pool = map._thread_pool;
+            const size_t height = map._height;
+            
+            if (pool && pool->num_threads() > 1 && height >= InfluenceMap::MIN_ROWS_PER_BAND * 2) {
+                const size_t max_bands = pool->num_threads() * 4;
+                const size_t num_bands = std::min(max_bands, height / InfluenceMap::MIN_ROWS_PER_BAND);
+                const size_t rows_per_band = (height + num_bands - 1) / num_bands;
+                
+                pool->parallel_for(num_bands, [&](const size_t band) {
+                    const size_t begin = band * rows_per_band;
+                    rows(begin, std::min(begin + rows_per_band, height));
+                });
+            } else {
+                rows(0, height);
+            }
+        }
+        
+        template <typename Node>
+        static void assign(InfluenceMap& destination, const Node& node)
+        {
+            XASSERT(node.fits(destination._width, destination._height), "maps in an expression must all be the same size");
+            const KernelTable& kernels = detail::kernels();
+            destination.claim_data();
+            
+            // A block is evaluated in full before it is written, and reads no
+            // other cells, so the destination can appear in the expression.
+            for_each_band(destination, [&](const size_t begin, const size_t end) {
+                for (size_t y = begin; y < end; y++) {
+                    float * const row = destination._data + destination.row_offset(y);
+                    evaluate_row(destination, node, kernels, y, row, false);
+                    destination.zero_obstacle_row(row, y);
+                }
+            });
+            
+            destination.mark_all_tiles_changed();
+        }
+        
+        template <typename Node>
+        static void propagate_from(InfluenceMap& destination, const Node& node, const float momentum, const float decay)
+        {
+            XASSERT(node.fits(destination._width, destination._height), "maps in an expression must all be the same size");
+            const KernelTable& kernels = detail::kernels();
+            const InfluenceMap::Kernels cell_kernels = detail::cell_kernels<float>();
+            const InfluenceMap::Params params = destination.begin_step(momentum, decay);
+            const size_t width = destination._width;
+            const size_t height = destination._height;
+            
+            // Source rows are evaluated into a window of three, with a zero cell
+            // either side, just ahead of the row being propagated. Each one is
+            // evaluated once per band and is in cache while it is read.
+            const size_t window_stride = width + 2;
+            
+            for_each_band(destination, [&](const size_t begin, const size_t end) {
+                std::vector<float> window(3 * window_stride, 0.0f);
+                
+                const auto load = [&](const size_t slot, const size_t y) {
+                    float * const row = &window[slot * window_stride + 1];
+                    if (y < height) {
+                        evaluate_row(destination, node, kernels, y, row, true);
+                        destination.zero_obstacle_row(row, y);
+                    } else {
+                        kernels.fill(row, width, 0.0f);
+                    }
+                };
+                
+                // Row y lives in slot y % 3. The row above the map is zero.
+                if (begin > 0) {
+                    load((begin - 1) % 3, begin - 1);
+                }
+                load(begin % 3, begin);
+                
+                for (size_t y = begin; y < end; y++) {
+                    load((y + 1) % 3, y + 1);
+                    const float * const above = &window[((y + 2) % 3) * window_stride + 1];
+                    const float * const row = &window[(y % 3) * window_stride + 1];
+                    const float * const below = &window[((y + 1) % 3) * window_stride + 1];
+                    cell_kernels.propagate_row(above, row, below, destination._copy + destination.row_offset(y), width, destination.row_params(params, y, 0));
+                }
+            });
+            
+            destination.finish_step();
+        }
+    };
+    
+    inline const float* MapNode::evaluate(const KernelTable&, const size_t y, const size_t x, const size_t, float * const) const
+    {
+        return ExpressionAccess::row(*map, y) + x;
+    }
+
+} // namespace detail
+    
+    template <typename A, typename B>
+    typename detail::Combined<A, B>::Type operator+(const A& a, const B& b)
+    {
+        return detail::combine(detail::CombineAdd, a, b);
+    }
+    
+    template <typename A, typename B>
+    typename detail::Combined<A, B>::Type operator-(const A& a, const B& b)
+    {
+        return detail::combine(detail::CombineSubtract, a, b);
+    }
+    
+    template <typename A, typename B>
+    typename detail::Combined<A, B>::Type operator*(const A& a, const B& b)
+    {
+        return detail::combine(detail::CombineMultiply, a, b);
+    }
+    
+    /**
+     * Multiplies by -1, which flips the sign of zeros too.
+     */
+    template <typename A>
+    typename detail::Combined<A, float>::Type operator-(const A& a)
+    {
+        return detail::combine(detail::CombineMultiply, a, -1.0f);
+    }
+    
+    /**
+     * a < b ? a : b cell by cell, so a NaN in either gives b.
+     */
+    template <typename A, typename B>
+    typename detail::Combined<A, B>::Type min(const A& a, const B& b)
+    {
+        return detail::combine(detail::CombineMin, a, b);
+    }
+    
+    /**
+     * a > b ? a : b cell by cell, so a NaN in either gives b.
+     */
+    template <typename A, typename B>
+    typename detail::Combined<A, B>::Type max(const A& a, const B& b)
+    {
+        return detail::combine(detail::CombineMax, a, b);
+    }
+    
+    /**
+     * a where it is at least level, and zero everywhere else.
+     */
+    template <typename A, typename B>
+    typename detail::Combined<A, B>::Type threshold(const A& a, const B& level)
+    {
+        return detail::combine(detail::CombineThreshold, a, level);
+    }
+    
+    /**
+     * a clamped to lowest..highest the same way maps clamp influence.
+     */
+    template <typename A>
+    typename std::enable_if<detail::Operand<A>::IS_MAP, MapExpression<detail::ClampNode<typename detail::Operand<A>::Node> > >::type
+    clamp(const A& a, const float lowest, const float highest)
+    {
+        const MapExpression<detail::ClampNode<typename detail::Operand<A>::Node> > expression = {
+            { detail::Operand<A>::node(a), lowest, highest }
+        };
+        return expression;
+    }
+    
+    /**
+     * Evaluates expression into every cell of destination, which may appear in
+     * it. Cells are clamped, and obstacles left at zero, as set_influence() does.
+     * Spreads the work over destination's thread pool, if it has one.
+     */
+    template <typename Expression>
+    typename std::enable_if<detail::Operand<Expression>::IS_MAP>::type
+    assign(InfluenceMap& destination, const Expression& expression)
+    {
+        detail::ExpressionAccess::assign(destination, detail::Operand<Expression>::node(expression));
+    }
+    
+    /**
+     * The same as assign(destination, source) followed by
+     * destination.propagate(momentum, decay), bit for bit, without ever storing
+     * source: each row of it is evaluated just before propagate reads it.
+     * destination may appear in source.
+     */
+    template <typename Expression>
+    typename std::enable_if<detail::Operand<Expression>::IS_MAP>::type
+    propagate_from(InfluenceMap& destination, const Expression& source, const float momentum, const float decay)
+    {
+        detail::ExpressionAccess::propagate_from(destination, detail::Operand<Expression>::node(source), momentum, decay);
+    }
+
+} // namespace influence_map
@@ -0,0 +1,413 @@
+#include "map_kernels.h"
+
+#include <cmath>
+
+// The vector kernels must match these bit for bit, so never let the compiler
+// fuse the lerp into an FMA even when building for a CPU that has one.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace influence_map {
+namespace detail {
+    
+    namespace {
+        
+        inline float max_of(const float candidate, const float current)
+        {
+            // Same comparison the per-cell kernel uses, so NaNs and signed zeros
+            // resolve identically. The SIMD max instructions behave the same way
+            // when given (candidate, current) in this order.
+            return candidate > current ? candidate : current;
+        }
+        
+        inline float clamp_to(const float influence, const float lowest, const float highest)
+        {
+            if (influence >= lowest && influence <= highest) {
+                return influence;
+            } else if (influence > highest) {
+                return highest;
+            } else {
+                return lowest;
+            }
+        }
+        
+        template <bool Clamp, bool Measure, bool Masked, bool Terrain, bool Floor>
+        float propagate_row(const float * const above,
+                            const float * const row,
+                            const float * const below,
+                            float * const out,
+                            const size_t count,
+                            const PropagateRowParams& params)
+        {
+            float residual = 0;
+            
+            for (size_t x = 0; x < count; x++) {
+                // Both weights are positive and multiplication rounds monotonically,
+                // so max(a * w, b * w) == max(a, b) * w and the neighbours can be
+                // reduced before weighting without changing a single bit.
+                float edge_influence = 0;
+                edge_influence = max_of(above[x],     edge_influence);
+                edge_influence = max_of(row[x + 1],   edge_influence);
+                edge_influence = max_of(below[x],     edge_influence);
+                edge_influence = max_of(row[x - 1],   edge_influence);
+                
+                float corner_influence = 0;
+                corner_influence = max_of(above[x - 1], corner_influence);
+                corner_influence = max_of(above[x + 1], corner_influence);
+                corner_influence = max_of(below[x + 1], corner_influence);
+                corner_influence = max_of(below[x - 1], corner_influence);
+                
+                const float edge = Terrain ? params.edge_factors[params.terrain[x]] : params.edge;
+                const float corner = Terrain ? params.corner_factors[params.terrain[x]] : params.corner;
+                
+                float max_influence = 0;
+                max_influence = max_of(edge_influence * edge, max_influence);
+                max_influence = max_of(corner_influence * corner, max_influence);
+                
+                const float cur_influence = row[x];
+                float result = (max_influence - cur_influence) * params.momentum + cur_influence;
+                if (Floor) result = max_of(params.floor[x], result);
+                float new_influence = Clamp ? clamp_to(result, params.clamp_min, params.clamp_max) : result;
+                if (Masked) new_influence = blocked_bits(params.blocked, params.blocked_bit + x, 1) & 1 ? 0.0f : new_influence;
+                out[x] = new_influence;
+                
+                if (Measure) residual = max_of(fabsf(new_influence - cur_influence), residual);
+            }
+            
+            return residual;
+        }
+        
+        void fill(float * const out, const size_t count, const float value)
+        {
+            for (size_t i = 0; i < count; i++) {
+                out[i] = value;
+            }
+        }
+        
+        float max(const float * const in, const size_t count, const float current)
+        {
+            float result = current;
+            for (size_t i = 0; i < count; i++) {
+                result = max_of(in[i], result);
+            }
+            return result;
+        }
+        
+        float max_difference(const float * const a, const float * const b, const size_t count, const float current)
+        {
+            float result = current;
+            for (size_t i = 0; i < count; i++) {
+                result = max_of(std::fabs(a[i] - b[i]), result);
+            }
+            return result;
+        }
+        
+        template <typename Cell>
+        void widen_cells(const Cell * const in, float * const out, const size_t count)
+        {
+            for (size_t i = 0; i < count; i++) {
+                out[i] = CellTraits<Cell>::decode(in[i]);
+            }
+        }
+        
+        template <typename Cell>
+        void narrow_cells(const float * const in, Cell * const out, const size_t count)
+        {
+            for (size_t i = 0; i < count; i++) {
+                out[i] = CellTraits<Cell>::encode(in[i]);
+            }
+        }
+        
+        void derive_row(const float * const ally,
+                        const float * const enemy,
+                        float * const influence,
+                        float * const tension,
+                        float * const vulnerability,
+                        const size_t count)
+        {
+            for (size_t i = 0; i < count; i++) {
+                const float difference = ally[i] - enemy[i];
+                const float sum = ally[i] + enemy[i];
+                influence[i] = difference;
+                tension[i] = sum;
+                vulnerability[i] = sum - std::fabs(difference);
+            }
+        }
+        
+        template <CombineOp Op>
+        float combine_one(const float a, const float b)
+        {
+            switch (Op) {
+                case CombineAdd:       return a + b;
+                case CombineSubtract:  return a - b;
+                case CombineMultiply:  return a * b;
+                case CombineMin:       return a < b ? a : b;
+                case CombineMax:       return a > b ? a : b;
+                case CombineThreshold: return a >= b ? a : 0.0f;
+            }
+            return a;
+        }
+        
+        template <CombineOp Op>
+        void combine_op(const float * const a, const float * const b, float * const out, const size_t count)
+        {
+            for (size_t i = 0; i < count; i++) {
+                out[i] = combine_one<Op>(a[i], b[i]);
+            }
+        }
+        
+        void combine(const CombineOp op,
+                     const float * const a,
+                     const float * const b,
+                     float * const out,
+                     const size_t count)
+        {
+            switch (op) {
+                case CombineAdd:       combine_op<CombineAdd>(a, b, out, count); break;
+                case CombineSubtract:  combine_op<CombineSubtract>(a, b, out, count); break;
+                case CombineMultiply:  combine_op<CombineMultiply>(a, b, out, count); break;
+                case CombineMin:       combine_op<CombineMin>(a, b, out, count); break;
+                case CombineMax:       combine_op<CombineMax>(a, b, out, count); break;
+                case CombineThreshold: combine_op<CombineThreshold>(a, b, out, count); break;
+            }
+        }
+        
+        void clamp(const float * const in,
+                   float * const out,
+                   const size_t count,
+                   const float lowest,
+                   const float highest)
+        {
+            for (size_t i = 0; i < count; i++) {
+                out[i] = clamp_to(in[i], lowest, highest);
+            }
+        }
+        
+        template <StampBlend Blend, bool Clamp>
+        void stamp_row_blended(float * const out,
+                               const float * const weights,
+                               const size_t count,
+                               const float strength,
+                               const float clamp_min,
+                               const float clamp_max)
+        {
+            for (size_t i = 0; i < count; i++) {
+                const float stamped = strength * weights[i];
+                float result;
+                switch (Blend) {
+                    case StampMax:     result = max_of(stamped, out[i]); break;
+                    case StampAdd:     result = out[i] + stamped; break;
+                    case StampReplace: result = stamped; break;
+                }
+                out[i] = Clamp ? clamp_to(result, clamp_min, clamp_max) : result;
+            }
+        }
+        
+        template <StampBlend Blend>
+        void stamp_row_clamped(float * const out,
+                               const float * const weights,
+                               const size_t count,
+                               const float strength,
+                               const bool clamp,
+                               const float clamp_min,
+                               const float clamp_max)
+        {
+            if (clamp) {
+                stamp_row_blended<Blend, true>(out, weights, count, strength, clamp_min, clamp_max);
+            } else {
+                stamp_row_blended<Blend, false>(out, weights, count, strength, clamp_min, clamp_max);
+            }
+        }
+        
+        void stamp_row(float * const out,
+                       const float * const weights,
+                       const size_t count,
+                       const float strength,
+                       const StampBlend blend,
+                       const bool clamp,
+                       const float clamp_min,
+                       const float clamp_max)
+        {
+            switch (blend) {
+                case StampMax:     stamp_row_clamped<StampMax>(out, weights, count, strength, clamp, clamp_min, clamp_max); break;
+                case StampAdd:     stamp_row_clamped<StampAdd>(out, weights, count, strength, clamp, clamp_min, clamp_max); break;
+                case StampReplace: stamp_row_clamped<StampReplace>(out, weights, count, strength, clamp, clamp_min, clamp_max); break;
+            }
+        }
+        
+        template <bool Clamp>
+        void propagate_channels(const float * const above,
+                                const float * const row,
+                                const float * const below,
+                                float * const out,
+                                const size_t count,
+                                const PropagateChannelsParams& params)
+        {
+            const size_t channels = params.channels;
+            size_t channel = params.phase;
+            
+            for (size_t i = 0; i < count; i++) {
+                // The same operations in the same order as propagate_row, with
+                // neighbours a cell of channels away.
+                float edge_influence = 0;
+                edge_influence = max_of(above[i],            edge_influence);
+                edge_influence = max_of(row[i + channels],   edge_influence);
+                edge_influence = max_of(below[i],            edge_influence);
+                edge_influence = max_of(row[i - channels],   edge_influence);
+                
+                float corner_influence = 0;
+                corner_influence = max_of(above[i - channels], corner_influence);
+                corner_influence = max_of(above[i + channels], corner_influence);
+                corner_influence = max_of(below[i + channels], corner_influence);
+                corner_influence = max_of(below[i - channels], corner_influence);
+                
+                float max_influence = 0;
+                max_influence = max_of(edge_influence * params.edge[channel], max_influence);
+                max_influence = max_of(corner_influence * params.corner[channel], max_influence);
+                
+                const float cur_influence = row[i];
+                const float result = (max_influence - cur_influence) * params.momentum[channel] + cur_influence;
+                out[i] = Clamp ? clamp_to(result, params.clamp_min, params.clamp_max) : result;
+                
+                if (++channel == channels) {
+                    channel = 0;
+                }
+            }
+        }
+        
+        template <bool Measure, bool Masked, bool Terrain, bool Floor>
+        float propagate_row_clamped(const float * const above,
+                                    const float * const row,
+                                    const float * const below,
+                                    float * const out,
+                                    const size_t count,
+                                    const PropagateRowParams& params)
+        {
+            return params.clamp
+                ? propagate_row<true, Measure, Masked, Terrain, Floor>(above, row, below, out, count, params)
+                : propagate_row<false, Measure, Masked, Terrain, Floor>(above, row, below, out, count, params);
+        }
+        
+        template <bool Measure, bool Floor>
+        float propagate_row_masked(const float * const above,
+                                   const float * const row,
+                                   const float * const below,
+                                   float * const out,
+                                   const size_t count,
+                                   const PropagateRowParams& params)
+        {
+            if (params.blocked) {
+                return params.terrain
+                    ? propagate_row_clamped<Measure, true, true, Floor>(above, row, below, out, count, params)
+                    : propagate_row_clamped<Measure, true, false, Floor>(above, row, below, out, count, params);
+            }
+            return params.terrain
+                ? propagate_row_clamped<Measure, false, true, Floor>(above, row, below, out, count, params)
+                : propagate_row_clamped<Measure, false, false, Floor>(above, row, below, out, count, params);
+        }
+        
+        template <bool Measure>
+        float propagate_row_dispatch(const float * const above,
+                                     const float * const row,
+                                     const float * const below,
+                                     float * const out,
+                                     const size_t count,
+                                     const PropagateRowParams& params)
+        {
+            return params.floor
+                ? propagate_row_masked<Measure, true>(above, row, below, out, count, params)
+                : propagate_row_masked<Measure, false>(above, row, below, out, count, params);
+        }
+        
+    } // namespace
+    
+    void propagate_row_scalar(const float * const above,
+                              const float * const row,
+                              const float * const below,
+                              float * const out,
+                              const size_t count,
+                              const PropagateRowParams& params)
+    {
+        propagate_row_dispatch<false>(above, row, below, out, count, params);
+    }
+    
+    float propagate_row_residual_scalar(const float * const above,
+                                        const float * const row,
+                                        const float * const below,
+                                        float * const out,
+                                        const size_t count,
+                                        const PropagateRowParams& params)
+    {
+        return propagate_row_dispatch<true>(above, row, below, out, count, params);
+    }
+    
+    void propagate_channels_scalar(const float * const above,
+                                   const float * const row,
+                                   const float * const below,
+                                   float * const out,
+                                   const size_t count,
+                                   const PropagateChannelsParams& params)
+    {
+        if (params.clamp) {
+            propagate_channels<true>(above, row, below, out, count, params);
+        } else {
+            propagate_channels<false>(above, row, below, out, count, params);
+        }
+    }
+    
+    void widen_cells_scalar(const uint8_t * const in, float * const out, const size_t count)
+    {
+        widen_cells(in, out, count);
+    }
+    
+    void widen_cells_scalar(const uint16_t * const in, float * const out, const size_t count)
+    {
+        widen_cells(in, out, count);
+    }
+    
+    void widen_cells_scalar(const Half * const in, float * const out, const size_t count)
+    {
+        widen_cells(in, out, count);
+    }
+    
+    void narrow_cells_scalar(const float * const in, uint8_t * const out, const size_t count)
+    {
+        narrow_cells(in, out, count);
+    }
+    
+    void narrow_cells_scalar(const float * const in, uint16_t * const out, const size_t count)
+    {
+        narrow_cells(in, out, count);
+    }
+    
+    void narrow_cells_scalar(const float * const in, Half * const out, const size_t count)
+    {
+        narrow_cells(in, out, count);
+    }
+    
+    const KernelTable& scalar_kernels()
+    {
+        static const KernelTable table = {
+            Scalar,
+            propagate_row_scalar,
+            propagate_row_residual_scalar,
+            fill,
+            max,
+            propagate_channels_scalar,
+            derive_row,
+            combine,
+            clamp,
+            stamp_row,
+            { widen_cells<uint8_t>, narrow_cells<uint8_t> },
+            { widen_cells<uint16_t>, narrow_cells<uint16_t> },
+            { widen_cells<Half>, narrow_cells<Half> },
+            max_difference
+        };
+        return table;
+    }
+    
+} // namespace detail
+} // namespace influence_map
@@ -0,0 +1,301 @@
+#pragma once
+
+#include "cell_types.h"
+#include "simd_dispatch.h"
+#include "stamps.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define INFLUENCE_MAP_X86_SIMD 1
+#else
+#define INFLUENCE_MAP_X86_SIMD 0
+#endif
+
+namespace influence_map {
+namespace detail {
+    
+    template <typename Value>
+    struct BasicPropagateRowParams
+    {
+        Value momentum;
+        Value edge;
+        Value corner;
+        
+        // Whether results are clamped to clamp_min..clamp_max.
+        bool clamp;
+        Value clamp_min;
+        Value clamp_max;
+        
+        // One bit per output cell, starting at bit blocked_bit of blocked[0], set
+        // for cells that are blocked and always come out zero. Null when no cell
+        // in the row is blocked.
+        const uint64_t * blocked;
+        size_t blocked_bit;
+        
+        // One index per output cell into edge_factors and corner_factors, which
+        // then replace edge and corner for that cell. Null for uniform decay.
+        // Every index is below terrain_types, and both tables hold at least 16
+        // values, so small tables can be looked up in registers.
+        const uint8_t * terrain;
+        const Value * edge_factors;
+        const Value * corner_factors;
+        size_t terrain_types;
+        
+        // One value per output cell that the cell is raised to, if it comes out
+        // lower, before it is clamped. Null when nothing in the row has a floor.
+        const Value * floor;
+    };
+    
+    /**
+     * The count bits of a blocked mask starting at bit, in the low bits of the
+     * result. count must be at most 64; bits above count are unspecified.
+     */
+    inline uint64_t blocked_bits(const uint64_t * const blocked, const size_t bit, const size_t count)
+    {
+        const uint64_t * const word = blocked + bit / 64;
+        const size_t shift = bit % 64;
+        
+        uint64_t bits = word[0] >> shift;
+        if (shift + count > 64) {
+            bits |= word[1] << (64 - shift);
+        }
+        return bits;
+    }
+    
+    typedef BasicPropagateRowParams<float> PropagateRowParams;
+    
+    // The widest vector any tier uses, in floats.
+    static const size_t MAX_SIMD_LANES = 16;
+    
+    /**
+     * Parameters for rows of cells that each hold channels floats side by side.
+     * momentum, edge and corner each hold channels + MAX_SIMD_LANES values, value
+     * i being channel i % channels's, so a vector of them can be loaded starting
+     * at any channel. phase is the channel of the first float in the row.
+     */
+    struct PropagateChannelsParams
+    {
+        const float * momentum;
+        const float * edge;
+        const float * corner;
+        size_t channels;
+        size_t phase;
+        
+        bool clamp;
+        float clamp_min;
+        float clamp_max;
+    };
+    
+    /**
+     * Computes count cells of one output row of InfluenceMap::propagate.
+     *
+     * above, row and below point at the input cells directly above, at and below
+     * the first output cell. All three must be readable from index -1 up to and
+     * including index count, so the caller is responsible for the border cells.
+     */
+    typedef void (*PropagateRowFn)(const float * const above,
+                                   const float * const row,
+                                   const float * const below,
+                                   float * const out,
+                                   const size_t count,
+                                   const PropagateRowParams& params);
+    
+    /**
+     * Same as PropagateRowFn, but also returns the largest absolute difference
+     * between an output cell and its input, or 0 for an empty row.
+     */
+    typedef float (*PropagateRowResidualFn)(const float * const above,
+                                            const float * const row,
+                                            const float * const below,
+                                            float * const out,
+                                            const size_t count,
+                                            const PropagateRowParams& params);
+    
+    /**
+     * PropagateRowFn for rows of interleaved channels: count floats, each
+     * propagated with its channel's parameters from the floats of the same
+     * channel in the neighbouring cells, channels floats to either side. The
+     * rows must be readable from index -channels up to count + channels - 1.
+     *
+     * Each channel comes out bit identical to PropagateRowFn run over that
+     * channel alone.
+     */
+    typedef void (*PropagateChannelsFn)(const float * const above,
+                                        const float * const row,
+                                        const float * const below,
+                                        float * const out,
+                                        const size_t count,
+                                        const PropagateChannelsParams& params);
+    
+    /**
+     * Sets count floats starting at out to value.
+     */
+    typedef void (*FillFn)(float * const out, const size_t count, const float value);
+    
+    /**
+     * Returns the largest of current and the count floats starting at in. NaNs
+     * are skipped.
+     */
+    typedef float (*MaxFn)(const float * const in, const size_t count, const float current);
+    
+    /**
+     * Computes count cells of the maps derived from an ally and an enemy map:
+     * influence = ally - enemy, tension = ally + enemy and
+     * vulnerability = tension - |influence|.
+     */
+    typedef void (*DeriveRowFn)(const float * const ally,
+                                const float * const enemy,
+                                float * const influence,
+                                float * const tension,
+                                float * const vulnerability,
+                                const size_t count);
+    
+    /**
+     * What CombineFn does to each pair of floats a and b. Min is a < b ? a : b,
+     * Max is a > b ? a : b, and Threshold keeps a where a >= b and is zero
+     * everywhere else.
+     */
+    enum CombineOp {
+        CombineAdd,
+        CombineSubtract,
+        CombineMultiply,
+        CombineMin,
+        CombineMax,
+        CombineThreshold
+    };
+    
+    /**
+     * Sets count floats starting at out to a op b, float by float. out may be
+     * a or b but must not otherwise overlap them.
+     */
+    typedef void (*CombineFn)(const CombineOp op,
+                              const float * const a,
+                              const float * const b,
+                              float * const out,
+                              const size_t count);
+    
+    /**
+     * Clamps count floats starting at in to lowest..highest the way propagate
+     * does, writing them to out, which may be in.
+     */
+    typedef void (*ClampFn)(const float * const in,
+                            float * const out,
+                            const size_t count,
+                            const float lowest,
+                            const float highest);
+    
+    /**
+     * Blends strength * weights[i] into out[i] for count floats, then clamps the
+     * result to clamp_min..clamp_max if clamp is set.
+     */
+    typedef void (*StampRowFn)(float * const out,
+                               const float * const weights,
+                               const size_t count,
+                               const float strength,
+                               const StampBlend blend,
+                               const bool clamp,
+                               const float clamp_min,
+                               const float clamp_max);
+    
+    /**
+     * Converts count cells to floats exactly as CellTraits<Cell>::decode does,
+     * and floats back to cells exactly as CellTraits<Cell>::encode does, so
+     * cells narrower than float can run through the float kernels.
+     */
+    template <typename Cell>
+    struct CellConversions
+    {
+        void (*widen)(const Cell * const in, float * const out, const size_t count);
+        void (*narrow)(const float * const in, Cell * const out, const size_t count);
+    };
+    
+    /**
+     * The largest of current and |a[i] - b[i]| over count floats. A NaN
+     * difference never wins.
+     */
+    typedef float (*MaxDifferenceFn)(const float * const a,
+                                     const float * const b,
+                                     const size_t count,
+                                     const float current);
+    
+    /**
+     * One implementation of every map kernel, all built for the same tier.
+     * Every tier's kernels produce results bit identical to the scalar ones.
+     */
+    struct KernelTable
+    {
+        SimdTier tier;
+        PropagateRowFn propagate_row;
+        PropagateRowResidualFn propagate_row_residual;
+        FillFn fill;
+        MaxFn max;
+        PropagateChannelsFn propagate_channels;
+        DeriveRowFn derive_row;
+        CombineFn combine;
+        ClampFn clamp;
+        StampRowFn stamp_row;
+        CellConversions<uint8_t> uint8_cells;
+        CellConversions<uint16_t> uint16_cells;
+        CellConversions<Half> half_cells;
+        MaxDifferenceFn max_difference;
+    };
+    
+    /**
+     * The scalar row kernels, which the vector kernels also use for the cells
+     * left over after their last full vector.
+     */
+    void propagate_row_scalar(const float * const above,
+                              const float * const row,
+                              const float * const below,
+                              float * const out,
+                              const size_t count,
+                              const PropagateRowParams& params);
+    
+    float propagate_row_residual_scalar(const float * const above,
+                                        const float * const row,
+                                        const float * const below,
+                                        float * const out,
+                                        const size_t count,
+                                        const PropagateRowParams& params);
+    
+    void propagate_channels_scalar(const float * const above,
+                                   const float * const row,
+                                   const float * const below,
+                                   float * const out,
+                                   const size_t count,
+                                   const PropagateChannelsParams& params);
+    
+    /**
+     * The scalar conversions, which the vector ones use for the cells left
+     * over after their last full vector.
+     */
+    void widen_cells_scalar(const uint8_t * const in, float * const out, const size_t count);
+    void widen_cells_scalar(const uint16_t * const in, float * const out, const size_t count);
+    void widen_cells_scalar(const Half * const in, float * const out, const size_t count);
+    void narrow_cells_scalar(const float * const in, uint8_t * const out, const size_t count);
+    void narrow_cells_scalar(const float * const in, uint16_t * const out, const size_t count);
+    void narrow_cells_scalar(const float * const in, Half * const out, const size_t count);
+    
+    const KernelTable& scalar_kernels();
+#if INFLUENCE_MAP_X86_SIMD
+    const KernelTable& sse41_kernels();
+    const KernelTable& avx2_kernels();
+    const KernelTable& avx512_kernels();
+#endif
+    
+    /**
+     * The kernels for a tier, which must not be above detected_simd_tier().
+     */
+    const KernelTable& kernels_for(const SimdTier tier);
+    
+    /**
+     * The kernels for active_simd_tier(). Callers running a multi-row operation
+     * should fetch this once and use it throughout so a concurrent
+     * force_simd_tier() cannot mix tiers within one result.
+     */
+    const KernelTable& kernels();
+    
+} // namespace detail
+} // namespace influence_map
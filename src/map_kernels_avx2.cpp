@@ -0,0 +1,147 @@
+#include "map_kernels.h"
+
+#if INFLUENCE_MAP_X86_SIMD
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,f16c"))), apply_to = function)
+#pragma STDC FP_CONTRACT OFF
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,f16c")
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace influence_map {
+namespace detail {
+    
+    namespace {
+        
+        struct Ops
+        {
+            typedef __m256 Vector;
+            static const size_t WIDTH = 8;
+            
+            static Vector load(const float * const p) { return _mm256_loadu_ps(p); }
+            static void store(float * const p, const Vector v) { _mm256_storeu_ps(p, v); }
+            static Vector broadcast(const float v) { return _mm256_set1_ps(v); }
+            
+            static Vector add(const Vector a, const Vector b) { return _mm256_add_ps(a, b); }
+            static Vector sub(const Vector a, const Vector b) { return _mm256_sub_ps(a, b); }
+            static Vector mul(const Vector a, const Vector b) { return _mm256_mul_ps(a, b); }
+            static Vector max(const Vector candidate, const Vector current) { return _mm256_max_ps(candidate, current); }
+            static Vector min(const Vector a, const Vector b) { return _mm256_min_ps(a, b); }
+            static Vector keep_at_least(const Vector v, const Vector level) { return _mm256_and_ps(_mm256_cmp_ps(v, level, _CMP_GE_OQ), v); }
+            static Vector abs(const Vector v) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v); }
+            
+            static Vector clamp(const Vector v, const Vector lowest, const Vector highest)
+            {
+                const Vector in_range = _mm256_and_ps(_mm256_cmp_ps(v, lowest, _CMP_GE_OQ), _mm256_cmp_ps(v, highest, _CMP_LE_OQ));
+                const Vector limit = _mm256_blendv_ps(lowest, highest, _mm256_cmp_ps(v, highest, _CMP_GT_OQ));
+                return _mm256_blendv_ps(limit, v, in_range);
+            }
+            
+            // Zeroes the lanes whose bit is set in the low WIDTH bits of lanes.
+            static Vector clear_lanes(const Vector v, const uint64_t lanes)
+            {
+                const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+                const __m256i set = _mm256_and_si256(_mm256_set1_epi32(int(lanes & 0xff)), lane_bits);
+                return _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(set, lane_bits)), v);
+            }
+            
+            // table[indices[lane]] for each lane.
+            static Vector gather(const float * const table, const uint8_t * const indices)
+            {
+                const __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices)));
+                return _mm256_i32gather_ps(table, lanes, sizeof(float));
+            }
+            
+            // Lane i of table for each index.
+            typedef __m256i Indices;
+            static Indices indices(const uint8_t * const indices)
+            {
+                return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices)));
+            }
+            static Vector permute(const Vector table, const Indices indices)
+            {
+                return _mm256_permutevar8x32_ps(table, indices);
+            }
+            
+            // Fixed point codes as floats, and back again truncating floats
+            // that already hold a code plus a half.
+            static Vector load_codes(const uint8_t * const p)
+            {
+                return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+            }
+            static Vector load_codes(const uint16_t * const p)
+            {
+                return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+            }
+            static __m128i code_words(const Vector codes)
+            {
+                const __m256i lanes = _mm256_cvttps_epi32(codes);
+                return _mm_packus_epi32(_mm256_castsi256_si128(lanes), _mm256_extracti128_si256(lanes, 1));
+            }
+            static void store_codes(uint8_t * const p, const Vector codes)
+            {
+                const __m128i words = code_words(codes);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(words, words));
+            }
+            static void store_codes(uint16_t * const p, const Vector codes)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p), code_words(codes));
+            }
+            
+            // F16C rounds to nearest even, as float_to_half does.
+            static Vector load_half(const Half * const p)
+            {
+                return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+            }
+            static void store_half(Half * const p, const Vector v)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+            }
+        };
+        
+#include "map_kernels_simd.inl"
+        
+    } // namespace
+    
+} // namespace detail
+} // namespace influence_map
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+namespace influence_map {
+namespace detail {
+    
+    const KernelTable& avx2_kernels()
+    {
+        static const KernelTable table = {
+            AVX2,
+            propagate_row,
+            propagate_row_residual,
+            fill,
+            max,
+            propagate_channels,
+            derive_row,
+            combine,
+            clamp,
+            stamp_row,
+            { widen_normalized<uint8_t>, narrow_normalized<uint8_t> },
+            { widen_normalized<uint16_t>, narrow_normalized<uint16_t> },
+            { widen_half, narrow_half },
+            max_difference
+        };
+        return table;
+    }
+    
+} // namespace detail
+} // namespace influence_map
+
+#endif // INFLUENCE_MAP_X86_SIMD
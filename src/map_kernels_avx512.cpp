@@ -0,0 +1,145 @@
+#include "map_kernels.h"
+
+#if INFLUENCE_MAP_X86_SIMD
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC's own _mm512_undefined_ps() trips this once the intrinsics are inlined.
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#pragma STDC FP_CONTRACT OFF
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace influence_map {
+namespace detail {
+    
+    namespace {
+        
+        struct Ops
+        {
+            typedef __m512 Vector;
+            static const size_t WIDTH = 16;
+            
+            static Vector load(const float * const p) { return _mm512_loadu_ps(p); }
+            static void store(float * const p, const Vector v) { _mm512_storeu_ps(p, v); }
+            static Vector broadcast(const float v) { return _mm512_set1_ps(v); }
+            
+            static Vector add(const Vector a, const Vector b) { return _mm512_add_ps(a, b); }
+            static Vector sub(const Vector a, const Vector b) { return _mm512_sub_ps(a, b); }
+            static Vector mul(const Vector a, const Vector b) { return _mm512_mul_ps(a, b); }
+            static Vector max(const Vector candidate, const Vector current) { return _mm512_max_ps(candidate, current); }
+            static Vector min(const Vector a, const Vector b) { return _mm512_min_ps(a, b); }
+            static Vector keep_at_least(const Vector v, const Vector level) { return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(v, level, _CMP_GE_OQ), v); }
+            static Vector abs(const Vector v) { return _mm512_abs_ps(v); }
+            
+            static Vector clamp(const Vector v, const Vector lowest, const Vector highest)
+            {
+                const __mmask16 in_range = _mm512_cmp_ps_mask(v, lowest, _CMP_GE_OQ) & _mm512_cmp_ps_mask(v, highest, _CMP_LE_OQ);
+                const __mmask16 above_range = _mm512_cmp_ps_mask(v, highest, _CMP_GT_OQ);
+                const Vector limit = _mm512_mask_blend_ps(above_range, lowest, highest);
+                return _mm512_mask_blend_ps(in_range, limit, v);
+            }
+            
+            // Zeroes the lanes whose bit is set in the low WIDTH bits of lanes.
+            static Vector clear_lanes(const Vector v, const uint64_t lanes)
+            {
+                return _mm512_maskz_mov_ps(__mmask16(~lanes), v);
+            }
+            
+            // table[indices[lane]] for each lane.
+            static Vector gather(const float * const table, const uint8_t * const indices)
+            {
+                const __m512i lanes = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(indices)));
+                return _mm512_i32gather_ps(lanes, table, sizeof(float));
+            }
+            
+            // Lane i of table for each index.
+            typedef __m512i Indices;
+            static Indices indices(const uint8_t * const indices)
+            {
+                return _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(indices)));
+            }
+            static Vector permute(const Vector table, const Indices indices)
+            {
+                return _mm512_permutexvar_ps(indices, table);
+            }
+            
+            // Fixed point codes as floats, and back again truncating floats
+            // that already hold a code plus a half.
+            static Vector load_codes(const uint8_t * const p)
+            {
+                return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+            }
+            static Vector load_codes(const uint16_t * const p)
+            {
+                return _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))));
+            }
+            static void store_codes(uint8_t * const p, const Vector codes)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(codes)));
+            }
+            static void store_codes(uint16_t * const p, const Vector codes)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_cvtepi32_epi16(_mm512_cvttps_epi32(codes)));
+            }
+            
+            // Rounds to nearest even, as float_to_half does.
+            static Vector load_half(const Half * const p)
+            {
+                return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+            }
+            static void store_half(Half * const p, const Vector v)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+            }
+        };
+        
+#include "map_kernels_simd.inl"
+        
+    } // namespace
+    
+} // namespace detail
+} // namespace influence_map
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+namespace influence_map {
+namespace detail {
+    
+    const KernelTable& avx512_kernels()
+    {
+        static const KernelTable table = {
+            AVX512,
+            propagate_row,
+            propagate_row_residual,
+            fill,
+            max,
+            propagate_channels,
+            derive_row,
+            combine,
+            clamp,
+            stamp_row,
+            { widen_normalized<uint8_t>, narrow_normalized<uint8_t> },
+            { widen_normalized<uint16_t>, narrow_normalized<uint16_t> },
+            { widen_half, narrow_half },
+            max_difference
+        };
+        return table;
+    }
+    
+} // namespace detail
+} // namespace influence_map
+
+#endif // INFLUENCE_MAP_X86_SIMD
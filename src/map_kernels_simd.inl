@@ -0,0 +1,490 @@
+// Vector versions of the kernels in map_kernels.cpp.
+//
+// Each map_kernels_<isa>.cpp includes this inside an anonymous namespace,
+// with its instruction set enabled, after defining a struct Ops wrapping that
+// instruction set's intrinsics. Keeping every instantiation in an anonymous
+// namespace stops the linker folding, say, the AVX-512 copy into the SSE build.
+//
+// The including file must also turn off floating point contraction; GCC will
+// otherwise happily fuse the multiply and add below whenever FMA is available.
+//
+// Don't include any headers from here.
+
+// The largest of current and every lane of lanes, skipping NaNs.
+float horizontal_max(const typename Ops::Vector lanes, const float current)
+{
+    float lane_values[Ops::WIDTH];
+    Ops::store(lane_values, lanes);
+    
+    float result = current;
+    for (size_t lane = 0; lane < Ops::WIDTH; lane++) {
+        result = lane_values[lane] > result ? lane_values[lane] : result;
+    }
+    return result;
+}
+
+template <bool Clamp, bool Measure, bool Masked, bool Terrain, bool Floor>
+float propagate_row_simd(const float * const above,
+                         const float * const row,
+                         const float * const below,
+                         float * const out,
+                         const size_t count,
+                         const PropagateRowParams& params)
+{
+    typedef typename Ops::Vector Vector;
+    
+    const Vector zero = Ops::broadcast(0.0f);
+    const Vector uniform_edge = Ops::broadcast(params.edge);
+    const Vector uniform_corner = Ops::broadcast(params.corner);
+    const Vector momentum = Ops::broadcast(params.momentum);
+    const Vector clamp_min = Ops::broadcast(params.clamp_min);
+    const Vector clamp_max = Ops::broadcast(params.clamp_max);
+    Vector residuals = zero;
+    
+    // With no more terrain types than lanes the whole table fits in a register.
+    const bool table_in_register = Terrain && params.terrain_types <= Ops::WIDTH;
+    const Vector edge_table = table_in_register ? Ops::load(params.edge_factors) : zero;
+    const Vector corner_table = table_in_register ? Ops::load(params.corner_factors) : zero;
+    
+    size_t x = 0;
+    for (; x + Ops::WIDTH <= count; x += Ops::WIDTH) {
+        // Mirrors the scalar kernel operation for operation; the max instructions
+        // return their second operand on ties and NaNs, which is exactly what
+        // `candidate > current ? candidate : current` does.
+        Vector edge_influence = zero;
+        edge_influence = Ops::max(Ops::load(above + x),     edge_influence);
+        edge_influence = Ops::max(Ops::load(row + x + 1),   edge_influence);
+        edge_influence = Ops::max(Ops::load(below + x),     edge_influence);
+        edge_influence = Ops::max(Ops::load(row + x - 1),   edge_influence);
+        
+        Vector corner_influence = zero;
+        corner_influence = Ops::max(Ops::load(above + x - 1), corner_influence);
+        corner_influence = Ops::max(Ops::load(above + x + 1), corner_influence);
+        corner_influence = Ops::max(Ops::load(below + x + 1), corner_influence);
+        corner_influence = Ops::max(Ops::load(below + x - 1), corner_influence);
+        
+        // Per cell weights are looked up rather than computed, so they come out
+        // exactly as the scalar kernel's do.
+        Vector edge = uniform_edge;
+        Vector corner = uniform_corner;
+        if (Terrain && table_in_register) {
+            const typename Ops::Indices indices = Ops::indices(params.terrain + x);
+            edge = Ops::permute(edge_table, indices);
+            corner = Ops::permute(corner_table, indices);
+        } else if (Terrain) {
+            edge = Ops::gather(params.edge_factors, params.terrain + x);
+            corner = Ops::gather(params.corner_factors, params.terrain + x);
+        }
+        
+        Vector max_influence = zero;
+        max_influence = Ops::max(Ops::mul(edge_influence, edge), max_influence);
+        max_influence = Ops::max(Ops::mul(corner_influence, corner), max_influence);
+        
+        // Deliberately not an FMA: a fused multiply-add rounds once instead of
+        // twice and would no longer match the scalar reference.
+        const Vector cur_influence = Ops::load(row + x);
+        Vector result = Ops::add(Ops::mul(Ops::sub(max_influence, cur_influence), momentum), cur_influence);
+        if (Floor) result = Ops::max(Ops::load(params.floor + x), result);
+        if (Clamp) result = Ops::clamp(result, clamp_min, clamp_max);
+        if (Masked) result = Ops::clear_lanes(result, blocked_bits(params.blocked, params.blocked_bit + x, Ops::WIDTH));
+        Ops::store(out + x, result);
+        
+        if (Measure) residuals = Ops::max(Ops::abs(Ops::sub(result, cur_influence)), residuals);
+    }
+    
+    PropagateRowParams tail_params = params;
+    tail_params.blocked_bit += x;
+    if (Terrain) tail_params.terrain += x;
+    if (Floor) tail_params.floor += x;
+    
+    if (!Measure) {
+        if (x < count) {
+            propagate_row_scalar(above + x, row + x, below + x, out + x, count - x, tail_params);
+        }
+        return 0;
+    }
+    
+    float residual = 0;
+    if (x < count) {
+        residual = propagate_row_residual_scalar(above + x, row + x, below + x, out + x, count - x, tail_params);
+    }
+    return horizontal_max(residuals, residual);
+}
+
+template <bool Measure, bool Masked, bool Terrain, bool Floor>
+float propagate_row_clamped(const float * const above,
+                            const float * const row,
+                            const float * const below,
+                            float * const out,
+                            const size_t count,
+                            const PropagateRowParams& params)
+{
+    return params.clamp
+        ? propagate_row_simd<true, Measure, Masked, Terrain, Floor>(above, row, below, out, count, params)
+        : propagate_row_simd<false, Measure, Masked, Terrain, Floor>(above, row, below, out, count, params);
+}
+
+template <bool Measure, bool Floor>
+float propagate_row_masked(const float * const above,
+                           const float * const row,
+                           const float * const below,
+                           float * const out,
+                           const size_t count,
+                           const PropagateRowParams& params)
+{
+    if (params.blocked) {
+        return params.terrain
+            ? propagate_row_clamped<Measure, true, true, Floor>(above, row, below, out, count, params)
+            : propagate_row_clamped<Measure, true, false, Floor>(above, row, below, out, count, params);
+    }
+    return params.terrain
+        ? propagate_row_clamped<Measure, false, true, Floor>(above, row, below, out, count, params)
+        : propagate_row_clamped<Measure, false, false, Floor>(above, row, below, out, count, params);
+}
+
+template <bool Measure>
+float propagate_row_dispatch(const float * const above,
+                             const float * const row,
+                             const float * const below,
+                             float * const out,
+                             const size_t count,
+                             const PropagateRowParams& params)
+{
+    return params.floor
+        ? propagate_row_masked<Measure, true>(above, row, below, out, count, params)
+        : propagate_row_masked<Measure, false>(above, row, below, out, count, params);
+}
+
+void propagate_row(const float * const above,
+                   const float * const row,
+                   const float * const below,
+                   float * const out,
+                   const size_t count,
+                   const PropagateRowParams& params)
+{
+    propagate_row_dispatch<false>(above, row, below, out, count, params);
+}
+
+float propagate_row_residual(const float * const above,
+                             const float * const row,
+                             const float * const below,
+                             float * const out,
+                             const size_t count,
+                             const PropagateRowParams& params)
+{
+    return propagate_row_dispatch<true>(above, row, below, out, count, params);
+}
+
+template <bool Clamp>
+void propagate_channels_simd(const float * const above,
+                             const float * const row,
+                             const float * const below,
+                             float * const out,
+                             const size_t count,
+                             const PropagateChannelsParams& params)
+{
+    typedef typename Ops::Vector Vector;
+    
+    const size_t channels = params.channels;
+    const Vector zero = Ops::broadcast(0.0f);
+    const Vector clamp_min = Ops::broadcast(params.clamp_min);
+    const Vector clamp_max = Ops::broadcast(params.clamp_max);
+    
+    // Each vector starts Ops::WIDTH channels on from the one before, so its
+    // weights start that much further into the repeating parameter arrays.
+    const size_t phase_step = Ops::WIDTH % channels;
+    size_t phase = params.phase;
+    
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        Vector edge_influence = zero;
+        edge_influence = Ops::max(Ops::load(above + i),            edge_influence);
+        edge_influence = Ops::max(Ops::load(row + i + channels),   edge_influence);
+        edge_influence = Ops::max(Ops::load(below + i),            edge_influence);
+        edge_influence = Ops::max(Ops::load(row + i - channels),   edge_influence);
+        
+        Vector corner_influence = zero;
+        corner_influence = Ops::max(Ops::load(above + i - channels), corner_influence);
+        corner_influence = Ops::max(Ops::load(above + i + channels), corner_influence);
+        corner_influence = Ops::max(Ops::load(below + i + channels), corner_influence);
+        corner_influence = Ops::max(Ops::load(below + i - channels), corner_influence);
+        
+        Vector max_influence = zero;
+        max_influence = Ops::max(Ops::mul(edge_influence, Ops::load(params.edge + phase)), max_influence);
+        max_influence = Ops::max(Ops::mul(corner_influence, Ops::load(params.corner + phase)), max_influence);
+        
+        const Vector cur_influence = Ops::load(row + i);
+        Vector result = Ops::add(Ops::mul(Ops::sub(max_influence, cur_influence), Ops::load(params.momentum + phase)), cur_influence);
+        if (Clamp) result = Ops::clamp(result, clamp_min, clamp_max);
+        Ops::store(out + i, result);
+        
+        phase += phase_step;
+        if (phase >= channels) {
+            phase -= channels;
+        }
+    }
+    
+    if (i < count) {
+        PropagateChannelsParams tail_params = params;
+        tail_params.phase = phase;
+        propagate_channels_scalar(above + i, row + i, below + i, out + i, count - i, tail_params);
+    }
+}
+
+void propagate_channels(const float * const above,
+                        const float * const row,
+                        const float * const below,
+                        float * const out,
+                        const size_t count,
+                        const PropagateChannelsParams& params)
+{
+    if (params.clamp) {
+        propagate_channels_simd<true>(above, row, below, out, count, params);
+    } else {
+        propagate_channels_simd<false>(above, row, below, out, count, params);
+    }
+}
+
+void derive_row(const float * const ally,
+                const float * const enemy,
+                float * const influence,
+                float * const tension,
+                float * const vulnerability,
+                const size_t count)
+{
+    typedef typename Ops::Vector Vector;
+    
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        const Vector a = Ops::load(ally + i);
+        const Vector e = Ops::load(enemy + i);
+        const Vector difference = Ops::sub(a, e);
+        const Vector sum = Ops::add(a, e);
+        Ops::store(influence + i, difference);
+        Ops::store(tension + i, sum);
+        Ops::store(vulnerability + i, Ops::sub(sum, Ops::abs(difference)));
+    }
+    if (i < count) {
+        scalar_kernels().derive_row(ally + i, enemy + i, influence + i, tension + i, vulnerability + i, count - i);
+    }
+}
+
+template <CombineOp Op>
+typename Ops::Vector combine_vector(const typename Ops::Vector a, const typename Ops::Vector b)
+{
+    switch (Op) {
+        case CombineAdd:       return Ops::add(a, b);
+        case CombineSubtract:  return Ops::sub(a, b);
+        case CombineMultiply:  return Ops::mul(a, b);
+        case CombineMin:       return Ops::min(a, b);
+        case CombineMax:       return Ops::max(a, b);
+        case CombineThreshold: return Ops::keep_at_least(a, b);
+    }
+    return a;
+}
+
+template <CombineOp Op>
+void combine_op(const float * const a, const float * const b, float * const out, const size_t count)
+{
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        Ops::store(out + i, combine_vector<Op>(Ops::load(a + i), Ops::load(b + i)));
+    }
+    if (i < count) {
+        scalar_kernels().combine(Op, a + i, b + i, out + i, count - i);
+    }
+}
+
+void combine(const CombineOp op,
+             const float * const a,
+             const float * const b,
+             float * const out,
+             const size_t count)
+{
+    switch (op) {
+        case CombineAdd:       combine_op<CombineAdd>(a, b, out, count); break;
+        case CombineSubtract:  combine_op<CombineSubtract>(a, b, out, count); break;
+        case CombineMultiply:  combine_op<CombineMultiply>(a, b, out, count); break;
+        case CombineMin:       combine_op<CombineMin>(a, b, out, count); break;
+        case CombineMax:       combine_op<CombineMax>(a, b, out, count); break;
+        case CombineThreshold: combine_op<CombineThreshold>(a, b, out, count); break;
+    }
+}
+
+void clamp(const float * const in,
+           float * const out,
+           const size_t count,
+           const float lowest,
+           const float highest)
+{
+    const typename Ops::Vector low = Ops::broadcast(lowest);
+    const typename Ops::Vector high = Ops::broadcast(highest);
+    
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        Ops::store(out + i, Ops::clamp(Ops::load(in + i), low, high));
+    }
+    if (i < count) {
+        scalar_kernels().clamp(in + i, out + i, count - i, lowest, highest);
+    }
+}
+
+template <StampBlend Blend, bool Clamp>
+void stamp_row_blended(float * const out,
+                       const float * const weights,
+                       const size_t count,
+                       const float strength,
+                       const float clamp_min,
+                       const float clamp_max)
+{
+    typedef typename Ops::Vector Vector;
+    
+    const Vector scale = Ops::broadcast(strength);
+    const Vector low = Ops::broadcast(clamp_min);
+    const Vector high = Ops::broadcast(clamp_max);
+    
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        const Vector stamped = Ops::mul(scale, Ops::load(weights + i));
+        Vector result;
+        switch (Blend) {
+            case StampMax:     result = Ops::max(stamped, Ops::load(out + i)); break;
+            case StampAdd:     result = Ops::add(Ops::load(out + i), stamped); break;
+            case StampReplace: result = stamped; break;
+        }
+        if (Clamp) result = Ops::clamp(result, low, high);
+        Ops::store(out + i, result);
+    }
+    
+    if (i < count) {
+        scalar_kernels().stamp_row(out + i, weights + i, count - i, strength, Blend, Clamp, clamp_min, clamp_max);
+    }
+}
+
+template <StampBlend Blend>
+void stamp_row_clamped(float * const out,
+                       const float * const weights,
+                       const size_t count,
+                       const float strength,
+                       const bool clamp,
+                       const float clamp_min,
+                       const float clamp_max)
+{
+    if (clamp) {
+        stamp_row_blended<Blend, true>(out, weights, count, strength, clamp_min, clamp_max);
+    } else {
+        stamp_row_blended<Blend, false>(out, weights, count, strength, clamp_min, clamp_max);
+    }
+}
+
+void stamp_row(float * const out,
+               const float * const weights,
+               const size_t count,
+               const float strength,
+               const StampBlend blend,
+               const bool clamp,
+               const float clamp_min,
+               const float clamp_max)
+{
+    switch (blend) {
+        case StampMax:     stamp_row_clamped<StampMax>(out, weights, count, strength, clamp, clamp_min, clamp_max); break;
+        case StampAdd:     stamp_row_clamped<StampAdd>(out, weights, count, strength, clamp, clamp_min, clamp_max); break;
+        case StampReplace: stamp_row_clamped<StampReplace>(out, weights, count, strength, clamp, clamp_min, clamp_max); break;
+    }
+}
+
+void fill(float * const out, const size_t count, const float value)
+{
+    const typename Ops::Vector v = Ops::broadcast(value);
+    
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        Ops::store(out + i, v);
+    }
+    for (; i < count; i++) {
+        out[i] = value;
+    }
+}
+
+float max(const float * const in, const size_t count, const float current)
+{
+    typedef typename Ops::Vector Vector;
+    
+    Vector lanes = Ops::broadcast(current);
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        lanes = Ops::max(Ops::load(in + i), lanes);
+    }
+    
+    float result = horizontal_max(lanes, current);
+    for (; i < count; i++) {
+        result = in[i] > result ? in[i] : result;
+    }
+    return result;
+}
+
+float max_difference(const float * const a, const float * const b, const size_t count, const float current)
+{
+    typedef typename Ops::Vector Vector;
+    
+    Vector lanes = Ops::broadcast(current);
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        lanes = Ops::max(Ops::abs(Ops::sub(Ops::load(a + i), Ops::load(b + i))), lanes);
+    }
+    
+    return scalar_kernels().max_difference(a + i, b + i, count - i, horizontal_max(lanes, current));
+}
+
+// Fixed point codes, converted to float and scaled by the same reciprocal
+// NormalizedCellTraits::decode multiplies by.
+template <typename Code>
+void widen_normalized(const Code * const in, float * const out, const size_t count)
+{
+    const typename Ops::Vector scale = Ops::broadcast(1.0f / float(Code(~Code(0))));
+    
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        Ops::store(out + i, Ops::mul(Ops::load_codes(in + i), scale));
+    }
+    widen_cells_scalar(in + i, out + i, count - i);
+}
+
+// NormalizedCellTraits::encode without its branches. Taking the max with zero
+// first sends NaNs to zero, and after limiting to one the largest code still
+// truncates back to itself.
+template <typename Code>
+void narrow_normalized(const float * const in, Code * const out, const size_t count)
+{
+    typedef typename Ops::Vector Vector;
+    
+    const Vector zero = Ops::broadcast(0.0f);
+    const Vector one = Ops::broadcast(1.0f);
+    const Vector max_code = Ops::broadcast(float(Code(~Code(0))));
+    const Vector half = Ops::broadcast(0.5f);
+    
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        const Vector value = Ops::min(Ops::max(Ops::load(in + i), zero), one);
+        Ops::store_codes(out + i, Ops::add(Ops::mul(value, max_code), half));
+    }
+    narrow_cells_scalar(in + i, out + i, count - i);
+}
+
+void widen_half(const Half * const in, float * const out, const size_t count)
+{
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        Ops::store(out + i, Ops::load_half(in + i));
+    }
+    widen_cells_scalar(in + i, out + i, count - i);
+}
+
+void narrow_half(const float * const in, Half * const out, const size_t count)
+{
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        Ops::store_half(out + i, Ops::load(in + i));
+    }
+    narrow_cells_scalar(in + i, out + i, count - i);
+}
@@ -0,0 +1,154 @@
+#include "map_kernels.h"
+
+#if INFLUENCE_MAP_X86_SIMD
+
+#include <immintrin.h>
+#include <cstring>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#pragma STDC FP_CONTRACT OFF
+#else
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace influence_map {
+namespace detail {
+    
+    namespace {
+        
+        struct Ops
+        {
+            typedef __m128 Vector;
+            static const size_t WIDTH = 4;
+            
+            static Vector load(const float * const p) { return _mm_loadu_ps(p); }
+            static void store(float * const p, const Vector v) { _mm_storeu_ps(p, v); }
+            static Vector broadcast(const float v) { return _mm_set1_ps(v); }
+            
+            static Vector add(const Vector a, const Vector b) { return _mm_add_ps(a, b); }
+            static Vector sub(const Vector a, const Vector b) { return _mm_sub_ps(a, b); }
+            static Vector mul(const Vector a, const Vector b) { return _mm_mul_ps(a, b); }
+            static Vector max(const Vector candidate, const Vector current) { return _mm_max_ps(candidate, current); }
+            static Vector min(const Vector a, const Vector b) { return _mm_min_ps(a, b); }
+            static Vector keep_at_least(const Vector v, const Vector level) { return _mm_and_ps(_mm_cmpge_ps(v, level), v); }
+            static Vector abs(const Vector v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+            
+            static Vector clamp(const Vector v, const Vector lowest, const Vector highest)
+            {
+                const Vector in_range = _mm_and_ps(_mm_cmpge_ps(v, lowest), _mm_cmple_ps(v, highest));
+                const Vector limit = _mm_blendv_ps(lowest, highest, _mm_cmpgt_ps(v, highest));
+                return _mm_blendv_ps(limit, v, in_range);
+            }
+            
+            // Zeroes the lanes whose bit is set in the low WIDTH bits of lanes.
+            static Vector clear_lanes(const Vector v, const uint64_t lanes)
+            {
+                const __m128i lane_bits = _mm_setr_epi32(1, 2, 4, 8);
+                const __m128i set = _mm_and_si128(_mm_set1_epi32(int(lanes & 0xf)), lane_bits);
+                return _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(set, lane_bits)), v);
+            }
+            
+            // table[indices[lane]] for each lane. SSE has no gather instruction.
+            static Vector gather(const float * const table, const uint8_t * const indices)
+            {
+                return _mm_setr_ps(table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]);
+            }
+            
+            // Lane i of table for each index, building a byte shuffle out of the
+            // indices.
+            typedef __m128i Indices;
+            static Indices indices(const uint8_t * const indices)
+            {
+                int packed;
+                memcpy(&packed, indices, sizeof(packed));
+                const __m128i lanes = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+                const __m128i first_bytes = _mm_shuffle_epi8(_mm_slli_epi32(lanes, 2), _mm_setr_epi8(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12));
+                return _mm_add_epi8(first_bytes, _mm_set1_epi32(0x03020100));
+            }
+            static Vector permute(const Vector table, const Indices indices)
+            {
+                return _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(table), indices));
+            }
+            
+            // Fixed point codes as floats, and back again truncating floats
+            // that already hold a code plus a half.
+            static Vector load_codes(const uint8_t * const p)
+            {
+                int packed;
+                memcpy(&packed, p, sizeof(packed));
+                return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+            }
+            static Vector load_codes(const uint16_t * const p)
+            {
+                return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+            }
+            static void store_codes(uint8_t * const p, const Vector codes)
+            {
+                const __m128i words = _mm_packus_epi32(_mm_cvttps_epi32(codes), _mm_setzero_si128());
+                const int packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+                memcpy(p, &packed, sizeof(packed));
+            }
+            static void store_codes(uint16_t * const p, const Vector codes)
+            {
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi32(_mm_cvttps_epi32(codes), _mm_setzero_si128()));
+            }
+            
+            // SSE has no half conversions, so these go through the scalar ones.
+            static Vector load_half(const Half * const p)
+            {
+                float values[WIDTH];
+                widen_cells_scalar(p, values, WIDTH);
+                return _mm_loadu_ps(values);
+            }
+            static void store_half(Half * const p, const Vector v)
+            {
+                float values[WIDTH];
+                _mm_storeu_ps(values, v);
+                narrow_cells_scalar(values, p, WIDTH);
+            }
+        };
+        
+#include "map_kernels_simd.inl"
+        
+    } // namespace
+    
+} // namespace detail
+} // namespace influence_map
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+namespace influence_map {
+namespace detail {
+    
+    const KernelTable& sse41_kernels()
+    {
+        static const KernelTable table = {
+            SSE41,
+            propagate_row,
+            propagate_row_residual,
+            fill,
+            max,
+            propagate_channels,
+            derive_row,
+            combine,
+            clamp,
+            stamp_row,
+            { widen_normalized<uint8_t>, narrow_normalized<uint8_t> },
+            { widen_normalized<uint16_t>, narrow_normalized<uint16_t> },
+            { widen_half, narrow_half },
+            max_difference
+        };
+        return table;
+    }
+    
+} // namespace detail
+} // namespace influence_map
+
+#endif // INFLUENCE_MAP_X86_SIMD
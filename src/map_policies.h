@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+
+namespace influence_map {
+    
+    // Clamp policies ///////////////////////////////////////////////////////////
+    //
+    // Decide whether and where set_influence() and propagate() clamp influence.
+    // clamps() is given the clamp_values_to_0_1 the map was constructed with,
+    // which only RuntimeClamp01 looks at; everything else is a compile time
+    // constant, so unused clamping compiles away.
+    
+    /**
+     * Clamps to 0..1 if the map was constructed with clamp_values_to_0_1. The
+     * default, matching the original runtime flag.
+     */
+    struct RuntimeClamp01
+    {
+        static bool clamps(const bool clamp_values_to_0_1) { return clamp_values_to_0_1; }
+        template <typename Value> static Value lowest() { return Value(0); }
+        template <typename Value> static Value highest() { return Value(1); }
+    };
+    
+    struct NoClamp
+    {
+        static bool clamps(const bool) { return false; }
+        template <typename Value> static Value lowest() { return Value(0); }
+        template <typename Value> static Value highest() { return Value(0); }
+    };
+    
+    struct Clamp01
+    {
+        static bool clamps(const bool) { return true; }
+        template <typename Value> static Value lowest() { return Value(0); }
+        template <typename Value> static Value highest() { return Value(1); }
+    };
+    
+    /**
+     * Clamps to Low / Denominator .. High / Denominator, since C++11 template
+     * arguments can't be floating point. ClampRange<-1, 1> clamps to -1..1 and
+     * ClampRange<0, 1, 2> to 0..0.5.
+     */
+    template <long Low, long High, long Denominator = 1>
+    struct ClampRange
+    {
+        static_assert(Low <= High, "ClampRange needs Low <= High");
+        static_assert(Denominator > 0, "ClampRange needs a positive Denominator");
+        
+        static bool clamps(const bool) { return true; }
+        template <typename Value> static Value lowest() { return Value(Low) / Value(Denominator); }
+        template <typename Value> static Value highest() { return Value(High) / Value(Denominator); }
+    };
+    
+    // Border policies //////////////////////////////////////////////////////////
+    //
+    // Decide what connections() and propagate() see beyond the edge of the map.
+    // resolve() maps a coordinate on one axis that may be out of bounds onto a
+    // cell inside 0..size - 1 and returns true, or returns false if the
+    // position reads as the constant value(). CONSTANT borders never resolve an
+    // out of bounds coordinate, so the map can keep value() in its halo for good.
+    
+    /**
+     * Nothing beyond the edge, the original behaviour. Influence is never
+     * negative where it matters to propagate(), so zero is the same as ignoring
+     * the missing neighbours.
+     */
+    struct ZeroBorder
+    {
+        static const bool CONSTANT = true;
+        template <typename Value> static Value value() { return Value(0); }
+        
+        static bool resolve(ptrdiff_t& coord, const size_t size)
+        {
+            return coord >= 0 && coord < ptrdiff_t(size);
+        }
+    };
+    
+    /**
+     * A fixed influence of Numerator / Denominator beyond every edge.
+     */
+    template <long Numerator, long Denominator = 1>
+    struct ConstantBorder
+    {
+        static_assert(Denominator > 0, "ConstantBorder needs a positive Denominator");
+        
+        static const bool CONSTANT = true;
+        template <typename Value> static Value value() { return Value(Numerator) / Value(Denominator); }
+        
+        static bool resolve(ptrdiff_t& coord, const size_t size)
+        {
+            return coord >= 0 && coord < ptrdiff_t(size);
+        }
+    };
+    
+    /**
+     * Out of bounds neighbours repeat the nearest cell on the edge.
+     */
+    struct ClampToEdgeBorder
+    {
+        static const bool CONSTANT = false;
+        template <typename Value> static Value value() { return Value(0); }
+        
+        static bool resolve(ptrdiff_t& coord, const size_t size)
+        {
+            if (coord < 0) {
+                coord = 0;
+            } else if (coord >= ptrdiff_t(size)) {
+                coord = ptrdiff_t(size) - 1;
+            }
+            return true;
+        }
+    };
+    
+    /**
+     * The map is a torus: leaving one edge comes back in at the opposite one.
+     */
+    struct WrapBorder
+    {
+        static const bool CONSTANT = false;
+        template <typename Value> static Value value() { return Value(0); }
+        
+        static bool resolve(ptrdiff_t& coord, const size_t size)
+        {
+            coord %= ptrdiff_t(size);
+            if (coord < 0) {
+                coord += ptrdiff_t(size);
+            }
+            return true;
+        }
+    };
+
+} // namespace influence_map
@@ -0,0 +1,7 @@
+#include "scenario_batch.h"
+
+namespace influence_map {
+    
+    template class BasicScenarioBatch<float>;
+
+} // namespace influence_map
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "influence_map_fork.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace influence_map {
+    
+    /**
+     * One plan to try on a map: sources to stamp onto it, all with the same
+     * blend, before it propagates. A StampReplace stamp of strength zero takes
+     * influence away.
+     */
+    template <typename Value>
+    struct BasicScenario
+    {
+        const BasicStampSource<Value>* sources;
+        size_t num_sources;
+        StampBlend blend;
+    };
+    
+    /**
+     * Scores many scenarios against one map, each on its own fork of it, spread
+     * over a thread pool. Every thread keeps a fork workspace from one batch to
+     * the next, so after the first batch a scenario allocates little more than
+     * its fork's table of tiles.
+     */
+    template <typename Cell, typename Clamp = RuntimeClamp01, typename Border = ZeroBorder>
+    class BasicScenarioBatch
+    {
+    public:
+        typedef BasicInfluenceMap<Cell, Clamp, Border> Map;
+        typedef BasicInfluenceMapFork<Cell, Clamp, Border> Fork;
+        typedef typename Map::Value Value;
+        typedef BasicScenario<Value> Scenario;
+        
+        /**
+         * A null thread pool evaluates every scenario on the calling thread.
+         */
+        explicit BasicScenarioBatch(ThreadPool * const thread_pool = nullptr);
+        BasicScenarioBatch(const BasicScenarioBatch&) = delete;
+        BasicScenarioBatch& operator=(const BasicScenarioBatch&) = delete;
+        
+        /**
+         * For each of count scenarios, forks map, stamps the scenario's
+         * sources, propagates steps times and stores score(fork) in scores.
+         * Scenarios go to threads as they come free, and score is called on
+         * whichever thread ran the scenario, so it must be safe to call from
+         * several at once. Forks read map as it is until this returns.
+         */
+        template <typename Score>
+        void evaluate(const Map& map,
+                      const Scenario * const scenarios,
+                      const size_t count,
+                      const size_t steps,
+                      const Value momentum,
+                      const Value decay,
+                      const Score& score,
+                      Value * const scores);
+        
+        ThreadPool* thread_pool() const;
+    
+    private:
+        typedef typename Fork::Workspace Workspace;
+        
+        ThreadPool* _thread_pool;
+        
+        // One per thread of the pool, created by the first batch.
+        std::vector<std::unique_ptr<Workspace> > _workspaces;
+    };
+    
+    typedef BasicScenario<float> Scenario;
+    typedef BasicScenarioBatch<float> ScenarioBatch;
+    
+    // The common float batch is built once, in scenario_batch.cpp.
+    extern template class BasicScenarioBatch<float>;
+
+} // namespace influence_map
+
+#include "scenario_batch.inl"
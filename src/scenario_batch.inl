@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <atomic>
+
+namespace influence_map {
+    
+    template <typename Cell, typename Clamp, typename Border>
+    BasicScenarioBatch<Cell, Clamp, Border>::BasicScenarioBatch(ThreadPool * const thread_pool) :
+        _thread_pool(thread_pool)
+    {
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    template <typename Score>
+    void BasicScenarioBatch<Cell, Clamp, Border>::evaluate(const Map& map,
+                                                           const Scenario * const scenarios,
+                                                           const size_t count,
+                                                           const size_t steps,
+                                                           const Value momentum,
+                                                           const Value decay,
+                                                           const Score& score,
+                                                           Value * const scores)
+    {
+        const size_t num_workers = std::min(_thread_pool ? std::max(_thread_pool->num_threads(), size_t(1)) : size_t(1),
+                                            std::max(count, size_t(1)));
+        while (_workspaces.size() < num_workers) {
+            _workspaces.push_back(std::unique_ptr<Workspace>(new Workspace()));
+        }
+        
+        // One task per workspace, each taking the next scenario until there
+        // are none left, so a slow scenario doesn't hold up the rest.
+        std::atomic<size_t> next_scenario(0);
+        auto run_worker = [&](const size_t worker) {
+            Workspace& workspace = *_workspaces[worker];
+            for (size_t i = next_scenario++; i < count; i = next_scenario++) {
+                const Scenario& scenario = scenarios[i];
+                Fork fork(map, &workspace);
+                fork.stamp_many(scenario.sources, scenario.num_sources, scenario.blend);
+                for (size_t step = 0; step < steps; step++) {
+                    fork.propagate(momentum, decay);
+                }
+                scores[i] = score(static_cast<const Fork&>(fork));
+            }
+        };
+        
+        if (num_workers > 1) {
+            _thread_pool->parallel_for(num_workers, run_worker);
+        } else {
+            run_worker(0);
+        }
+    }
+    
+    template <typename Cell, typename Clamp, typename Border>
+    ThreadPool* BasicScenarioBatch<Cell, Clamp, Border>::thread_pool() const
+    {
+        return _thread_pool;
+    }
+
+} // namespace influence_map
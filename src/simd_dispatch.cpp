@@ -0,0 +1,149 @@
+#include "simd_dispatch.h"
+#include "map_kernels.h"
+#include "xassert.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if INFLUENCE_MAP_X86_SIMD
+#include <cpuid.h>
+#endif
+
+namespace influence_map {
+    
+    namespace {
+        
+#if INFLUENCE_MAP_X86_SIMD
+        unsigned long long read_xcr0()
+        {
+            unsigned int eax, edx;
+            __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return (static_cast<unsigned long long>(edx) << 32) | eax;
+        }
+#endif
+        
+        SimdTier detect_simd_tier()
+        {
+#if INFLUENCE_MAP_X86_SIMD
+            unsigned int eax, ebx, ecx, edx;
+            if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+                return Scalar;
+            }
+            
+            const bool sse41 = (ecx & bit_SSE4_1) != 0;
+            if (!sse41) return Scalar;
+            
+            // The wider tiers also need the OS to save the vector registers on a
+            // context switch, which it reports through XCR0.
+            const bool osxsave = (ecx & bit_OSXSAVE) != 0;
+            const bool avx = (ecx & bit_AVX) != 0;
+            if (!osxsave || !avx) return SSE41;
+            
+            // Every CPU with AVX2 has F16C too, but check rather than assume:
+            // the AVX2 kernels convert half cells with it.
+            const bool f16c = (ecx & bit_F16C) != 0;
+            
+            const unsigned long long xcr0 = read_xcr0();
+            const unsigned long long ymm_state = 0x6;  // XMM | YMM
+            const unsigned long long zmm_state = 0xe6; // XMM | YMM | opmask | ZMM_Hi256 | Hi16_ZMM
+            if ((xcr0 & ymm_state) != ymm_state) return SSE41;
+            
+            if (__get_cpuid_max(0, 0) < 7) return SSE41;
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            
+            const bool avx2 = (ebx & bit_AVX2) != 0;
+            const bool avx512f = (ebx & bit_AVX512F) != 0;
+            if (!avx2 || !f16c) return SSE41;
+            if (!avx512f || (xcr0 & zmm_state) != zmm_state) return AVX2;
+            return AVX512;
+#else
+            return Scalar;
+#endif
+        }
+        
+        bool parse_simd_tier(const char * const name, SimdTier& tier)
+        {
+            const SimdTier tiers[] = { Scalar, SSE41, AVX2, AVX512 };
+            for (size_t i = 0; i < sizeof(tiers) / sizeof(tiers[0]); i++) {
+                if (strcmp(name, simd_tier_name(tiers[i])) == 0) {
+                    tier = tiers[i];
+                    return true;
+                }
+            }
+            return false;
+        }
+        
+        SimdTier initial_simd_tier()
+        {
+            SimdTier tier = detected_simd_tier();
+            
+            const char * const requested = getenv("CCINFLUENCE_SIMD");
+            SimdTier requested_tier;
+            if (requested && parse_simd_tier(requested, requested_tier) && requested_tier < tier) {
+                tier = requested_tier;
+            }
+            
+            return tier;
+        }
+        
+        std::atomic<const detail::KernelTable*>& active_table()
+        {
+            static std::atomic<const detail::KernelTable*> table(&detail::kernels_for(initial_simd_tier()));
+            return table;
+        }
+        
+    } // namespace
+    
+    SimdTier detected_simd_tier()
+    {
+        static const SimdTier tier = detect_simd_tier();
+        return tier;
+    }
+    
+    SimdTier active_simd_tier()
+    {
+        return detail::kernels().tier;
+    }
+    
+    SimdTier force_simd_tier(const SimdTier tier)
+    {
+        const SimdTier supported = tier < detected_simd_tier() ? tier : detected_simd_tier();
+        active_table().store(&detail::kernels_for(supported));
+        return supported;
+    }
+    
+    const char* simd_tier_name(const SimdTier tier)
+    {
+        switch (tier) {
+            case Scalar: return "scalar";
+            case SSE41:  return "sse4.1";
+            case AVX2:   return "avx2";
+            case AVX512: return "avx512";
+        }
+        return "unknown";
+    }
+    
+namespace detail {
+    
+    const KernelTable& kernels_for(const SimdTier tier)
+    {
+        XASSERT(tier <= detected_simd_tier(), "SIMD tier is not supported by this CPU");
+        
+        switch (tier) {
+#if INFLUENCE_MAP_X86_SIMD
+            case AVX512: return avx512_kernels();
+            case AVX2:   return avx2_kernels();
+            case SSE41:  return sse41_kernels();
+#endif
+            default:     return scalar_kernels();
+        }
+    }
+    
+    const KernelTable& kernels()
+    {
+        return *active_table().load(std::memory_order_acquire);
+    }
+    
+} // namespace detail
+} // namespace influence_map
@@ -0,0 +1,44 @@
+#pragma once
+
+namespace influence_map {
+    
+    /**
+     * Instruction set tiers the map kernels are built for, in increasing order of
+     * preference. Every tier produces bit identical results, they only differ in
+     * speed.
+     */
+    enum SimdTier {
+        Scalar = 0,
+        SSE41  = 1,
+        AVX2   = 2,
+        AVX512 = 3
+    };
+    
+    /**
+     * The best tier the host CPU and OS support, detected once with CPUID. The
+     * AVX2 tier also needs F16C.
+     */
+    SimdTier detected_simd_tier();
+    
+    /**
+     * The tier the kernels are currently bound to.
+     *
+     * On first use this is the detected tier, lowered to the one named by the
+     * CCINFLUENCE_SIMD environment variable if that is set to one of "scalar",
+     * "sse4.1", "avx2" or "avx512".
+     */
+    SimdTier active_simd_tier();
+    
+    /**
+     * Rebinds every kernel to the given tier for benchmarking and testing. Tiers
+     * the host cannot run are lowered to the detected tier. Returns the tier that
+     * is now active.
+     *
+     * Safe to call at any time, but a propagate already in flight on another
+     * thread finishes with the kernels it started with.
+     */
+    SimdTier force_simd_tier(const SimdTier tier);
+    
+    const char* simd_tier_name(const SimdTier tier);
+    
+} // namespace influence_map
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace influence_map {
+    
+    /**
+     * How a stamp combines with the influence already in each cell it covers.
+     */
+    enum StampBlend {
+        StampMax     = 0,   // The larger of the two, as max_of()
+        StampAdd     = 1,
+        StampReplace = 2
+    };
+    
+    /**
+     * How a stamp of radius r falls off with the distance d of a cell from its
+     * centre. Cells further than r away are not covered at all.
+     */
+    enum StampFalloff {
+        FalloffConstant  = 0,   // strength
+        FalloffLinear    = 1,   // strength * (1 - d / (r + 1))
+        FalloffQuadratic = 2    // strength * (1 - d / (r + 1))^2
+    };
+    
+    /**
+     * One source for stamp_many(): a disc of influence centred on cell (x, y).
+     */
+    template <typename Value>
+    struct BasicStampSource
+    {
+        size_t x;
+        size_t y;
+        size_t radius;
+        Value strength;
+        StampFalloff falloff;
+    };
+
+namespace detail {
+    
+    /**
+     * The weights of a disc, row by row, 2 * radius + 1 to a row. Row radius +
+     * dy covers the half_widths[radius + dy] cells either side of the centre
+     * column, and those weights are all positive.
+     */
+    template <typename Value>
+    struct BasicStampKernel
+    {
+        size_t radius;
+        StampFalloff falloff;
+        std::vector<Value> weights;
+        std::vector<size_t> half_widths;
+    };
+    
+    /**
+     * The index in cache of the kernel for radius and falloff, worked out and
+     * appended the first time it is asked for.
+     */
+    template <typename Value>
+    size_t find_stamp_kernel(std::vector<BasicStampKernel<Value> >& cache, const size_t radius, const StampFalloff falloff)
+    {
+        for (size_t i = 0; i < cache.size(); i++) {
+            if (cache[i].radius == radius && cache[i].falloff == falloff) {
+                return i;
+            }
+        }
+        
+        const size_t diameter = 2 * radius + 1;
+        BasicStampKernel<Value> kernel;
+        kernel.radius = radius;
+        kernel.falloff = falloff;
+        kernel.weights.assign(diameter * diameter, Value(0));
+        kernel.half_widths.assign(diameter, 0);
+        
+        // A cell is covered when its centre is within radius of the disc's.
+        // Distances are compared squared, in integers, so discs are exact.
+        const ptrdiff_t r = ptrdiff_t(radius);
+        for (ptrdiff_t dy = -r; dy <= r; dy++) {
+            for (ptrdiff_t dx = -r; dx <= r; dx++) {
+                const size_t squared = size_t(dx * dx + dy * dy);
+                if (squared > radius * radius) {
+                    continue;
+                }
+                
+                const Value fraction = std::sqrt(Value(squared)) / Value(radius + 1);
+                Value weight = Value(1);
+                if (falloff == FalloffLinear) {
+                    weight = Value(1) - fraction;
+                } else if (falloff == FalloffQuadratic) {
+                    weight = (Value(1) - fraction) * (Value(1) - fraction);
+                }
+                
+                const size_t row = size_t(dy + r);
+                kernel.weights[row * diameter + size_t(dx + r)] = weight;
+                kernel.half_widths[row] = std::max(kernel.half_widths[row], size_t(dx < 0 ? -dx : dx));
+            }
+        }
+        
+        cache.push_back(kernel);
+        return cache.size() - 1;
+    }
+
+} // namespace detail
+
+} // namespace influence_map
@@ -0,0 +1,74 @@
+#include "catch.hpp"
+#include "buffer_pool.h"
+
+#include <cstdint>
+#include <cstring>
+
+using namespace influence_map;
+
+TEST_CASE( "buffer pools sort requests into size classes", "[BufferPool]" ) {
+    REQUIRE( BufferPool::class_bytes(0) == 256 );
+    REQUIRE( BufferPool::class_bytes(256) == 256 );
+    REQUIRE( BufferPool::class_bytes(257) == 320 );
+    REQUIRE( BufferPool::class_bytes(320) == 320 );
+    REQUIRE( BufferPool::class_bytes(321) == 384 );
+    REQUIRE( BufferPool::class_bytes(512) == 512 );
+    REQUIRE( BufferPool::class_bytes(513) == 640 );
+    REQUIRE( BufferPool::class_bytes(1000000) == 1048576 );
+    
+    // No class wastes more than a quarter of what it was asked for.
+    for (size_t bytes = 257; bytes < 100000; bytes += 97) {
+        const size_t class_bytes = BufferPool::class_bytes(bytes);
+        const size_t waste = class_bytes - bytes;
+        REQUIRE( class_bytes >= bytes );
+        REQUIRE( waste < bytes / 4 );
+    }
+}
+
+TEST_CASE( "buffer pools hand released buffers back out zeroed", "[BufferPool]" ) {
+    BufferPool pool;
+    
+    unsigned char * const first = static_cast<unsigned char*>(pool.allocate(1000));
+    REQUIRE( first != nullptr );
+    const uintptr_t misalignment = reinterpret_cast<uintptr_t>(first) % 64;
+    REQUIRE( misalignment == 0 );
+    memset(first, 0xff, 1000);
+    pool.release(first, 1000);
+    REQUIRE( pool.num_spare_buffers() == 1 );
+    REQUIRE( pool.spare_bytes() == BufferPool::class_bytes(1000) );
+    
+    // Any request of the same class gets it.
+    unsigned char * const second = static_cast<unsigned char*>(pool.allocate(960));
+    REQUIRE( second == first );
+    REQUIRE( pool.num_spare_buffers() == 0 );
+    bool zeroed = true;
+    for (size_t i = 0; i < 960; i++) {
+        zeroed = zeroed && second[i] == 0;
+    }
+    REQUIRE( zeroed );
+    
+    void * const other_class = pool.allocate(2000);
+    REQUIRE( other_class != second );
+    pool.release(second, 960);
+    pool.release(other_class, 2000);
+    pool.release(nullptr, 2000);
+    REQUIRE( pool.num_spare_buffers() == 2 );
+    
+    pool.trim();
+    REQUIRE( pool.num_spare_buffers() == 0 );
+    REQUIRE( pool.spare_bytes() == 0 );
+}
+
+TEST_CASE( "buffer pools free what they have no room to keep", "[BufferPool]" ) {
+    BufferPool pool(3000);
+    
+    void* buffers[4];
+    for (size_t i = 0; i < 4; i++) {
+        buffers[i] = pool.allocate(1024);
+    }
+    for (size_t i = 0; i < 4; i++) {
+        pool.release(buffers[i], 1024);
+    }
+    REQUIRE( pool.num_spare_buffers() == 2 );
+    REQUIRE( pool.spare_bytes() == 2048 );
+}
@@ -0,0 +1,57 @@
+#include "catch.hpp"
+#include "cell_buffer.h"
+
+#include <cstdint>
+#include <cstring>
+
+using namespace influence_map;
+
+TEST_CASE( "cell buffers start on a cache line and come zeroed", "[CellBuffer]" ) {
+    const HugePages initial = huge_pages();
+    const HugePages settings[] = { HugePagesOff, HugePagesTransparent, HugePagesReserved };
+    const size_t sizes[] = { 1, 1000, detail::MIN_HUGE_PAGE_BUFFER_BYTES - 1, detail::MIN_HUGE_PAGE_BUFFER_BYTES, 5 * 1024 * 1024 + 3 };
+    
+    for (size_t s = 0; s < 3; s++) {
+        set_huge_pages(settings[s]);
+        REQUIRE( huge_pages() == settings[s] );
+        
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            INFO( huge_pages_name(settings[s]) << ", " << sizes[i] << " bytes" );
+            
+            unsigned char * const cells = detail::allocate_cells<unsigned char>(sizes[i]);
+            REQUIRE( cells != nullptr );
+            const uintptr_t misalignment = reinterpret_cast<uintptr_t>(cells) % detail::CACHE_LINE_BYTES;
+            REQUIRE( misalignment == 0 );
+            
+            bool zeroed = true;
+            for (size_t b = 0; b < sizes[i]; b++) {
+                zeroed = zeroed && cells[b] == 0;
+            }
+            REQUIRE( zeroed );
+            
+            // Every byte is ours to write.
+            memset(cells, 0x5a, sizes[i]);
+            REQUIRE( cells[sizes[i] - 1] == 0x5a );
+            
+            const size_t mapped = detail::mapped_bytes(cells);
+            if (settings[s] == HugePagesOff || sizes[i] < detail::MIN_HUGE_PAGE_BUFFER_BYTES) {
+                REQUIRE( mapped == 0 );
+            } else if (mapped > 0) {
+                // The mapping covers whole huge pages.
+                const size_t partial_page = mapped % detail::HUGE_PAGE_BYTES;
+                REQUIRE( partial_page == 0 );
+                REQUIRE( mapped >= sizes[i] + detail::CACHE_LINE_BYTES );
+            }
+            
+            detail::free_cells(cells);
+        }
+    }
+    
+    set_huge_pages(initial);
+}
+
+TEST_CASE( "huge page settings have names", "[CellBuffer]" ) {
+    REQUIRE( strcmp(huge_pages_name(HugePagesOff), "off") == 0 );
+    REQUIRE( strcmp(huge_pages_name(HugePagesTransparent), "transparent") == 0 );
+    REQUIRE( strcmp(huge_pages_name(HugePagesReserved), "reserved") == 0 );
+}
@@ -0,0 +1,62 @@
+#include "catch.hpp"
+#include "cell_types.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace influence_map;
+using namespace influence_map::detail;
+
+TEST_CASE( "half conversions round trip every half", "[CellTypes]" ) {
+    bool round_trips = true;
+    for (uint32_t bits = 0; bits <= 0xffff; bits++) {
+        const float value = half_to_float(uint16_t(bits));
+        if (value == value) {
+            round_trips = round_trips && float_to_half(value) == bits;
+        } else {
+            round_trips = round_trips && (float_to_half(value) & 0x7c00) == 0x7c00 && (float_to_half(value) & 0x3ff) != 0;
+        }
+    }
+    REQUIRE( round_trips );
+}
+
+TEST_CASE( "floats round to the nearest half", "[CellTypes]" ) {
+    REQUIRE( float_to_half(1.0f) == 0x3c00 );
+    REQUIRE( float_to_half(-2.0f) == 0xc000 );
+    REQUIRE( float_to_half(65504.0f) == 0x7bff );
+    REQUIRE( float_to_half(65519.0f) == 0x7bff );
+    REQUIRE( float_to_half(65520.0f) == 0x7c00 );
+    REQUIRE( float_to_half(INFINITY) == 0x7c00 );
+    
+    // Ties go to even, in normals and subnormals alike.
+    REQUIRE( float_to_half(1.0f + 1.0f / 2048.0f) == 0x3c00 );
+    REQUIRE( float_to_half(1.0f + 3.0f / 2048.0f) == 0x3c02 );
+    REQUIRE( float_to_half(ldexpf(1.0f, -24)) == 0x0001 );
+    REQUIRE( float_to_half(ldexpf(1.0f, -25)) == 0x0000 );
+    REQUIRE( float_to_half(ldexpf(3.0f, -25)) == 0x0002 );
+    
+    REQUIRE( half_to_float(0x0001) == ldexpf(1.0f, -24) );
+    REQUIRE( half_to_float(0x3555) == 0.333251953125f );
+}
+
+TEST_CASE( "normalized cells cover 0..1 exactly", "[CellTypes]" ) {
+    typedef CellTraits<uint8_t> U8;
+    typedef CellTraits<uint16_t> U16;
+    
+    REQUIRE( U8::decode(0) == 0.0f );
+    REQUIRE( U8::decode(255) == 1.0f );
+    REQUIRE( U16::decode(65535) == 1.0f );
+    REQUIRE( U8::encode(2.0f) == 255 );
+    REQUIRE( U8::encode(-1.0f) == 0 );
+    REQUIRE( U8::encode(NAN) == 0 );
+    
+    bool round_trips = true;
+    for (uint32_t code = 0; code <= 0xffff; code++) {
+        round_trips = round_trips && U16::encode(U16::decode(uint16_t(code))) == code;
+        round_trips = round_trips && (code > 0xff || U8::encode(U8::decode(uint8_t(code))) == code);
+        round_trips = round_trips && (code == 0 || U16::decode(uint16_t(code)) > U16::decode(uint16_t(code - 1)));
+    }
+    REQUIRE( round_trips );
+    
+    REQUIRE( U8::largest(3, 200, 7, 199) == U8::decode(200) );
+}
@@ -0,0 +1,107 @@
+#include "catch.hpp"
+#include "derived_maps.h"
+#include "simd_dispatch.h"
+#include "test_helpers.h"
+#include "thread_pool.h"
+
+#include <cmath>
+
+using namespace influence_map;
+
+namespace {
+    
+    // Whether maps holds exactly what deriving from ally and enemy cell by
+    // cell gives.
+    bool derived_from(const DerivedInfluenceMaps& maps, const InfluenceMap& ally, const InfluenceMap& enemy)
+    {
+        for (size_t y = 0; y < maps.height(); y++) {
+            for (size_t x = 0; x < maps.width(); x++) {
+                const float influence = ally.influence(x, y) - enemy.influence(x, y);
+                const float tension = ally.influence(x, y) + enemy.influence(x, y);
+                if (!test::same_bits(maps.influence().influence(x, y), influence) ||
+                    !test::same_bits(maps.tension().influence(x, y), tension) ||
+                    !test::same_bits(maps.vulnerability().influence(x, y), tension - std::fabs(influence))) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+} // namespace
+
+TEST_CASE( "derived maps combine ally and enemy influence", "[DerivedInfluenceMaps]" ) {
+    InfluenceMap ally(3, 1, true, 0.0f);
+    InfluenceMap enemy(3, 1, true, 0.0f);
+    ally.set_influence(0, 0, 0.75f);
+    ally.set_influence(1, 0, 0.5f);
+    enemy.set_influence(1, 0, 0.25f);
+    enemy.set_influence(2, 0, 1.0f);
+    
+    DerivedInfluenceMaps maps(3, 1);
+    maps.derive(ally, enemy);
+    
+    REQUIRE( maps.influence().influence(0, 0) == 0.75f );
+    REQUIRE( maps.influence().influence(1, 0) == 0.25f );
+    REQUIRE( maps.influence().influence(2, 0) == -1.0f );
+    REQUIRE( maps.tension().influence(1, 0) == 0.75f );
+    REQUIRE( maps.tension().influence(2, 0) == 1.0f );
+    REQUIRE( maps.vulnerability().influence(0, 0) == 0.0f );
+    REQUIRE( maps.vulnerability().influence(1, 0) == 0.5f );
+    REQUIRE( maps.vulnerability().influence(2, 0) == 0.0f );
+}
+
+TEST_CASE( "fused derived propagation matches propagating then deriving", "[DerivedInfluenceMaps]" ) {
+    const size_t sizes[][2] = { {1, 1}, {7, 3}, {37, 23}, {53, 211} };
+    const SimdTier initial_tier = active_simd_tier();
+    ThreadPool pool(3);
+    
+    for (int tier = Scalar; tier <= detected_simd_tier(); tier++) {
+        force_simd_tier(SimdTier(tier));
+        
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (int threaded = 0; threaded < 2; threaded++) {
+                const size_t width = sizes[s][0];
+                const size_t height = sizes[s][1];
+                
+                InfluenceMap ally(width, height, true, 0.0f);
+                InfluenceMap enemy(width, height, true, 0.0f);
+                InfluenceMap expected_ally(width, height, true, 0.0f);
+                InfluenceMap expected_enemy(width, height, true, 0.0f);
+                test::seed(ally, unsigned(width + height));
+                test::seed(expected_ally, unsigned(width + height));
+                test::seed(enemy, unsigned(width * height));
+                test::seed(expected_enemy, unsigned(width * height));
+                
+                // Obstacles and terrain on one side only.
+                ally.set_obstacle(width / 2, height / 2, true);
+                expected_ally.set_obstacle(width / 2, height / 2, true);
+                enemy.set_terrain(0, height - 1, 1);
+                enemy.set_terrain_cost(1, 3.0f);
+                expected_enemy.set_terrain(0, height - 1, 1);
+                expected_enemy.set_terrain_cost(1, 3.0f);
+                
+                DerivedInfluenceMaps maps(width, height);
+                DerivedInfluenceMaps expected(width, height);
+                if (threaded) maps.set_thread_pool(&pool);
+                
+                for (int step = 0; step < 4; step++) {
+                    const float momentum = 0.3f + 0.15f * step;
+                    const float decay = 0.1f * step;
+                    maps.propagate(ally, enemy, momentum, decay);
+                    expected_ally.propagate(momentum, decay);
+                    expected_enemy.propagate(momentum, decay);
+                    expected.derive(expected_ally, expected_enemy);
+                    
+                    INFO( simd_tier_name(SimdTier(tier)) << ", size " << width << "x" << height << ", threaded " << threaded << ", step " << step );
+                    REQUIRE( test::same_cells(ally, expected_ally) );
+                    REQUIRE( test::same_cells(enemy, expected_enemy) );
+                    REQUIRE( derived_from(maps, ally, enemy) );
+                    REQUIRE( derived_from(expected, ally, enemy) );
+                }
+            }
+        }
+    }
+    
+    force_simd_tier(initial_tier);
+}
@@ -0,0 +1,288 @@
+#include "catch.hpp"
+#include "emitter_field.h"
+#include "influence_map.h"
+#include "simd_dispatch.h"
+#include "test_helpers.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace influence_map;
+
+namespace {
+    
+    EmitterField::Source random_source(unsigned int& state, const size_t width, const size_t height)
+    {
+        const StampFalloff falloffs[] = { FalloffConstant, FalloffLinear, FalloffQuadratic };
+        const EmitterField::Source source = {
+            test::random_below(state, unsigned(width)),
+            test::random_below(state, unsigned(height)),
+            test::random_below(state, 9),
+            float(test::random_below(state, 1000)) / 500.0f,
+            falloffs[test::random_below(state, 3)]
+        };
+        return source;
+    }
+    
+    // Whether field holds what stamping every registered emitter onto an
+    // empty map gives, to within tolerance.
+    bool matches_rebuild(const EmitterField& field, const std::vector<EmitterField::Handle>& handles, const float tolerance)
+    {
+        const float empty = field.blend() == StampMax ? -std::numeric_limits<float>::infinity() : 0.0f;
+        InfluenceMap rebuilt(field.width(), field.height(), false, empty);
+        for (size_t i = 0; i < handles.size(); i++) {
+            const EmitterField::Source& source = field.source(handles[i]);
+            rebuilt.stamp(source.x, source.y, source.radius, source.strength, source.falloff, field.blend());
+        }
+        
+        for (size_t y = 0; y < field.height(); y++) {
+            for (size_t x = 0; x < field.width(); x++) {
+                const float value = field.value(x, y);
+                if (value != rebuilt.influence(x, y) && !(std::fabs(value - rebuilt.influence(x, y)) <= tolerance)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+} // namespace
+
+TEST_CASE( "emitter fields hold what rebuilding from every emitter gives", "[EmitterField]" ) {
+    const size_t width = 70;
+    const size_t height = 45;
+    const StampBlend blends[] = { StampMax, StampAdd };
+    
+    for (size_t b = 0; b < 2; b++) {
+        INFO( "blend " << blends[b] );
+        
+        // Max is exact whatever the order; sums may round differently.
+        const float tolerance = blends[b] == StampMax ? 0.0f : 1e-5f;
+        EmitterField field(width, height, blends[b]);
+        std::vector<EmitterField::Handle> handles;
+        unsigned int state = 11;
+        
+        for (size_t i = 0; i < 60; i++) {
+            handles.push_back(field.add(random_source(state, width, height)));
+        }
+        REQUIRE( field.size() == 60 );
+        REQUIRE( matches_rebuild(field, handles, tolerance) );
+        
+        for (size_t step = 0; step < 300; step++) {
+            const size_t i = test::random_below(state, unsigned(handles.size()));
+            const EmitterField::Source& source = field.source(handles[i]);
+            
+            switch (test::random_below(state, 4)) {
+                case 0:
+                    field.move(handles[i],
+                               std::min(source.x + test::random_below(state, 3), width - 1),
+                               source.y > 0 ? source.y - test::random_below(state, 2) : 0);
+                    break;
+                case 1:
+                    field.set_strength(handles[i], float(test::random_below(state, 1000)) / 500.0f);
+                    break;
+                case 2:
+                    field.update(handles[i], random_source(state, width, height));
+                    break;
+                default:
+                    field.remove(handles[i]);
+                    handles[i] = field.add(random_source(state, width, height));
+                    break;
+            }
+        }
+        REQUIRE( field.size() == 60 );
+        REQUIRE( matches_rebuild(field, handles, tolerance) );
+        
+        for (size_t i = 0; i < handles.size(); i++) {
+            field.remove(handles[i]);
+        }
+        REQUIRE( field.size() == 0 );
+        REQUIRE( matches_rebuild(field, std::vector<EmitterField::Handle>(), 0.0f) );
+    }
+}
+
+TEST_CASE( "emitter fields record the rectangles they change", "[EmitterField]" ) {
+    EmitterField field(40, 40);
+    const EmitterField::Source source = { 2, 20, 3, 1.0f, FalloffLinear };
+    const EmitterField::Handle handle = field.add(source);
+    
+    REQUIRE( field.dirty_rects().size() == 1 );
+    REQUIRE( field.dirty_rects()[0].x_begin == 0 );
+    REQUIRE( field.dirty_rects()[0].x_end == 6 );
+    REQUIRE( field.dirty_rects()[0].y_begin == 17 );
+    REQUIRE( field.dirty_rects()[0].y_end == 24 );
+    
+    field.clear_dirty();
+    field.set_strength(handle, 1.0f);
+    REQUIRE( field.dirty_rects().empty() );
+    
+    field.move(handle, 30, 20);
+    REQUIRE( field.dirty_rects().size() == 2 );
+    REQUIRE( field.dirty_rects()[0].x_end == 6 );
+    REQUIRE( field.dirty_rects()[1].x_begin == 27 );
+    REQUIRE( field.dirty_rects()[1].x_end == 34 );
+    REQUIRE( field.value(2, 20) == -std::numeric_limits<float>::infinity() );
+    REQUIRE( field.value(30, 20) == 1.0f );
+}
+
+TEST_CASE( "maps raised to an emitter field propagate as if sources were set by hand", "[EmitterField]" ) {
+    const size_t width = 150;
+    const size_t height = 100;
+    
+    EmitterField field(width, height);
+    InfluenceMap by_hand(width, height, true, 0.0f);
+    InfluenceMap sparse(width, height, true, 0.0f);
+    sparse.set_sparse_propagation(true);
+    sparse.set_obstacle(40, 40, true);
+    by_hand.set_obstacle(40, 40, true);
+    
+    std::vector<EmitterField::Handle> handles;
+    unsigned int state = 3;
+    for (size_t i = 0; i < 12; i++) {
+        handles.push_back(field.add(random_source(state, width, height)));
+    }
+    
+    for (size_t step = 0; step < 120; step++) {
+        if (step % 7 == 0) {
+            const size_t i = test::random_below(state, unsigned(handles.size()));
+            field.move(handles[i], test::random_below(state, unsigned(width)), test::random_below(state, unsigned(height)));
+        }
+        
+        sparse.apply_emitters(field);
+        field.clear_dirty();
+        for (size_t i = 0; i < handles.size(); i++) {
+            const EmitterField::Source& source = field.source(handles[i]);
+            by_hand.stamp(source.x, source.y, source.radius, source.strength, source.falloff);
+        }
+        
+        sparse.propagate(0.4f, 0.1f);
+        by_hand.propagate(0.4f, 0.1f);
+    }
+    
+    bool same = true;
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            same = same && sparse.influence(x, y) == by_hand.influence(x, y);
+        }
+    }
+    REQUIRE( same );
+    REQUIRE( sparse.influence(40, 40) == 0.0f );
+}
+
+TEST_CASE( "emitters registered on a map are applied as it propagates", "[EmitterField]" ) {
+    const size_t width = 90;
+    const size_t height = 70;
+    const SimdTier initial_tier = active_simd_tier();
+    ThreadPool pool(4);
+    
+    for (int tier = Scalar; tier <= detected_simd_tier(); tier++) {
+        force_simd_tier(SimdTier(tier));
+        
+        for (int variant = 0; variant < 4; variant++) {
+            INFO( simd_tier_name(SimdTier(tier)) << ", variant " << variant );
+            
+            // Unclamped maps start below zero, which floors must leave alone.
+            const bool clamped = variant != 1;
+            InfluenceMap fused(width, height, clamped, clamped ? 0.0f : -0.5f);
+            InfluenceMap applied(width, height, clamped, clamped ? 0.0f : -0.5f);
+            EmitterField field(width, height);
+            
+            fused.set_obstacle(20, 30, true);
+            applied.set_obstacle(20, 30, true);
+            fused.set_terrain(50, 10, 1);
+            applied.set_terrain(50, 10, 1);
+            if (variant == 2) {
+                fused.set_sparse_propagation(true);
+            } else if (variant == 3) {
+                fused.set_thread_pool(&pool);
+            }
+            
+            std::vector<InfluenceMap::EmitterHandle> handles;
+            std::vector<EmitterField::Handle> field_handles;
+            unsigned int state = 21;
+            for (size_t i = 0; i < 10; i++) {
+                const EmitterField::Source source = random_source(state, width, height);
+                handles.push_back(fused.add_emitter(source));
+                field_handles.push_back(field.add(source));
+            }
+            REQUIRE( fused.num_emitters() == 10 );
+            
+            for (size_t step = 0; step < 60; step++) {
+                if (step % 5 == 0) {
+                    // Emitter 0 is removed half way through.
+                    const size_t i = 1 + test::random_below(state, unsigned(handles.size() - 1));
+                    const size_t x = test::random_below(state, unsigned(width));
+                    const size_t y = test::random_below(state, unsigned(height));
+                    fused.move_emitter(handles[i], x, y);
+                    field.move(field_handles[i], x, y);
+                }
+                if (step == 30) {
+                    fused.remove_emitter(handles[0]);
+                    field.remove(field_handles[0]);
+                    fused.set_emitter_strength(handles[1], 0.25f);
+                    field.set_strength(field_handles[1], 0.25f);
+                }
+                
+                if (step % 10 == 9) {
+                    fused.propagate_steps(3, 0.4f, 0.1f);
+                    for (size_t s = 0; s < 3; s++) {
+                        applied.propagate(0.4f, 0.1f);
+                        applied.apply_emitters(field);
+                    }
+                } else {
+                    fused.propagate(0.4f, 0.1f);
+                    applied.propagate(0.4f, 0.1f);
+                    applied.apply_emitters(field);
+                }
+                field.clear_dirty();
+            }
+            
+            bool same = true;
+            for (size_t y = 0; y < height; y++) {
+                for (size_t x = 0; x < width; x++) {
+                    same = same && fused.influence(x, y) == applied.influence(x, y);
+                }
+            }
+            REQUIRE( same );
+            REQUIRE( fused.num_emitters() == 9 );
+            REQUIRE( fused.emitter(handles[1]).strength == 0.25f );
+            REQUIRE( fused.influence(20, 30) == 0.0f );
+        }
+    }
+    
+    force_simd_tier(initial_tier);
+}
+
+TEST_CASE( "moving an emitter wakes the tiles sparse propagation let settle", "[EmitterField]" ) {
+    InfluenceMap dense(200, 200, true, 0.0f);
+    InfluenceMap sparse(200, 200, true, 0.0f);
+    sparse.set_sparse_propagation(true);
+    
+    const InfluenceMap::StampSource source = { 10, 10, 2, 1.0f, FalloffLinear };
+    const InfluenceMap::EmitterHandle dense_handle = dense.add_emitter(source);
+    const InfluenceMap::EmitterHandle sparse_handle = sparse.add_emitter(source);
+    
+    for (size_t step = 0; step < 400; step++) {
+        dense.propagate(0.5f, 2.0f);
+        sparse.propagate(0.5f, 2.0f);
+    }
+    REQUIRE( sparse.num_active_tiles() < sparse.num_tiles() / 4 );
+    
+    dense.move_emitter(dense_handle, 180, 150);
+    sparse.move_emitter(sparse_handle, 180, 150);
+    for (size_t step = 0; step < 5; step++) {
+        dense.propagate(0.5f, 2.0f);
+        sparse.propagate(0.5f, 2.0f);
+    }
+    
+    REQUIRE( sparse.influence(180, 150) == 1.0f );
+    bool same = true;
+    for (size_t y = 0; y < 200; y++) {
+        for (size_t x = 0; x < 200; x++) {
+            same = same && sparse.influence(x, y) == dense.influence(x, y);
+        }
+    }
+    REQUIRE( same );
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+// Helpers shared by the tests. Everything random comes from one small
+// generator, so failures reproduce on every platform.
+
+namespace influence_map {
+namespace test {
+    
+    /**
+     * Steps state on to the next value of the generator and returns it.
+     */
+    inline unsigned int next_random(unsigned int& state)
+    {
+        state = state * 1664525u + 1013904223u;
+        return state;
+    }
+    
+    /**
+     * The next random value in 0..range-1.
+     */
+    inline unsigned int random_below(unsigned int& state, const unsigned int range)
+    {
+        return (next_random(state) >> 8) % range;
+    }
+    
+    /**
+     * The next random value in [0, 1).
+     */
+    inline float noise(unsigned int& state)
+    {
+        return float(next_random(state) >> 8) / float(1 << 24);
+    }
+    
+    template <typename Value>
+    bool same_bits(const Value a, const Value b)
+    {
+        return memcmp(&a, &b, sizeof(Value)) == 0;
+    }
+    
+    /**
+     * Whether two maps, or forks, of the same size hold the same influence bit
+     * for bit in every cell.
+     */
+    template <typename Map, typename Other>
+    bool same_cells(const Map& map, const Other& other)
+    {
+        for (size_t y = 0; y < map.height(); y++) {
+            for (size_t x = 0; x < map.width(); x++) {
+                if (!same_bits(map.influence(x, y), other.influence(x, y))) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    
+    /**
+     * Sets every cell of map to noise() * scale + offset, starting the
+     * generator from state.
+     */
+    template <typename Map>
+    void seed(Map& map, unsigned int state, const float scale = 1.0f, const float offset = 0.0f)
+    {
+        for (size_t y = 0; y < map.height(); y++) {
+            for (size_t x = 0; x < map.width(); x++) {
+                map.set_influence(x, y, noise(state) * scale + offset);
+            }
+        }
+    }
+
+} // namespace test
+} // namespace influence_map
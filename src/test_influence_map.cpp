@@ -1,7 +1,14 @@
 #include "catch.hpp"
 #include "influence_map.h"
+#include "simd_dispatch.h"
+#include "test_helpers.h"
+#include "thread_pool.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <thread>
+#include <vector>
 #define CLOSE_ENOUGH(a, b, tolerance) fabs((a) - (b)) <= (tolerance)
 
 using namespace influence_map;
@@ -135,7 +142,7 @@ TEST_CASE( "clamped influence can be set and read", "[InfluenceMap]" ) {
             REQUIRE( cell_value == 0.0f );
         }
     }
-
+    
     SECTION( "all influence within bounds" ) {
         // Top row
         map.set_influence(0, 0, 0.1f);
@@ -350,7 +357,7 @@ TEST_CASE( "connecting influences can be added", "[InfluenceMap]" ) {
     map.set_influence(0, 2, 0.7f);
     map.set_influence(1, 2, 0.8f);
     map.set_influence(2, 2, 0.9f);
-
+    
     float connections[InfluenceMap::CONNECTIONS_ARRAY_LENGTH] = {1, 1, 1, 1, 1, 1, 1, 1};
     
     SECTION( "unweighted" ) {
@@ -489,3 +496,1468 @@ TEST_CASE( "clamped propagation", "[InfluenceMap]" ) {
     }
 }
 
+
+namespace {
+    
+    // Straight port of the original cell-at-a-time propagate, kept as the
+    // reference the optimised kernels must match bit for bit. Border decides
+    // what lies beyond the edge, as it does for the map.
+    template <typename Border>
+    void reference_propagate_bordered(std::vector<float>& cells,
+                                      const size_t width,
+                                      const size_t height,
+                                      const bool clamped,
+                                      const float lowest,
+                                      const float highest,
+                                      const float momentum,
+                                      const float decay)
+    {
+        const float edge = expf(-1.0f * decay);
+        const float corner = expf(-1.414f * decay);
+        std::vector<float> result(cells.size());
+        
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                float max_influence = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        if (dx == 0 && dy == 0) continue;
+                        ptrdiff_t nx = ptrdiff_t(x) + dx;
+                        ptrdiff_t ny = ptrdiff_t(y) + dy;
+                        float neighbour = Border::template value<float>();
+                        if (Border::resolve(nx, width) && Border::resolve(ny, height)) {
+                            neighbour = cells[ny * width + nx];
+                        }
+                        neighbour *= (dx == 0 || dy == 0) ? edge : corner;
+                        if (neighbour > max_influence) max_influence = neighbour;
+                    }
+                }
+                
+                const float cur_influence = cells[y * width + x];
+                float value = (max_influence - cur_influence) * momentum + cur_influence;
+                if (clamped && !(value >= lowest && value <= highest)) {
+                    value = value > highest ? highest : lowest;
+                }
+                result[y * width + x] = value;
+            }
+        }
+        
+        cells.swap(result);
+    }
+    
+    void reference_propagate(std::vector<float>& cells,
+                             const size_t width,
+                             const size_t height,
+                             const bool clamped,
+                             const float momentum,
+                             const float decay)
+    {
+        reference_propagate_bordered<ZeroBorder>(cells, width, height, clamped, 0.0f, 1.0f, momentum, decay);
+    }
+    
+    void seed_map(InfluenceMap& map, std::vector<float>& cells, unsigned int state, const float scale)
+    {
+        cells.resize(map.num_cells());
+        for (size_t y = 0; y < map.height(); y++) {
+            for (size_t x = 0; x < map.width(); x++) {
+                const float value = (test::noise(state) * 2.0f - 0.5f) * scale;
+                map.set_influence(x, y, value);
+                cells[y * map.width() + x] = map.influence(x, y);
+            }
+        }
+    }
+    
+    bool matches_reference(const InfluenceMap& map, const std::vector<float>& cells)
+    {
+        for (size_t y = 0; y < map.height(); y++) {
+            for (size_t x = 0; x < map.width(); x++) {
+                if (!test::same_bits(cells[y * map.width() + x], map.influence(x, y))) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    
+    // Runs a map of Cell alongside a float map through the same steps and
+    // returns the largest difference between them.
+    template <typename Cell>
+    float drift_from_float(const bool clamped, const float scale)
+    {
+        const size_t width = 45;
+        const size_t height = 38;
+        
+        InfluenceMap expected(width, height, clamped, 0.0f);
+        BasicInfluenceMap<Cell> actual(width, height, clamped, 0.0f);
+        unsigned int state = 5;
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                actual.set_influence(x, y, typename BasicInfluenceMap<Cell>::Value((test::noise(state) * 2.0f - 0.5f) * scale));
+                expected.set_influence(x, y, float(actual.influence(x, y)));
+            }
+        }
+        
+        for (int step = 0; step < 5; step++) {
+            expected.propagate(0.6f, 0.3f);
+            actual.propagate(0.6f, 0.3f);
+        }
+        
+        float drift = 0;
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                drift = std::max(drift, float(fabs(expected.influence(x, y) - actual.influence(x, y))));
+            }
+        }
+        return drift;
+    }
+
+} // namespace
+
+TEST_CASE( "propagation is bit identical to the reference kernel", "[InfluenceMap]" ) {
+    const size_t sizes[][2] = { {1, 1}, {2, 2}, {1, 7}, {7, 1}, {3, 3}, {4, 9}, {37, 23}, {64, 64} };
+    const SimdTier initial_tier = active_simd_tier();
+    
+    for (int tier = Scalar; tier <= detected_simd_tier(); tier++) {
+        force_simd_tier(SimdTier(tier));
+        
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            const size_t width = sizes[s][0];
+            const size_t height = sizes[s][1];
+            
+            for (int clamped = 0; clamped < 2; clamped++) {
+                InfluenceMap map(width, height, clamped != 0, 0.0f);
+                std::vector<float> cells;
+                seed_map(map, cells, unsigned(width * 31 + height), clamped ? 1.0f : 100.0f);
+                
+                for (int step = 0; step < 6; step++) {
+                    const float momentum = 0.2f + 0.15f * step;
+                    const float decay = 0.1f * step;
+                    map.propagate(momentum, decay);
+                    reference_propagate(cells, width, height, clamped != 0, momentum, decay);
+                    
+                    INFO( simd_tier_name(SimdTier(tier)) << ", size " << width << "x" << height << ", clamped " << clamped << ", step " << step );
+                    REQUIRE( matches_reference(map, cells) );
+                }
+            }
+        }
+    }
+    
+    force_simd_tier(initial_tier);
+}
+
+TEST_CASE( "maps can be filled and their peak read", "[InfluenceMap]" ) {
+    InfluenceMap map(37, 5, true, 0.25f);
+    
+    REQUIRE( map.peak_influence() == 0.25f );
+    
+    map.set_influence(36, 4, 0.75f);
+    REQUIRE( map.peak_influence() == 0.75f );
+    
+    map.fill(2.0f);
+    REQUIRE( map.influence(0, 0) == 1.0f );
+    REQUIRE( map.influence(36, 4) == 1.0f );
+    REQUIRE( map.peak_influence() == 1.0f );
+    
+    map.fill(-1.0f);
+    REQUIRE( map.peak_influence() == 0.0f );
+}
+
+TEST_CASE( "threaded propagation matches single threaded propagation", "[InfluenceMap]" ) {
+    const size_t width = 53;
+    const size_t height = 211;
+    
+    InfluenceMap single(width, height, false, 0.0f);
+    std::vector<float> cells;
+    seed_map(single, cells, 99, 50.0f);
+    
+    for (size_t steps = 0; steps < 4; steps++) {
+        single.propagate(0.6f, 0.2f);
+    }
+    
+    const size_t thread_counts[] = { 2, 3, 5 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        ThreadPool pool(thread_counts[t]);
+        InfluenceMap threaded(width, height, false, 0.0f);
+        seed_map(threaded, cells, 99, 50.0f);
+        threaded.set_thread_pool(&pool);
+        REQUIRE( threaded.thread_pool() == &pool );
+        
+        for (size_t steps = 0; steps < 4; steps++) {
+            threaded.propagate(0.6f, 0.2f);
+        }
+        
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                cells[y * width + x] = single.influence(x, y);
+            }
+        }
+        
+        INFO( thread_counts[t] << " threads" );
+        REQUIRE( matches_reference(threaded, cells) );
+    }
+}
+
+TEST_CASE( "propagating several steps at once matches stepping one at a time", "[InfluenceMap]" ) {
+    // Wide enough that 16 steps need several column blocks.
+    const size_t sizes[][2] = { {1, 1}, {5, 3}, {3, 40}, {61, 29}, {4500, 6} };
+    const size_t step_counts[] = { 0, 1, 2, 3, 7, 16, 19 };
+    
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const size_t width = sizes[s][0];
+        const size_t height = sizes[s][1];
+        
+        for (size_t c = 0; c < sizeof(step_counts) / sizeof(step_counts[0]); c++) {
+            const size_t steps = step_counts[c];
+            
+            InfluenceMap stepped(width, height, true, 0.0f);
+            InfluenceMap blocked(width, height, true, 0.0f);
+            std::vector<float> cells;
+            seed_map(stepped, cells, unsigned(width + steps), 1.0f);
+            seed_map(blocked, cells, unsigned(width + steps), 1.0f);
+            
+            for (size_t i = 0; i < steps; i++) {
+                stepped.propagate(0.8f, 0.05f);
+            }
+            blocked.propagate_steps(steps, 0.8f, 0.05f);
+            
+            for (size_t y = 0; y < height; y++) {
+                for (size_t x = 0; x < width; x++) {
+                    cells[y * width + x] = stepped.influence(x, y);
+                }
+            }
+            
+            INFO( width << "x" << height << " for " << steps << " steps" );
+            REQUIRE( matches_reference(blocked, cells) );
+        }
+    }
+}
+
+TEST_CASE( "blocked propagation can use a thread pool", "[InfluenceMap]" ) {
+    const size_t width = 3000;
+    const size_t height = 9;
+    ThreadPool pool(3);
+    
+    InfluenceMap stepped(width, height, false, 0.0f);
+    InfluenceMap blocked(width, height, false, 0.0f);
+    std::vector<float> cells;
+    seed_map(stepped, cells, 5, 10.0f);
+    seed_map(blocked, cells, 5, 10.0f);
+    blocked.set_thread_pool(&pool);
+    
+    for (size_t i = 0; i < 12; i++) {
+        stepped.propagate(0.5f, 0.3f);
+    }
+    blocked.propagate_steps(12, 0.5f, 0.3f);
+    
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            cells[y * width + x] = stepped.influence(x, y);
+        }
+    }
+    REQUIRE( matches_reference(blocked, cells) );
+}
+
+TEST_CASE( "steady state can be solved directly", "[InfluenceMap]" ) {
+    const float decay = 0.3f;
+    const float edge = expf(-1.0f * decay);
+    const float corner = expf(-1.414f * decay);
+    const float tolerance = 0.00001f;
+    
+    SECTION( "single source" ) {
+        InfluenceMap map(6, 5, false, 0.0f);
+        map.set_influence(1, 1, 10.0f);
+        map.solve_steady_state(decay);
+        
+        REQUIRE( map.influence(1, 1) == 10.0f );
+        REQUIRE( CLOSE_ENOUGH(map.influence(4, 1), 10.0f * edge * edge * edge, tolerance) );
+        REQUIRE( CLOSE_ENOUGH(map.influence(0, 0), 10.0f * corner, tolerance) );
+        REQUIRE( CLOSE_ENOUGH(map.influence(3, 3), 10.0f * corner * corner, tolerance) );
+        REQUIRE( CLOSE_ENOUGH(map.influence(5, 4), 10.0f * corner * corner * corner * edge, tolerance) );
+    }
+    
+    SECTION( "matches iterating propagate with fixed sources" ) {
+        const size_t width = 41;
+        const size_t height = 27;
+        
+        InfluenceMap solved(width, height, true, 0.0f);
+        InfluenceMap iterated(width, height, true, 0.0f);
+        std::vector<float> sources(width * height, 0.0f);
+        unsigned int state = 7;
+        for (size_t i = 0; i < 12; i++) {
+            const size_t x = size_t(test::noise(state) * width);
+            const size_t y = size_t(test::noise(state) * height);
+            sources[y * width + x] = test::noise(state);
+            solved.set_influence(x, y, sources[y * width + x]);
+        }
+        
+        solved.solve_steady_state(decay);
+        
+        for (size_t step = 0; step < width + height; step++) {
+            iterated.propagate(1.0f, decay);
+            for (size_t y = 0; y < height; y++) {
+                for (size_t x = 0; x < width; x++) {
+                    if (sources[y * width + x] > iterated.influence(x, y)) {
+                        iterated.set_influence(x, y, sources[y * width + x]);
+                    }
+                }
+            }
+        }
+        
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                REQUIRE( CLOSE_ENOUGH(solved.influence(x, y), iterated.influence(x, y), tolerance) );
+            }
+        }
+    }
+}
+
+TEST_CASE( "propagation can report how much the map changed", "[InfluenceMap]" ) {
+    const size_t width = 53;
+    const size_t height = 40;
+    ThreadPool pool(3);
+    
+    for (int threaded = 0; threaded < 2; threaded++) {
+        InfluenceMap map(width, height, false, 0.0f);
+        std::vector<float> cells;
+        seed_map(map, cells, 99, 10.0f);
+        if (threaded) {
+            map.set_thread_pool(&pool);
+        }
+        
+        for (int step = 0; step < 4; step++) {
+            std::vector<float> before(cells);
+            const float residual = map.propagate_with_residual(0.6f, 0.2f);
+            reference_propagate(cells, width, height, false, 0.6f, 0.2f);
+            
+            float expected = 0;
+            for (size_t i = 0; i < cells.size(); i++) {
+                expected = std::max(expected, fabsf(cells[i] - before[i]));
+            }
+            
+            INFO( "threaded " << threaded << ", step " << step );
+            REQUIRE( matches_reference(map, cells) );
+            REQUIRE( residual == expected );
+        }
+    }
+}
+
+TEST_CASE( "propagation can run until the map is stable", "[InfluenceMap]" ) {
+    InfluenceMap map(30, 20, true, 0.0f);
+    map.set_influence(3, 4, 1.0f);
+    
+    SECTION( "stops once no cell changes by more than epsilon" ) {
+        const InfluenceMap::Convergence result = map.propagate_until_stable(0.5f, 0.3f, 0.0001f, 10000);
+        
+        REQUIRE( result.iterations > 1 );
+        REQUIRE( result.iterations < 10000 );
+        REQUIRE( result.residual <= 0.0001f );
+        REQUIRE( map.propagate_with_residual(0.5f, 0.3f) <= 0.0001f );
+    }
+    
+    SECTION( "stops after max_iterations" ) {
+        const InfluenceMap::Convergence result = map.propagate_until_stable(0.5f, 0.3f, 0.0f, 3);
+        
+        REQUIRE( result.iterations == 3 );
+        REQUIRE( result.residual > 0.0f );
+    }
+}
+
+TEST_CASE( "sparse propagation matches dense propagation", "[InfluenceMap]" ) {
+    const size_t width = 7 * InfluenceMap::TILE_SIZE + 5;
+    const size_t height = 5 * InfluenceMap::TILE_SIZE + 3;
+    ThreadPool pool(3);
+    
+    for (int threaded = 0; threaded < 2; threaded++) {
+        for (int clamped = 0; clamped < 2; clamped++) {
+            InfluenceMap dense(width, height, clamped != 0, 0.0f);
+            InfluenceMap sparse(width, height, clamped != 0, 0.0f);
+            sparse.set_sparse_propagation(true);
+            if (threaded) {
+                dense.set_thread_pool(&pool);
+                sparse.set_thread_pool(&pool);
+            }
+            
+            // A unit walking across the map, with decay changing part way.
+            for (size_t step = 0; step < 120; step++) {
+                const size_t x = 3 + step * 3 / 2;
+                const size_t y = 40 + step / 3;
+                dense.set_influence(x, y, 1.0f);
+                sparse.set_influence(x, y, 1.0f);
+                
+                const float decay = step < 80 ? 0.4f : 0.6f;
+                dense.propagate(0.5f, decay);
+                const float residual = sparse.propagate_with_residual(0.5f, decay);
+                
+                INFO( "threaded " << threaded << ", clamped " << clamped << ", step " << step );
+                REQUIRE( residual >= 0.0f );
+                REQUIRE( test::same_cells(dense, sparse) );
+            }
+        }
+    }
+}
+
+TEST_CASE( "sparse propagation only recomputes the active area", "[InfluenceMap]" ) {
+    InfluenceMap map(16 * InfluenceMap::TILE_SIZE, 16 * InfluenceMap::TILE_SIZE, true, 0.0f);
+    map.set_sparse_propagation(true);
+    
+    map.propagate(0.5f, 0.4f);
+    REQUIRE( map.num_active_tiles() == map.num_tiles() );
+    
+    map.propagate(0.5f, 0.4f);
+    REQUIRE( map.num_active_tiles() == 0 );
+    
+    map.set_influence(5 * InfluenceMap::TILE_SIZE + 3, 7 * InfluenceMap::TILE_SIZE + 3, 1.0f);
+    map.propagate(0.5f, 0.4f);
+    REQUIRE( map.num_active_tiles() == 9 );
+    
+    SECTION( "fill makes every tile active" ) {
+        map.fill(0.0f);
+        map.propagate(0.5f, 0.4f);
+        REQUIRE( map.num_active_tiles() == map.num_tiles() );
+    }
+    
+    SECTION( "changing parameters makes every tile active" ) {
+        map.propagate(0.5f, 0.3f);
+        REQUIRE( map.num_active_tiles() == map.num_tiles() );
+    }
+}
+
+TEST_CASE( "sparse propagation treats a change of sign in zero as a change", "[InfluenceMap]" ) {
+    const size_t x = 5 * InfluenceMap::TILE_SIZE + 3;
+    const size_t y = 7 * InfluenceMap::TILE_SIZE + 3;
+    InfluenceMap map(16 * InfluenceMap::TILE_SIZE, 16 * InfluenceMap::TILE_SIZE, false, 0.0f);
+    map.set_sparse_propagation(true);
+    map.propagate(0.5f, 0.4f);
+    map.propagate(0.5f, 0.4f);
+    REQUIRE( map.num_active_tiles() == 0 );
+    
+    // -0 steps to +0 with a residual of zero, but the cell still changed.
+    map.set_influence(x, y, -0.0f);
+    REQUIRE( map.propagate_with_residual(0.5f, 0.4f) == 0.0f );
+    REQUIRE( map.num_active_tiles() == 9 );
+    REQUIRE_FALSE( std::signbit(map.influence(x, y)) );
+    
+    map.propagate(0.5f, 0.4f);
+    REQUIRE( map.num_active_tiles() == 9 );
+    
+    map.propagate(0.5f, 0.4f);
+    REQUIRE( map.num_active_tiles() == 0 );
+}
+
+TEST_CASE( "maps can store other cell types", "[InfluenceMap]" ) {
+    SECTION( "double" ) {
+        REQUIRE( drift_from_float<double>(false, 100.0f) < 0.0001f );
+        REQUIRE( drift_from_float<double>(true, 1.0f) < 0.000001f );
+    }
+    
+    SECTION( "half" ) {
+        REQUIRE( drift_from_float<Half>(false, 100.0f) < 0.5f );
+        REQUIRE( drift_from_float<Half>(true, 1.0f) < 0.005f );
+    }
+    
+    SECTION( "normalized fixed point" ) {
+        REQUIRE( drift_from_float<uint8_t>(true, 1.0f) < 5.0f / 255.0f );
+        REQUIRE( drift_from_float<uint16_t>(true, 1.0f) < 5.0f / 65535.0f );
+    }
+}
+
+TEST_CASE( "fixed point maps always clamp to 0..1", "[InfluenceMap]" ) {
+    UInt8InfluenceMap map(4, 3, false, 2.0f);
+    
+    REQUIRE( map.influence(1, 1) == 1.0f );
+    REQUIRE( map.peak_influence() == 1.0f );
+    
+    map.set_influence(2, 1, -1.0f);
+    REQUIRE( map.influence(2, 1) == 0.0f );
+    
+    map.set_influence(3, 2, 0.5f);
+    REQUIRE( map.influence(3, 2) == 128.0f / 255.0f );
+}
+
+TEST_CASE( "other cell types propagate several steps at once exactly", "[InfluenceMap]" ) {
+    UInt8InfluenceMap stepped(300, 20, true, 0.0f);
+    UInt8InfluenceMap blocked(300, 20, true, 0.0f);
+    HalfInfluenceMap sparse(300, 70, false, 0.0f);
+    HalfInfluenceMap dense(300, 70, false, 0.0f);
+    sparse.set_sparse_propagation(true);
+    
+    for (size_t i = 0; i < 4; i++) {
+        stepped.set_influence(70 * i + 3, 5 + 3 * i, 1.0f);
+        blocked.set_influence(70 * i + 3, 5 + 3 * i, 1.0f);
+        sparse.set_influence(70 * i + 3, 5 + 12 * i, 8.0f);
+        dense.set_influence(70 * i + 3, 5 + 12 * i, 8.0f);
+    }
+    
+    for (int step = 0; step < 12; step++) {
+        stepped.propagate(0.7f, 0.2f);
+        sparse.propagate(0.7f, 0.2f);
+        dense.propagate(0.7f, 0.2f);
+    }
+    blocked.propagate_steps(12, 0.7f, 0.2f);
+    
+    bool same = true;
+    for (size_t y = 0; y < stepped.height(); y++) {
+        for (size_t x = 0; x < stepped.width(); x++) {
+            same = same && stepped.influence(x, y) == blocked.influence(x, y);
+        }
+    }
+    for (size_t y = 0; y < dense.height(); y++) {
+        for (size_t x = 0; x < dense.width(); x++) {
+            same = same && dense.influence(x, y) == sparse.influence(x, y);
+        }
+    }
+    REQUIRE( same );
+    REQUIRE( stepped.influence(5, 5) > 0.0f );
+}
+
+TEST_CASE( "clamp policies fix the clamping at compile time", "[InfluenceMap]" ) {
+    BasicInfluenceMap<float, NoClamp> unclamped(3, 3, true, 0.0f);
+    BasicInfluenceMap<float, Clamp01> clamped(3, 3, 0.0f);
+    BasicInfluenceMap<float, ClampRange<-1, 1, 2> > ranged(3, 3, 0.0f);
+    
+    unclamped.set_influence(1, 1, 5.0f);
+    clamped.set_influence(1, 1, 5.0f);
+    ranged.set_influence(1, 1, 5.0f);
+    ranged.set_influence(0, 0, -5.0f);
+    
+    REQUIRE( unclamped.influence(1, 1) == 5.0f );
+    REQUIRE( clamped.influence(1, 1) == 1.0f );
+    REQUIRE( ranged.influence(1, 1) == 0.5f );
+    REQUIRE( ranged.influence(0, 0) == -0.5f );
+    
+    unclamped.propagate(1.0f, 0.0f);
+    clamped.propagate(1.0f, 0.0f);
+    ranged.propagate(1.0f, 0.0f);
+    
+    REQUIRE( unclamped.influence(2, 2) == 5.0f );
+    REQUIRE( clamped.influence(2, 2) == 1.0f );
+    REQUIRE( ranged.influence(2, 2) == 0.5f );
+}
+
+TEST_CASE( "border policies decide what lies beyond the edge", "[InfluenceMap]" ) {
+    typedef BasicInfluenceMap<float, NoClamp, ConstantBorder<1, 2> > ConstantMap;
+    typedef BasicInfluenceMap<float, NoClamp, ClampToEdgeBorder> EdgeMap;
+    
+    float connections[8];
+    
+    SECTION( "constant borders read as their value" ) {
+        ConstantMap map(3, 3, 0.25f);
+        map.connections(0, 1, connections, 2.0f);
+        
+        REQUIRE( connections[ConstantMap::TopLeft] == 1.0f );
+        REQUIRE( connections[ConstantMap::MiddleLeft] == 1.0f );
+        REQUIRE( connections[ConstantMap::BottomLeft] == 1.0f );
+        REQUIRE( connections[ConstantMap::TopMiddle] == 0.5f );
+        REQUIRE( connections[ConstantMap::MiddleRight] == 0.5f );
+    }
+    
+    SECTION( "clamp to edge borders repeat the edge" ) {
+        EdgeMap map(3, 3, 0.0f);
+        map.set_influence(0, 0, 0.75f);
+        map.set_influence(1, 0, 0.5f);
+        map.connections(0, 0, connections, 1.0f);
+        
+        REQUIRE( connections[EdgeMap::TopLeft] == 0.75f );
+        REQUIRE( connections[EdgeMap::TopMiddle] == 0.75f );
+        REQUIRE( connections[EdgeMap::TopRight] == 0.5f );
+        REQUIRE( connections[EdgeMap::MiddleLeft] == 0.75f );
+        REQUIRE( connections[EdgeMap::BottomLeft] == 0.0f );
+        
+        std::fill(connections, connections + 8, 1.0f);
+        map.add_connections(0, 0, connections, 1.0f);
+        
+        REQUIRE( connections[EdgeMap::TopLeft] == 1.75f );
+        REQUIRE( connections[EdgeMap::TopRight] == 1.5f );
+        REQUIRE( connections[EdgeMap::BottomRight] == 1.0f );
+    }
+    
+    SECTION( "propagation matches the reference kernel" ) {
+        const SimdTier initial_tier = active_simd_tier();
+        
+        for (int tier = Scalar; tier <= detected_simd_tier(); tier++) {
+            force_simd_tier(SimdTier(tier));
+            
+            ConstantMap constant(37, 23, 0.0f);
+            BasicInfluenceMap<float, ClampRange<-1, 1>, ClampToEdgeBorder> edge(37, 23, 0.0f);
+            std::vector<float> constant_cells(constant.num_cells());
+            std::vector<float> edge_cells(edge.num_cells());
+            
+            unsigned int state = 17;
+            for (size_t y = 0; y < 23; y++) {
+                for (size_t x = 0; x < 37; x++) {
+                    const float value = test::noise(state) * 3.0f - 1.5f;
+                    constant.set_influence(x, y, value);
+                    edge.set_influence(x, y, value);
+                    constant_cells[y * 37 + x] = constant.influence(x, y);
+                    edge_cells[y * 37 + x] = edge.influence(x, y);
+                }
+            }
+            
+            bool same = true;
+            for (int step = 0; step < 6; step++) {
+                constant.propagate(0.6f, 0.1f * step);
+                edge.propagate(0.6f, 0.1f * step);
+                reference_propagate_bordered<ConstantBorder<1, 2> >(constant_cells, 37, 23, false, 0.0f, 0.0f, 0.6f, 0.1f * step);
+                reference_propagate_bordered<ClampToEdgeBorder>(edge_cells, 37, 23, true, -1.0f, 1.0f, 0.6f, 0.1f * step);
+                
+                for (size_t i = 0; i < constant.num_cells(); i++) {
+                    const size_t x = i % 37;
+                    const size_t y = i / 37;
+                    same = same && constant.influence(x, y) == constant_cells[i] && edge.influence(x, y) == edge_cells[i];
+                }
+            }
+            
+            INFO( simd_tier_name(SimdTier(tier)) );
+            REQUIRE( same );
+        }
+        
+        force_simd_tier(initial_tier);
+    }
+    
+    SECTION( "several steps at once and sparse steps match stepping" ) {
+        ConstantMap stepped(300, 40, 0.0f);
+        ConstantMap blocked(300, 40, 0.0f);
+        EdgeMap edge_stepped(300, 70, 0.0f);
+        EdgeMap edge_sparse(300, 70, 0.0f);
+        edge_sparse.set_sparse_propagation(true);
+        
+        stepped.set_influence(150, 20, 1.0f);
+        blocked.set_influence(150, 20, 1.0f);
+        edge_stepped.set_influence(1, 1, 1.0f);
+        edge_sparse.set_influence(1, 1, 1.0f);
+        
+        for (int step = 0; step < 12; step++) {
+            stepped.propagate(0.7f, 0.2f);
+            edge_stepped.propagate(0.7f, 0.2f);
+            edge_sparse.propagate(0.7f, 0.2f);
+        }
+        blocked.propagate_steps(12, 0.7f, 0.2f);
+        
+        bool same = true;
+        for (size_t y = 0; y < stepped.height(); y++) {
+            for (size_t x = 0; x < stepped.width(); x++) {
+                same = same && stepped.influence(x, y) == blocked.influence(x, y);
+            }
+        }
+        for (size_t y = 0; y < edge_stepped.height(); y++) {
+            for (size_t x = 0; x < edge_stepped.width(); x++) {
+                same = same && edge_stepped.influence(x, y) == edge_sparse.influence(x, y);
+            }
+        }
+        REQUIRE( same );
+        REQUIRE( stepped.influence(0, 0) > 0.0f );
+    }
+    
+    SECTION( "a constant border is a source to the steady state" ) {
+        ConstantMap solved(20, 10, 0.0f);
+        ConstantMap stepped(20, 10, 0.0f);
+        
+        solved.solve_steady_state(0.3f);
+        stepped.propagate_until_stable(1.0f, 0.3f, 0.0f, 100);
+        
+        bool close = true;
+        for (size_t y = 0; y < solved.height(); y++) {
+            for (size_t x = 0; x < solved.width(); x++) {
+                close = close && CLOSE_ENOUGH(solved.influence(x, y), stepped.influence(x, y), 1e-5f);
+            }
+        }
+        REQUIRE( close );
+        REQUIRE( solved.influence(0, 5) == 0.5f * expf(-0.3f) );
+    }
+}
+
+TEST_CASE( "wrapping maps are toroidal", "[InfluenceMap]" ) {
+    float connections[8];
+    
+    SECTION( "connections wrap to the opposite edge" ) {
+        ToroidalInfluenceMap map(5, 4, false, 0.0f);
+        map.set_influence(4, 3, 0.25f);
+        map.set_influence(0, 3, 0.5f);
+        map.set_influence(4, 0, 0.75f);
+        
+        map.connections(0, 0, connections, 1.0f, 9.0f);
+        
+        REQUIRE( connections[ToroidalInfluenceMap::TopLeft] == 0.25f );
+        REQUIRE( connections[ToroidalInfluenceMap::TopMiddle] == 0.5f );
+        REQUIRE( connections[ToroidalInfluenceMap::MiddleLeft] == 0.75f );
+        REQUIRE( connections[ToroidalInfluenceMap::BottomRight] == 0.0f );
+        
+        std::fill(connections, connections + 8, 1.0f);
+        map.add_connections(0, 0, connections, 2.0f);
+        
+        REQUIRE( connections[ToroidalInfluenceMap::TopLeft] == 1.5f );
+        REQUIRE( connections[ToroidalInfluenceMap::MiddleLeft] == 2.5f );
+        REQUIRE( connections[ToroidalInfluenceMap::MiddleRight] == 1.0f );
+    }
+    
+    SECTION( "propagation matches the reference kernel" ) {
+        const size_t sizes[][2] = { {1, 1}, {2, 3}, {7, 1}, {37, 23}, {64, 5} };
+        const SimdTier initial_tier = active_simd_tier();
+        
+        for (int tier = Scalar; tier <= detected_simd_tier(); tier++) {
+            force_simd_tier(SimdTier(tier));
+            
+            for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                const size_t width = sizes[s][0];
+                const size_t height = sizes[s][1];
+                ToroidalInfluenceMap map(width, height, false, 0.0f);
+                std::vector<float> cells(map.num_cells());
+                
+                unsigned int state = unsigned(width * 7 + height);
+                for (size_t y = 0; y < height; y++) {
+                    for (size_t x = 0; x < width; x++) {
+                        map.set_influence(x, y, test::noise(state) * 2.0f - 0.5f);
+                        cells[y * width + x] = map.influence(x, y);
+                    }
+                }
+                
+                bool same = true;
+                for (int step = 0; step < 6; step++) {
+                    map.propagate(0.6f, 0.1f * step);
+                    reference_propagate_bordered<WrapBorder>(cells, width, height, false, 0.0f, 0.0f, 0.6f, 0.1f * step);
+                    
+                    for (size_t i = 0; i < map.num_cells(); i++) {
+                        same = same && map.influence(i % width, i / width) == cells[i];
+                    }
+                }
+                
+                INFO( simd_tier_name(SimdTier(tier)) << ", size " << width << "x" << height );
+                REQUIRE( same );
+            }
+        }
+        
+        force_simd_tier(initial_tier);
+    }
+    
+    SECTION( "sparse propagation wraps between tiles on opposite edges" ) {
+        ToroidalInfluenceMap dense(300, 70, false, 0.0f);
+        ToroidalInfluenceMap sparse(300, 70, false, 0.0f);
+        sparse.set_sparse_propagation(true);
+        
+        for (int step = 0; step < 20; step++) {
+            dense.set_influence(0, 0, 1.0f);
+            sparse.set_influence(0, 0, 1.0f);
+            dense.propagate(0.7f, 0.2f);
+            sparse.propagate(0.7f, 0.2f);
+        }
+        
+        bool same = true;
+        for (size_t y = 0; y < dense.height(); y++) {
+            for (size_t x = 0; x < dense.width(); x++) {
+                same = same && dense.influence(x, y) == sparse.influence(x, y);
+            }
+        }
+        REQUIRE( same );
+        REQUIRE( sparse.influence(299, 69) > 0.0f );
+        REQUIRE( sparse.num_active_tiles() < sparse.num_tiles() );
+    }
+    
+    SECTION( "the steady state goes the short way round" ) {
+        ToroidalInfluenceMap solved(40, 30, false, 0.0f);
+        ToroidalInfluenceMap stepped(40, 30, false, 0.0f);
+        solved.set_influence(2, 1, 1.0f);
+        solved.set_influence(20, 15, 0.5f);
+        solved.solve_steady_state(0.2f);
+        
+        for (size_t step = 0; step < 70; step++) {
+            stepped.set_influence(2, 1, 1.0f);
+            stepped.set_influence(20, 15, std::max(0.5f, stepped.influence(20, 15)));
+            stepped.propagate(1.0f, 0.2f);
+        }
+        stepped.set_influence(2, 1, 1.0f);
+        stepped.set_influence(20, 15, std::max(0.5f, stepped.influence(20, 15)));
+        
+        bool close = true;
+        for (size_t y = 0; y < solved.height(); y++) {
+            for (size_t x = 0; x < solved.width(); x++) {
+                close = close && CLOSE_ENOUGH(solved.influence(x, y), stepped.influence(x, y), 1e-5f);
+            }
+        }
+        REQUIRE( close );
+        
+        // Three columns and two rows from (2, 1) across both wrapping edges.
+        REQUIRE( CLOSE_ENOUGH(solved.influence(39, 29), expf(-0.2f * (2 * 1.414f + 1.0f)), 1e-5f) );
+    }
+}
+
+TEST_CASE( "obstacles block influence", "[InfluenceMap]" ) {
+    const size_t width = 150;
+    const size_t height = 70;
+    
+    // A wall down column 40 with a one cell gap at row 60.
+    InfluenceMap map(width, height, true, 0.0f);
+    for (size_t y = 0; y < height; y++) {
+        if (y != 60) map.set_obstacle(40, y, true);
+    }
+    
+    SECTION( "obstacles hold zero" ) {
+        map.set_influence(40, 3, 1.0f);
+        map.fill(0.5f);
+        
+        REQUIRE( map.is_obstacle(40, 3) );
+        REQUIRE_FALSE( map.is_obstacle(40, 60) );
+        REQUIRE( map.influence(40, 3) == 0.0f );
+        REQUIRE( map.influence(40, 60) == 0.5f );
+        
+        map.clear_obstacles();
+        REQUIRE_FALSE( map.is_obstacle(40, 3) );
+    }
+    
+    SECTION( "propagation matches masking the reference kernel" ) {
+        const SimdTier initial_tier = active_simd_tier();
+        
+        for (int tier = Scalar; tier <= detected_simd_tier(); tier++) {
+            force_simd_tier(SimdTier(tier));
+            
+            InfluenceMap walled(width, height, true, 0.0f);
+            std::vector<float> cells;
+            seed_map(walled, cells, 31, 1.0f);
+            for (size_t y = 0; y < height; y++) {
+                for (size_t x = 0; x < width; x++) {
+                    if (map.is_obstacle(x, y)) {
+                        walled.set_obstacle(x, y, true);
+                        cells[y * width + x] = 0.0f;
+                    }
+                }
+            }
+            
+            bool same = true;
+            for (int step = 0; step < 5; step++) {
+                walled.propagate(0.6f, 0.2f);
+                reference_propagate(cells, width, height, true, 0.6f, 0.2f);
+                for (size_t y = 0; y < height; y++) {
+                    cells[y * width + 40] = y == 60 ? cells[y * width + 40] : 0.0f;
+                }
+                same = same && matches_reference(walled, cells);
+            }
+            
+            INFO( simd_tier_name(SimdTier(tier)) );
+            REQUIRE( same );
+        }
+        
+        force_simd_tier(initial_tier);
+    }
+    
+    SECTION( "every way of propagating respects them" ) {
+        ThreadPool pool(3);
+        InfluenceMap threaded(width, height, true, 0.0f);
+        InfluenceMap sparse(width, height, true, 0.0f);
+        InfluenceMap blocked(width, height, true, 0.0f);
+        threaded.set_thread_pool(&pool);
+        sparse.set_sparse_propagation(true);
+        for (size_t y = 0; y < height; y++) {
+            if (y == 60) continue;
+            threaded.set_obstacle(40, y, true);
+            sparse.set_obstacle(40, y, true);
+            blocked.set_obstacle(40, y, true);
+        }
+        
+        map.set_influence(20, 10, 1.0f);
+        threaded.set_influence(20, 10, 1.0f);
+        sparse.set_influence(20, 10, 1.0f);
+        blocked.set_influence(20, 10, 1.0f);
+        
+        for (int step = 0; step < 12; step++) {
+            map.propagate(0.8f, 0.1f);
+            threaded.propagate(0.8f, 0.1f);
+            sparse.propagate(0.8f, 0.1f);
+        }
+        blocked.propagate_steps(12, 0.8f, 0.1f);
+        
+        REQUIRE( test::same_cells(map, threaded) );
+        REQUIRE( test::same_cells(map, sparse) );
+        REQUIRE( test::same_cells(map, blocked) );
+        
+        // Twelve steps reach past the wall, but only the long way round.
+        REQUIRE( map.influence(32, 10) > 0.0f );
+        REQUIRE( map.influence(48, 10) == 0.0f );
+    }
+    
+    SECTION( "the steady state goes around them" ) {
+        map.set_influence(20, 10, 1.0f);
+        map.solve_steady_state(0.1f);
+        
+        // From (20, 10) down to the gap at (40, 60) and back up to (41, 10):
+        // 21 corner steps and 79 edge steps.
+        REQUIRE( map.influence(40, 10) == 0.0f );
+        REQUIRE( CLOSE_ENOUGH(map.influence(41, 10), expf(-0.1f * (21 * 1.414f + 79)), 1e-6f) );
+    }
+}
+
+TEST_CASE( "removing obstacles wakes the tiles sparse propagation let settle", "[InfluenceMap]" ) {
+    const size_t width = 150;
+    const size_t height = 70;
+    
+    // A source held just left of a wall down column 40, with nothing behind.
+    InfluenceMap dense(width, height, true, 0.0f);
+    InfluenceMap sparse(width, height, true, 0.0f);
+    sparse.set_sparse_propagation(true);
+    for (size_t y = 0; y < height; y++) {
+        dense.set_obstacle(40, y, true);
+        sparse.set_obstacle(40, y, true);
+    }
+    
+    auto step = [&](const size_t steps) {
+        for (size_t s = 0; s < steps; s++) {
+            dense.set_influence(35, 10, 1.0f);
+            sparse.set_influence(35, 10, 1.0f);
+            dense.propagate(0.5f, 0.1f);
+            sparse.propagate(0.5f, 0.1f);
+        }
+    };
+    step(300);
+    REQUIRE( sparse.num_active_tiles() < sparse.num_tiles() );
+    REQUIRE( test::same_cells(dense, sparse) );
+    REQUIRE( dense.influence(45, 10) == 0.0f );
+    
+    SECTION( "one cell at a time" ) {
+        dense.set_obstacle(40, 10, false);
+        sparse.set_obstacle(40, 10, false);
+    }
+    
+    SECTION( "all at once" ) {
+        dense.clear_obstacles();
+        sparse.clear_obstacles();
+    }
+    
+    step(40);
+    REQUIRE( dense.influence(70, 10) > 0.0f );
+    REQUIRE( test::same_cells(dense, sparse) );
+}
+
+TEST_CASE( "terrain changes how fast influence spreads", "[InfluenceMap]" ) {
+    const size_t width = 150;
+    const size_t height = 70;
+    
+    // A road along row 10 and a swamp over the bottom half.
+    auto lay_terrain = [&](InfluenceMap& map) {
+        map.set_terrain_cost(1, 0.25f);
+        map.set_terrain_cost(2, 3.0f);
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                if (y == 10) map.set_terrain(x, y, 1);
+                else if (y >= height / 2) map.set_terrain(x, y, 2);
+            }
+        }
+    };
+    
+    SECTION( "each cell decays by its own terrain" ) {
+        InfluenceMap map(width, height, false, 0.0f);
+        lay_terrain(map);
+        map.set_influence(20, 10, 1.0f);
+        map.set_influence(20, 50, 1.0f);
+        map.propagate(1.0f, 0.2f);
+        
+        REQUIRE( map.terrain(21, 10) == 1 );
+        REQUIRE( map.terrain_cost(2) == 3.0f );
+        REQUIRE( map.influence(21, 10) == expf(-1.0f * (0.2f * 0.25f)) );
+        REQUIRE( map.influence(20, 11) == expf(-1.0f * 0.2f) );
+        REQUIRE( map.influence(21, 50) == expf(-1.0f * (0.2f * 3.0f)) );
+        REQUIRE( map.influence(21, 51) == expf(-1.414f * (0.2f * 3.0f)) );
+    }
+    
+    SECTION( "terrain that costs 1 is the same as none" ) {
+        InfluenceMap uniform(width, height, true, 0.0f);
+        InfluenceMap plain(width, height, true, 0.0f);
+        std::vector<float> cells;
+        seed_map(uniform, cells, 77, 1.0f);
+        seed_map(plain, cells, 77, 1.0f);
+        for (size_t x = 0; x < width; x++) {
+            plain.set_terrain(x, x % height, uint8_t(x));
+        }
+        
+        for (int step = 0; step < 5; step++) {
+            uniform.propagate(0.6f, 0.1f * step);
+            plain.propagate(0.6f, 0.1f * step);
+        }
+        REQUIRE( test::same_cells(uniform, plain) );
+    }
+    
+    SECTION( "every way of propagating agrees" ) {
+        const SimdTier initial_tier = active_simd_tier();
+        force_simd_tier(Scalar);
+        InfluenceMap scalar(width, height, true, 0.0f);
+        lay_terrain(scalar);
+        scalar.set_influence(20, 10, 1.0f);
+        for (int step = 0; step < 12; step++) {
+            scalar.propagate(0.8f, 0.1f);
+        }
+        force_simd_tier(initial_tier);
+        
+        ThreadPool pool(3);
+        InfluenceMap threaded(width, height, true, 0.0f);
+        InfluenceMap sparse(width, height, true, 0.0f);
+        InfluenceMap blocked(width, height, true, 0.0f);
+        threaded.set_thread_pool(&pool);
+        sparse.set_sparse_propagation(true);
+        InfluenceMap * const maps[] = { &threaded, &sparse, &blocked };
+        for (size_t m = 0; m < 3; m++) {
+            lay_terrain(*maps[m]);
+            maps[m]->set_influence(20, 10, 1.0f);
+        }
+        
+        for (int step = 0; step < 12; step++) {
+            threaded.propagate(0.8f, 0.1f);
+            sparse.propagate(0.8f, 0.1f);
+        }
+        blocked.propagate_steps(12, 0.8f, 0.1f);
+        
+        REQUIRE( test::same_cells(scalar, threaded) );
+        REQUIRE( test::same_cells(scalar, sparse) );
+        REQUIRE( test::same_cells(scalar, blocked) );
+        REQUIRE( scalar.influence(31, 10) > scalar.influence(20, 21) );
+    }
+    
+    SECTION( "the steady state follows the cheapest route" ) {
+        InfluenceMap solved(width, height, false, 0.0f);
+        InfluenceMap iterated(width, height, false, 0.0f);
+        lay_terrain(solved);
+        lay_terrain(iterated);
+        solved.set_influence(20, 40, 1.0f);
+        solved.solve_steady_state(0.05f);
+        
+        for (size_t step = 0; step < width + height; step++) {
+            iterated.set_influence(20, 40, 1.0f);
+            iterated.propagate(1.0f, 0.05f);
+        }
+        iterated.set_influence(20, 40, 1.0f);
+        
+        bool close = true;
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                close = close && CLOSE_ENOUGH(solved.influence(x, y), iterated.influence(x, y), 1e-5f);
+            }
+        }
+        REQUIRE( close );
+    }
+}
+
+namespace {
+    
+    // What stamp() should give one cell, worked out the long way.
+    float stamped_cell(const float current, const float strength, const StampBlend blend,
+                       const ptrdiff_t dx, const ptrdiff_t dy, const size_t radius, const StampFalloff falloff)
+    {
+        const size_t squared = size_t(dx * dx + dy * dy);
+        if (squared > radius * radius) {
+            return current;
+        }
+        
+        const float fraction = std::sqrt(float(squared)) / float(radius + 1);
+        float weight = 1.0f;
+        if (falloff == FalloffLinear) {
+            weight = 1.0f - fraction;
+        } else if (falloff == FalloffQuadratic) {
+            weight = (1.0f - fraction) * (1.0f - fraction);
+        }
+        
+        const float stamped = strength * weight;
+        if (blend == StampMax) {
+            return stamped > current ? stamped : current;
+        } else if (blend == StampAdd) {
+            return current + stamped;
+        }
+        return stamped;
+    }
+
+} // namespace
+
+TEST_CASE( "stamps blend discs of influence into the map", "[InfluenceMap]" ) {
+    InfluenceMap map(9, 9, false, 0.0f);
+    
+    map.stamp(4, 4, 2, 2.0f, FalloffLinear);
+    REQUIRE( map.influence(4, 4) == 2.0f );
+    REQUIRE( map.influence(5, 4) == 2.0f * (1.0f - 1.0f / 3.0f) );
+    REQUIRE( map.influence(4, 2) == 2.0f * (1.0f - 2.0f / 3.0f) );
+    REQUIRE( map.influence(5, 5) == 2.0f * (1.0f - std::sqrt(2.0f) / 3.0f) );
+    REQUIRE( map.influence(6, 6) == 0.0f );
+    REQUIRE( map.influence(4, 7) == 0.0f );
+    
+    map.stamp(4, 4, 0, 1.0f, FalloffConstant, StampAdd);
+    REQUIRE( map.influence(4, 4) == 3.0f );
+    REQUIRE( map.influence(5, 4) == 2.0f * (1.0f - 1.0f / 3.0f) );
+    
+    map.stamp(4, 4, 1, 1.5f, FalloffConstant, StampMax);
+    REQUIRE( map.influence(4, 4) == 3.0f );
+    REQUIRE( map.influence(4, 5) == 1.5f );
+    
+    map.stamp(4, 4, 1, -1.0f, FalloffQuadratic, StampReplace);
+    REQUIRE( map.influence(4, 4) == -1.0f );
+    REQUIRE( map.influence(3, 4) == -0.25f );
+    REQUIRE( map.influence(3, 3) == 2.0f * (1.0f - std::sqrt(2.0f) / 3.0f) );
+    
+    SECTION( "stamps are clamped and clipped, and leave obstacles alone" ) {
+        InfluenceMap clamped(5, 4, true, 0.0f);
+        clamped.set_obstacle(1, 0, true);
+        clamped.stamp(0, 0, 3, 4.0f, FalloffLinear);
+        
+        REQUIRE( clamped.influence(0, 0) == 1.0f );
+        REQUIRE( clamped.influence(1, 0) == 0.0f );
+        REQUIRE( clamped.influence(3, 0) == 1.0f );
+        REQUIRE( clamped.influence(4, 0) == 0.0f );
+        REQUIRE( clamped.influence(0, 3) == 1.0f );
+    }
+}
+
+TEST_CASE( "stamping many sources matches stamping cell by cell", "[InfluenceMap]" ) {
+    const size_t width = 61;
+    const size_t height = 37;
+    const StampFalloff falloffs[] = { FalloffConstant, FalloffLinear, FalloffQuadratic };
+    const StampBlend blends[] = { StampMax, StampAdd, StampReplace };
+    const SimdTier initial_tier = active_simd_tier();
+    
+    std::vector<InfluenceMap::StampSource> sources;
+    unsigned int state = 5;
+    for (size_t i = 0; i < 40; i++) {
+        const InfluenceMap::StampSource source = {
+            size_t(test::noise(state) * width), size_t(test::noise(state) * height), size_t(test::noise(state) * 12),
+            test::noise(state) * 1.5f - 0.25f, falloffs[i % 3]
+        };
+        sources.push_back(source);
+    }
+    
+    for (int tier = Scalar; tier <= detected_simd_tier(); tier++) {
+        force_simd_tier(SimdTier(tier));
+        
+        for (size_t b = 0; b < 3; b++) {
+            for (int clamped = 0; clamped < 2; clamped++) {
+                InfluenceMap map(width, height, clamped != 0, 0.0f);
+                std::vector<float> cells;
+                seed_map(map, cells, 17, 1.0f);
+                map.set_obstacle(30, 20, true);
+                cells[20 * width + 30] = 0.0f;
+                map.stamp_many(&sources[0], sources.size(), blends[b]);
+                
+                for (size_t i = 0; i < sources.size(); i++) {
+                    const InfluenceMap::StampSource& source = sources[i];
+                    for (size_t y = 0; y < height; y++) {
+                        for (size_t x = 0; x < width; x++) {
+                            float& cell = cells[y * width + x];
+                            const float stamped = stamped_cell(cell, source.strength, blends[b],
+                                                               ptrdiff_t(x) - ptrdiff_t(source.x), ptrdiff_t(y) - ptrdiff_t(source.y),
+                                                               source.radius, source.falloff);
+                            if (stamped != cell || std::isnan(stamped)) {
+                                cell = clamped ? std::min(std::max(stamped, 0.0f), 1.0f) : stamped;
+                            }
+                        }
+                    }
+                    cells[20 * width + 30] = 0.0f;
+                }
+                
+                INFO( simd_tier_name(SimdTier(tier)) << ", blend " << blends[b] << ", clamped " << clamped );
+                REQUIRE( matches_reference(map, cells) );
+            }
+        }
+    }
+    
+    force_simd_tier(initial_tier);
+    
+    SECTION( "sparse propagation sees stamped tiles" ) {
+        InfluenceMap dense(width, height, true, 0.0f);
+        InfluenceMap sparse(width, height, true, 0.0f);
+        sparse.set_sparse_propagation(true);
+        
+        for (int step = 0; step < 30; step++) {
+            if (step % 10 == 0) {
+                dense.stamp_many(&sources[step / 10], 1, StampMax);
+                sparse.stamp_many(&sources[step / 10], 1, StampMax);
+            }
+            dense.propagate(0.5f, 0.2f);
+            sparse.propagate(0.5f, 0.2f);
+        }
+        
+        REQUIRE( test::same_cells(dense, sparse) );
+    }
+}
+
+TEST_CASE( "snapshots keep what was published while the map moves on", "[InfluenceMap]" ) {
+    InfluenceMap map(40, 30, true, 0.0f);
+    map.enable_snapshots();
+    REQUIRE( map.snapshots_enabled() );
+    map.set_influence(3, 4, 1.0f);
+    map.propagate(0.5f, 0.1f);
+    
+    InfluenceMap::Snapshot first = map.snapshot();
+    std::vector<float> published(40 * 30);
+    for (size_t y = 0; y < 30; y++) {
+        for (size_t x = 0; x < 40; x++) {
+            published[y * 40 + x] = map.influence(x, y);
+        }
+    }
+    auto unchanged = [&](const InfluenceMap::Snapshot& snapshot) {
+        bool same = true;
+        for (size_t y = 0; y < 30; y++) {
+            for (size_t x = 0; x < 40; x++) {
+                same = same && snapshot.influence(x, y) == published[y * 40 + x];
+            }
+        }
+        return same;
+    };
+    
+    SECTION( "snapshots read like the map did" ) {
+        float map_connections[8];
+        float snapshot_connections[8];
+        for (size_t y = 0; y < 30; y += 29) {
+            map.connections(0, y, map_connections, 1.0f, 7.0f);
+            first.connections(0, y, snapshot_connections, 1.0f, 7.0f);
+            REQUIRE( std::equal(map_connections, map_connections + 8, snapshot_connections) );
+            map.add_connections(39, y, map_connections, 0.5f);
+            first.add_connections(39, y, snapshot_connections, 0.5f);
+            REQUIRE( std::equal(map_connections, map_connections + 8, snapshot_connections) );
+        }
+        REQUIRE( first.width() == 40 );
+        REQUIRE( first.height() == 30 );
+    }
+    
+    SECTION( "steps write buffers no snapshot is reading" ) {
+        map.propagate(0.5f, 0.1f);
+        InfluenceMap::Snapshot second = map.snapshot();
+        const float second_value = map.influence(5, 5);
+        
+        // Both are held, so this step writes the third buffer.
+        map.propagate(0.5f, 0.1f);
+        REQUIRE( unchanged(first) );
+        REQUIRE( second.influence(5, 5) == second_value );
+        REQUIRE( map.snapshot().influence(5, 5) == map.influence(5, 5) );
+        
+        InfluenceMap::Snapshot copy = first;
+        first.release();
+        REQUIRE_FALSE( first.valid() );
+        second.release();
+        for (size_t i = 0; i < 4; i++) {
+            map.propagate(0.5f, 0.1f);
+        }
+        REQUIRE( unchanged(copy) );
+        REQUIRE( map.influence(5, 5) != copy.influence(5, 5) );
+    }
+    
+    SECTION( "changes between steps are copied and wait to be published" ) {
+        map.set_influence(20, 20, 0.75f);
+        map.stamp(30, 10, 2, 1.0f, FalloffLinear);
+        REQUIRE( unchanged(first) );
+        REQUIRE( unchanged(map.snapshot()) );
+        REQUIRE( map.influence(20, 20) == 0.75f );
+        
+        map.publish();
+        InfluenceMap::Snapshot second = map.snapshot();
+        REQUIRE( second.influence(20, 20) == 0.75f );
+        REQUIRE( second.influence(30, 10) == 1.0f );
+        
+        map.propagate(0.5f, 0.1f);
+        REQUIRE( unchanged(first) );
+        REQUIRE( second.influence(20, 20) == 0.75f );
+    }
+}
+
+TEST_CASE( "sparse propagation holding snapshots matches dense propagation", "[InfluenceMap]" ) {
+    InfluenceMap dense(200, 150, true, 0.0f);
+    InfluenceMap sparse(200, 150, true, 0.0f);
+    sparse.set_sparse_propagation(true);
+    sparse.enable_snapshots();
+    
+    // A wide emitter keeps whole tiles at its strength once they settle.
+    const InfluenceMap::StampSource source = { 60, 60, 24, 1.0f, FalloffLinear };
+    dense.add_emitter(source);
+    sparse.add_emitter(source);
+    
+    // Holding a snapshot across a step makes the next one write the third
+    // buffer, which is behind on the tiles sparse steps have let settle.
+    InfluenceMap::Snapshot held;
+    for (size_t step = 0; step < 200; step++) {
+        if (step >= 120 && step % 3 == 0) {
+            held = sparse.snapshot();
+        } else if (step % 3 == 2) {
+            held.release();
+        }
+        if (step == 60) {
+            dense.set_influence(30, 30, 1.0f);
+            sparse.set_influence(30, 30, 1.0f);
+        }
+        dense.propagate(0.5f, 2.0f);
+        sparse.propagate(0.5f, 2.0f);
+    }
+    REQUIRE( sparse.num_active_tiles() < sparse.num_tiles() );
+    
+    bool same = true;
+    const InfluenceMap::Snapshot snapshot = sparse.snapshot();
+    for (size_t y = 0; y < 150; y++) {
+        for (size_t x = 0; x < 200; x++) {
+            same = same && sparse.influence(x, y) == dense.influence(x, y);
+            same = same && snapshot.influence(x, y) == dense.influence(x, y);
+        }
+    }
+    REQUIRE( same );
+}
+
+TEST_CASE( "readers take snapshots while another thread propagates", "[InfluenceMap]" ) {
+    // A uniform toroidal map stays uniform, so a snapshot that caught a
+    // step half written would show two values.
+    ToroidalInfluenceMap map(64, 64, false, 1.0f);
+    ThreadPool pool(2);
+    map.set_thread_pool(&pool);
+    map.enable_snapshots();
+    
+    std::atomic<bool> done(false);
+    std::atomic<size_t> torn(0);
+    std::atomic<size_t> reads(0);
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < 3; i++) {
+        readers.push_back(std::thread([&]() {
+            while (!done.load()) {
+                const ToroidalInfluenceMap::Snapshot snapshot = map.snapshot();
+                const float value = snapshot.influence(0, 0);
+                for (size_t y = 0; y < 64; y++) {
+                    for (size_t x = 0; x < 64; x++) {
+                        if (snapshot.influence(x, y) != value) {
+                            torn++;
+                        }
+                    }
+                }
+                reads++;
+            }
+        }));
+    }
+    
+    for (size_t step = 0; step < 2000; step++) {
+        map.propagate(0.5f, 0.001f);
+        if (step % 100 == 0) {
+            map.propagate_steps(3, 0.5f, 0.001f);
+        }
+    }
+    while (reads.load() < 10) {
+        std::this_thread::yield();
+    }
+    done = true;
+    for (size_t i = 0; i < readers.size(); i++) {
+        readers[i].join();
+    }
+    
+    REQUIRE( torn.load() == 0 );
+    REQUIRE( map.influence(0, 0) < 1.0f );
+}
+
+TEST_CASE( "maps can be moved", "[InfluenceMap]" ) {
+    const size_t width = 3 * InfluenceMap::TILE_SIZE + 7;
+    const size_t height = 2 * InfluenceMap::TILE_SIZE + 5;
+    const InfluenceMap::StampSource source = { 20, 30, 4, 1.0f, FalloffLinear };
+    
+    auto set_up = [&](InfluenceMap& map) {
+        map.set_sparse_propagation(true);
+        map.set_obstacle(10, 10, true);
+        map.set_terrain(50, 20, 1);
+        map.set_terrain_cost(1, 3.0f);
+        map.add_emitter(source);
+        map.enable_snapshots();
+    };
+    
+    InfluenceMap expected(width, height, true, 0.0f);
+    set_up(expected);
+    InfluenceMap original(width, height, true, 0.0f);
+    set_up(original);
+    for (size_t step = 0; step < 20; step++) {
+        expected.propagate(0.5f, 0.2f);
+        original.propagate(0.5f, 0.2f);
+    }
+    
+    InfluenceMap moved(std::move(original));
+    REQUIRE( original.width() == 0 );
+    REQUIRE( original.height() == 0 );
+    REQUIRE( moved.width() == width );
+    REQUIRE( moved.num_emitters() == 1 );
+    REQUIRE( moved.snapshots_enabled() );
+    REQUIRE( test::same_cells(expected, moved) );
+    
+    InfluenceMap assigned(5, 5, false, 1.0f);
+    assigned = std::move(moved);
+    REQUIRE( moved.width() == 0 );
+    REQUIRE( assigned.width() == width );
+    REQUIRE( assigned.height() == height );
+    
+    // Obstacles, terrain, emitters and the tiles sparse propagation tracks
+    // all came along.
+    for (size_t step = 0; step < 20; step++) {
+        expected.propagate(0.5f, 0.2f);
+        assigned.propagate(0.5f, 0.2f);
+    }
+    REQUIRE( test::same_cells(expected, assigned) );
+    REQUIRE( assigned.num_active_tiles() == expected.num_active_tiles() );
+    REQUIRE( assigned.influence(10, 10) == 0.0f );
+    REQUIRE( assigned.snapshot().influence(20, 30) == expected.snapshot().influence(20, 30) );
+    
+    // A moved from map takes new cells.
+    original = InfluenceMap(8, 6, false, 0.25f);
+    REQUIRE( original.width() == 8 );
+    REQUIRE( original.influence(7, 5) == 0.25f );
+    
+    std::vector<InfluenceMap> maps;
+    for (size_t i = 0; i < 10; i++) {
+        maps.push_back(InfluenceMap(12, 9, false, float(i)));
+    }
+    for (size_t i = 0; i < 10; i++) {
+        REQUIRE( maps[i].influence(11, 8) == float(i) );
+    }
+}
+
+TEST_CASE( "maps sharing a buffer pool recycle their cells", "[InfluenceMap]" ) {
+    BufferPool pool;
+    
+    {
+        // A wrapping map writes its halo, which the maps after it need zeroed.
+        ToroidalInfluenceMap dirty(40, 30, 5.0f, &pool);
+        dirty.set_influence(0, 0, 9.0f);
+        dirty.propagate(0.5f, 0.1f);
+        REQUIRE( pool.num_spare_buffers() == 0 );
+        
+        dirty.enable_snapshots();
+        dirty.propagate(0.5f, 0.1f);
+    }
+    REQUIRE( pool.num_spare_buffers() == 3 );
+    
+    // Squads come and go without the heap, and a map made from recycled
+    // buffers behaves as a fresh one would, halo and all.
+    for (size_t round = 0; round < 5; round++) {
+        InfluenceMap recycled(40, 30, true, 0.0f, &pool);
+        InfluenceMap recycled_too(40, 30, true, 0.0f, &pool);
+        REQUIRE( pool.num_spare_buffers() == 0 );
+        InfluenceMap fresh(40, 30, true, 0.0f);
+        
+        recycled.set_influence(0, 0, 1.0f);
+        fresh.set_influence(0, 0, 1.0f);
+        for (size_t step = 0; step < 5; step++) {
+            recycled.propagate(0.5f, 0.1f);
+            fresh.propagate(0.5f, 0.1f);
+        }
+        REQUIRE( test::same_cells(fresh, recycled) );
+        REQUIRE( recycled_too.influence(39, 29) == 0.0f );
+        
+        // Moving hands the buffers over along with the pool they go back to.
+        InfluenceMap moved(std::move(recycled_too));
+    }
+    REQUIRE( pool.num_spare_buffers() == 4 );
+}
+
+TEST_CASE( "maps on huge pages propagate as maps on the heap do", "[InfluenceMap]" ) {
+    const HugePages initial = huge_pages();
+    
+    // Big enough for its buffers to be put on huge pages.
+    const size_t width = 1100;
+    const size_t height = 1000;
+    
+    set_huge_pages(HugePagesOff);
+    InfluenceMap heap(width, height, true, 0.0f);
+    set_huge_pages(HugePagesTransparent);
+    InfluenceMap huge(width, height, true, 0.0f);
+    set_huge_pages(initial);
+    
+    const InfluenceMap::StampSource sources[] = {
+        { 10, 20, 5, 1.0f, FalloffLinear },
+        { 1090, 990, 8, 0.5f, FalloffQuadratic }
+    };
+    heap.stamp_many(sources, 2);
+    huge.stamp_many(sources, 2);
+    for (size_t step = 0; step < 3; step++) {
+        heap.propagate(0.5f, 0.1f);
+        huge.propagate(0.5f, 0.1f);
+    }
+    REQUIRE( test::same_cells(heap, huge) );
+}
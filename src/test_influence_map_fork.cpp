@@ -0,0 +1,224 @@
+#include "catch.hpp"
+#include "influence_map_fork.h"
+
+#include <vector>
+
+using namespace influence_map;
+
+namespace {
+    
+    template <typename Map, typename Other>
+    bool same_influence(const Map& map, const Other& other)
+    {
+        bool same = true;
+        for (size_t y = 0; y < map.height(); y++) {
+            for (size_t x = 0; x < map.width(); x++) {
+                same = same && map.influence(x, y) == other.influence(x, y);
+            }
+        }
+        return same;
+    }
+    
+    // Gives map a settled source, an obstacle and some terrain, the same
+    // every time, so that two maps set up with it match.
+    template <typename Map>
+    void set_up(Map& map, const bool emitter)
+    {
+        map.set_sparse_propagation(true);
+        map.set_obstacle(70, 40, true);
+        map.set_terrain(20, 50, 1);
+        map.set_terrain_cost(1, 3.0f);
+        if (emitter) {
+            const typename Map::StampSource source = { 30, 30, 6, 1.0f, FalloffLinear };
+            map.add_emitter(source);
+        } else {
+            map.stamp(30, 30, 6, 1.0f, FalloffLinear);
+        }
+        for (size_t step = 0; step < 300; step++) {
+            map.propagate(0.5f, 1.0f);
+        }
+    }
+    
+    template <typename Map, typename Fork>
+    void check_fork_matches_map(const bool emitter)
+    {
+        Map map(256, 192, true, 0.0f);
+        Map expected(256, 192, true, 0.0f);
+        set_up(map, emitter);
+        set_up(expected, emitter);
+        
+        Fork fork(map);
+        REQUIRE( same_influence(fork, map) );
+        REQUIRE( fork.num_copied_tiles() == 0 );
+        
+        fork.stamp(100, 75, 5, 0.8f, FalloffQuadratic);
+        expected.stamp(100, 75, 5, 0.8f, FalloffQuadratic);
+        fork.set_influence(255, 0, 0.5f);
+        expected.set_influence(255, 0, 0.5f);
+        fork.set_influence(70, 40, 0.5f);
+        expected.set_influence(70, 40, 0.5f);
+        for (size_t step = 0; step < 40; step++) {
+            fork.propagate(0.5f, 1.0f);
+            expected.propagate(0.5f, 1.0f);
+        }
+        REQUIRE( same_influence(fork, expected) );
+        REQUIRE( fork.num_copied_tiles() < fork.num_tiles() );
+        
+        // Changing the decay changes every tile.
+        fork.propagate(0.5f, 0.5f);
+        expected.propagate(0.5f, 0.5f);
+        REQUIRE( same_influence(fork, expected) );
+        REQUIRE( fork.num_active_tiles() == fork.num_tiles() );
+        
+        // None of which touched the map.
+        Map untouched(256, 192, true, 0.0f);
+        set_up(untouched, emitter);
+        REQUIRE( same_influence(map, untouched) );
+    }
+
+} // namespace
+
+TEST_CASE( "forks propagate to the same cells as the map would", "[InfluenceMapFork]" ) {
+    SECTION( "stamped sources" ) {
+        check_fork_matches_map<InfluenceMap, InfluenceMapFork>(false);
+    }
+    SECTION( "emitters" ) {
+        check_fork_matches_map<InfluenceMap, InfluenceMapFork>(true);
+    }
+    SECTION( "wrapping borders" ) {
+        check_fork_matches_map<ToroidalInfluenceMap, BasicInfluenceMapFork<float, RuntimeClamp01, WrapBorder> >(false);
+    }
+    SECTION( "fixed point cells" ) {
+        check_fork_matches_map<UInt16InfluenceMap, BasicInfluenceMapFork<uint16_t> >(true);
+    }
+}
+
+TEST_CASE( "forks share tiles until they change them", "[InfluenceMapFork]" ) {
+    InfluenceMap map(256, 256, true, 0.0f);
+    set_up(map, true);
+    
+    InfluenceMapFork fork(map);
+    REQUIRE( fork.num_tiles() == 64 );
+    fork.set_influence(200, 200, 1.0f);
+    REQUIRE( fork.num_copied_tiles() == 1 );
+    
+    InfluenceMapFork child(fork);
+    REQUIRE( child.num_copied_tiles() == 1 );
+    child.set_influence(201, 200, 0.5f);
+    child.set_influence(10, 250, 0.5f);
+    REQUIRE( child.num_copied_tiles() == 2 );
+    REQUIRE( child.influence(200, 200) == 1.0f );
+    REQUIRE( fork.influence(201, 200) == 0.0f );
+    REQUIRE( fork.influence(10, 250) == 0.0f );
+    REQUIRE( map.influence(200, 200) == 0.0f );
+    
+    // A few steps only copy the tiles the change spreads to.
+    for (size_t step = 0; step < 5; step++) {
+        child.propagate(0.5f, 1.0f);
+    }
+    REQUIRE( child.num_copied_tiles() <= 9 );
+    REQUIRE( child.influence(203, 200) > 0.0f );
+    REQUIRE( fork.influence(203, 200) == 0.0f );
+    
+    child = fork;
+    REQUIRE( child.influence(10, 250) == 0.0f );
+}
+
+TEST_CASE( "forks of a map with snapshots outlive its steps", "[InfluenceMapFork]" ) {
+    InfluenceMap map(64, 64, true, 0.0f);
+    map.enable_snapshots();
+    map.set_influence(32, 32, 1.0f);
+    map.propagate(0.5f, 0.5f);
+    
+    InfluenceMap copy(64, 64, true, 0.0f);
+    for (size_t y = 0; y < 64; y++) {
+        for (size_t x = 0; x < 64; x++) {
+            copy.set_influence(x, y, map.influence(x, y));
+        }
+    }
+    
+    InfluenceMapFork fork(map);
+    map.propagate(0.5f, 0.5f);
+    map.set_influence(0, 0, 1.0f);
+    map.propagate(0.5f, 0.5f);
+    REQUIRE( same_influence(fork, copy) );
+    
+    fork.propagate(0.5f, 0.5f);
+    copy.propagate(0.5f, 0.5f);
+    REQUIRE( same_influence(fork, copy) );
+}
+
+TEST_CASE( "forks of a map with snapshots see changes made since the last step", "[InfluenceMapFork]" ) {
+    InfluenceMap map(64, 64, true, 0.0f);
+    map.enable_snapshots();
+    map.set_influence(32, 32, 1.0f);
+    map.propagate(0.5f, 0.5f);
+    
+    // Written after the step published, so no snapshot has these yet.
+    map.set_influence(5, 5, 1.0f);
+    map.stamp(50, 10, 3, 1.0f, FalloffLinear);
+    REQUIRE( map.snapshot().influence(5, 5) == 0.0f );
+    
+    InfluenceMap copy(64, 64, true, 0.0f);
+    for (size_t y = 0; y < 64; y++) {
+        for (size_t x = 0; x < 64; x++) {
+            copy.set_influence(x, y, map.influence(x, y));
+        }
+    }
+    
+    InfluenceMapFork fork(map);
+    REQUIRE( fork.influence(5, 5) == 1.0f );
+    REQUIRE( same_influence(fork, copy) );
+    
+    // Forking doesn't publish them either.
+    REQUIRE( map.snapshot().influence(5, 5) == 0.0f );
+    map.publish();
+    REQUIRE( map.snapshot().influence(5, 5) == 1.0f );
+    
+    // The map writing on leaves the buffer the fork holds alone.
+    map.set_influence(5, 5, 0.25f);
+    map.propagate(0.5f, 0.5f);
+    map.set_influence(6, 6, 1.0f);
+    map.propagate(0.5f, 0.5f);
+    REQUIRE( same_influence(fork, copy) );
+    
+    fork.propagate(0.5f, 0.5f);
+    copy.propagate(0.5f, 0.5f);
+    REQUIRE( fork.influence(5, 6) > 0.0f );
+    REQUIRE( same_influence(fork, copy) );
+}
+
+TEST_CASE( "forks sharing a workspace recycle their tiles", "[InfluenceMapFork]" ) {
+    InfluenceMap map(128, 128, true, 0.0f);
+    InfluenceMapFork::Workspace workspace;
+    
+    size_t spare = 0;
+    {
+        // The disc misses the corner tiles of the 4 x 4 it spans.
+        InfluenceMapFork fork(map, &workspace);
+        fork.stamp(64, 64, 40, 1.0f, FalloffLinear);
+        REQUIRE( fork.num_copied_tiles() == 12 );
+        REQUIRE( workspace.num_spare_tiles() == 0 );
+        
+        // Tiles a step replaces come back to the workspace, and the next
+        // step takes them out again.
+        fork.propagate(0.5f, 0.5f);
+        spare = workspace.num_spare_tiles();
+        REQUIRE( spare >= 12 );
+        fork.propagate(0.5f, 0.5f);
+        REQUIRE( workspace.num_spare_tiles() <= spare );
+        spare = workspace.num_spare_tiles() + fork.num_copied_tiles();
+    }
+    REQUIRE( workspace.num_spare_tiles() == spare );
+    
+    InfluenceMapFork fork(map, &workspace);
+    InfluenceMapFork plain(map);
+    fork.stamp(10, 10, 3, 1.0f, FalloffConstant);
+    plain.stamp(10, 10, 3, 1.0f, FalloffConstant);
+    REQUIRE( workspace.num_spare_tiles() == spare - 1 );
+    for (size_t step = 0; step < 3; step++) {
+        fork.propagate(0.5f, 0.5f);
+        plain.propagate(0.5f, 0.5f);
+    }
+    REQUIRE( same_influence(fork, plain) );
+}
@@ -0,0 +1,149 @@
+#include "catch.hpp"
+#include "influence_map.h"
+#include "layered_influence_map.h"
+#include "simd_dispatch.h"
+#include "test_helpers.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace influence_map;
+
+namespace {
+    
+    // Seeds every channel of the layered map and the matching single map with
+    // the same values.
+    void seed_layers(LayeredInfluenceMap& layered, std::vector<InfluenceMap*>& singles, unsigned int state, const float scale)
+    {
+        for (size_t c = 0; c < layered.num_channels(); c++) {
+            for (size_t y = 0; y < layered.height(); y++) {
+                for (size_t x = 0; x < layered.width(); x++) {
+                    const float value = (test::noise(state) * 2.0f - 0.5f) * scale;
+                    layered.set_influence(x, y, c, value);
+                    singles[c]->set_influence(x, y, value);
+                }
+            }
+        }
+    }
+    
+    bool layers_match(const LayeredInfluenceMap& layered, const std::vector<InfluenceMap*>& singles)
+    {
+        for (size_t c = 0; c < layered.num_channels(); c++) {
+            for (size_t y = 0; y < layered.height(); y++) {
+                for (size_t x = 0; x < layered.width(); x++) {
+                    if (!test::same_bits(singles[c]->influence(x, y), layered.influence(x, y, c))) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+} // namespace
+
+TEST_CASE( "layered maps keep their channels apart", "[LayeredInfluenceMap]" ) {
+    LayeredInfluenceMap map(37, 5, 3, true, 0.25f);
+    
+    REQUIRE( map.width() == 37 );
+    REQUIRE( map.height() == 5 );
+    REQUIRE( map.num_cells() == 37 * 5 );
+    REQUIRE( map.num_channels() == 3 );
+    REQUIRE( map.peak_influence(1) == 0.25f );
+    
+    map.set_influence(36, 4, 1, 0.75f);
+    map.set_influence(0, 0, 2, 2.0f);
+    REQUIRE( map.influence(36, 4, 0) == 0.25f );
+    REQUIRE( map.influence(36, 4, 1) == 0.75f );
+    REQUIRE( map.influence(0, 0, 2) == 1.0f );
+    REQUIRE( map.peak_influence(0) == 0.25f );
+    REQUIRE( map.peak_influence(1) == 0.75f );
+    
+    map.fill(1, -1.0f);
+    REQUIRE( map.peak_influence(1) == 0.0f );
+    REQUIRE( map.peak_influence(2) == 1.0f );
+    REQUIRE( map.influence(36, 4, 0) == 0.25f );
+}
+
+TEST_CASE( "layered propagation matches a map per channel bit for bit", "[LayeredInfluenceMap]" ) {
+    const size_t sizes[][2] = { {1, 1}, {2, 2}, {7, 1}, {4, 9}, {37, 23} };
+    const size_t channel_counts[] = { 1, 3, 8, 16 };
+    const SimdTier initial_tier = active_simd_tier();
+    
+    for (int tier = Scalar; tier <= detected_simd_tier(); tier++) {
+        force_simd_tier(SimdTier(tier));
+        
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (size_t n = 0; n < sizeof(channel_counts) / sizeof(channel_counts[0]); n++) {
+                for (int clamped = 0; clamped < 2; clamped++) {
+                    const size_t width = sizes[s][0];
+                    const size_t height = sizes[s][1];
+                    const size_t channels = channel_counts[n];
+                    
+                    LayeredInfluenceMap layered(width, height, channels, clamped != 0, 0.0f);
+                    std::vector<InfluenceMap*> singles;
+                    for (size_t c = 0; c < channels; c++) {
+                        singles.push_back(new InfluenceMap(width, height, clamped != 0, 0.0f));
+                    }
+                    seed_layers(layered, singles, unsigned(width * 31 + height + channels), clamped ? 1.0f : 100.0f);
+                    
+                    std::vector<float> momentums(channels);
+                    std::vector<float> decays(channels);
+                    for (int step = 0; step < 4; step++) {
+                        for (size_t c = 0; c < channels; c++) {
+                            momentums[c] = 0.2f + 0.05f * float(c) + 0.1f * step;
+                            decays[c] = 0.05f * float(c + step);
+                            singles[c]->propagate(momentums[c], decays[c]);
+                        }
+                        layered.propagate(&momentums[0], &decays[0]);
+                        
+                        INFO( simd_tier_name(SimdTier(tier)) << ", size " << width << "x" << height << ", " << channels << " channels, clamped " << clamped << ", step " << step );
+                        REQUIRE( layers_match(layered, singles) );
+                    }
+                    
+                    for (size_t c = 0; c < channels; c++) {
+                        singles[c]->propagate(0.5f, 0.3f);
+                    }
+                    layered.propagate(0.5f, 0.3f);
+                    REQUIRE( layers_match(layered, singles) );
+                    
+                    for (size_t c = 0; c < channels; c++) {
+                        delete singles[c];
+                    }
+                }
+            }
+        }
+    }
+    
+    force_simd_tier(initial_tier);
+}
+
+TEST_CASE( "threaded layered propagation matches single threaded propagation", "[LayeredInfluenceMap]" ) {
+    const size_t width = 53;
+    const size_t height = 211;
+    const size_t channels = 5;
+    
+    ThreadPool pool(3);
+    LayeredInfluenceMap layered(width, height, channels, false, 0.0f);
+    layered.set_thread_pool(&pool);
+    REQUIRE( layered.thread_pool() == &pool );
+    
+    std::vector<InfluenceMap*> singles;
+    for (size_t c = 0; c < channels; c++) {
+        singles.push_back(new InfluenceMap(width, height, false, 0.0f));
+    }
+    seed_layers(layered, singles, 99, 50.0f);
+    
+    for (size_t steps = 0; steps < 4; steps++) {
+        for (size_t c = 0; c < channels; c++) {
+            singles[c]->propagate(0.6f, 0.2f);
+        }
+        layered.propagate(0.6f, 0.2f);
+    }
+    REQUIRE( layers_match(layered, singles) );
+    
+    for (size_t c = 0; c < channels; c++) {
+        delete singles[c];
+    }
+}
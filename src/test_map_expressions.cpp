@@ -0,0 +1,127 @@
+#include "catch.hpp"
+#include "map_expressions.h"
+#include "simd_dispatch.h"
+#include "test_helpers.h"
+#include "thread_pool.h"
+
+#include <cmath>
+
+using namespace influence_map;
+
+TEST_CASE( "map expressions evaluate cell by cell", "[MapExpressions]" ) {
+    // Wider than an expression block, so rows take several.
+    const size_t width = 300;
+    const size_t height = 3;
+    const SimdTier initial_tier = active_simd_tier();
+    
+    InfluenceMap a(width, height, false, 0.0f);
+    InfluenceMap b(width, height, false, 0.0f);
+    InfluenceMap c(width, height, false, 0.0f);
+    test::seed(a, 1, 3.0f, -1.0f);
+    test::seed(b, 2, 3.0f, -1.0f);
+    test::seed(c, 3, 3.0f, -1.0f);
+    
+    for (int tier = Scalar; tier <= detected_simd_tier(); tier++) {
+        force_simd_tier(SimdTier(tier));
+        INFO( simd_tier_name(SimdTier(tier)) );
+        
+        InfluenceMap weighted(width, height, false, 0.0f);
+        assign(weighted, 0.6f * a + 0.4 * b - c);
+        
+        InfluenceMap mixed(width, height, false, 0.0f);
+        assign(mixed, max(min(a, b), -c) + threshold(c, 0.5f));
+        
+        InfluenceMap clamped(width, height, false, 0.0f);
+        assign(clamped, clamp(a * b, -0.25f, 0.25f) - 1);
+        
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                const float av = a.influence(x, y);
+                const float bv = b.influence(x, y);
+                const float cv = c.influence(x, y);
+                
+                const float scaled_a = 0.6f * av;
+                const float scaled_b = 0.4f * bv;
+                const float sum = scaled_a + scaled_b;
+                REQUIRE( test::same_bits(weighted.influence(x, y), sum - cv) );
+                
+                const float smaller = av < bv ? av : bv;
+                const float negated = cv * -1.0f;
+                const float larger = smaller > negated ? smaller : negated;
+                REQUIRE( test::same_bits(mixed.influence(x, y), larger + (cv >= 0.5f ? cv : 0.0f)) );
+                
+                const float product = av * bv;
+                const float limited = product > 0.25f ? 0.25f : (product < -0.25f ? -0.25f : product);
+                REQUIRE( test::same_bits(clamped.influence(x, y), limited - 1.0f) );
+            }
+        }
+    }
+    
+    force_simd_tier(initial_tier);
+}
+
+TEST_CASE( "assigning an expression clamps and keeps obstacles", "[MapExpressions]" ) {
+    InfluenceMap a(4, 4, false, 0.75f);
+    InfluenceMap destination(4, 4, true, 0.5f);
+    destination.set_obstacle(1, 2, true);
+    
+    // The destination can read itself.
+    assign(destination, destination + a);
+    
+    REQUIRE( destination.influence(0, 0) == 1.0f );
+    REQUIRE( destination.influence(1, 2) == 0.0f );
+    
+    assign(destination, destination - 2.0f * a);
+    REQUIRE( destination.influence(0, 0) == 0.0f );
+    
+    assign(destination, 0.25f * a + destination);
+    REQUIRE( destination.influence(3, 3) == 0.1875f );
+    REQUIRE( destination.peak_influence() == 0.1875f );
+}
+
+TEST_CASE( "propagating from an expression matches assigning then propagating", "[MapExpressions]" ) {
+    const size_t sizes[][2] = { {1, 1}, {7, 3}, {300, 5}, {53, 211} };
+    const SimdTier initial_tier = active_simd_tier();
+    ThreadPool pool(3);
+    
+    for (int tier = Scalar; tier <= detected_simd_tier(); tier++) {
+        force_simd_tier(SimdTier(tier));
+        
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (int threaded = 0; threaded < 2; threaded++) {
+                for (int clamped = 0; clamped < 2; clamped++) {
+                    const size_t width = sizes[s][0];
+                    const size_t height = sizes[s][1];
+                    
+                    InfluenceMap a(width, height, false, 0.0f);
+                    InfluenceMap b(width, height, false, 0.0f);
+                    test::seed(a, unsigned(width + height), 3.0f, -1.0f);
+                    test::seed(b, unsigned(width * height), 3.0f, -1.0f);
+                    
+                    InfluenceMap fused(width, height, clamped != 0, 0.0f);
+                    InfluenceMap expected(width, height, clamped != 0, 0.0f);
+                    fused.set_obstacle(width / 2, height / 2, true);
+                    expected.set_obstacle(width / 2, height / 2, true);
+                    fused.set_terrain(0, 0, 1);
+                    fused.set_terrain_cost(1, 2.0f);
+                    expected.set_terrain(0, 0, 1);
+                    expected.set_terrain_cost(1, 2.0f);
+                    if (threaded) fused.set_thread_pool(&pool);
+                    
+                    for (int step = 0; step < 3; step++) {
+                        const float momentum = 0.4f + 0.2f * step;
+                        const float decay = 0.1f * step;
+                        propagate_from(fused, 0.5f * fused + max(a, b) - 0.25f * b, momentum, decay);
+                        assign(expected, 0.5f * expected + max(a, b) - 0.25f * b);
+                        expected.propagate(momentum, decay);
+                        
+                        INFO( simd_tier_name(SimdTier(tier)) << ", size " << width << "x" << height << ", threaded " << threaded << ", clamped " << clamped << ", step " << step );
+                        REQUIRE( test::same_cells(fused, expected) );
+                    }
+                }
+            }
+        }
+    }
+    
+    force_simd_tier(initial_tier);
+}
@@ -0,0 +1,594 @@
+#include "catch.hpp"
+#include "cell_kernels.h"
+#include "map_kernels.h"
+#include "test_helpers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace influence_map;
+using namespace influence_map::detail;
+
+namespace {
+    
+    // Every vector tier the host can run.
+    std::vector<SimdTier> vector_tiers()
+    {
+        std::vector<SimdTier> tiers;
+        for (int tier = SSE41; tier <= detected_simd_tier(); tier++) {
+            tiers.push_back(SimdTier(tier));
+        }
+        return tiers;
+    }
+    
+    // Mix of in range, out of range, negative and signed zero values.
+    float test_value(unsigned int& state)
+    {
+        const unsigned int bits = test::next_random(state);
+        switch ((bits >> 28) & 7) {
+            case 0: return 0.0f;
+            case 1: return -0.0f;
+            case 2: return 1.0f;
+            default: return (float(bits >> 8) / float(1 << 24)) * 3.0f - 1.0f;
+        }
+    }
+    
+    // Any float at all, NaNs and subnormals included.
+    float test_bits(unsigned int& state)
+    {
+        const unsigned int bits = test::next_random(state);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    
+    template <typename Cell>
+    void require_same_conversions(const std::vector<Cell>& cells, const std::vector<float>& values)
+    {
+        const std::vector<SimdTier> tiers = vector_tiers();
+        
+        std::vector<float> expected_wide(cells.size());
+        std::vector<Cell> expected_narrow(values.size());
+        conversions<Cell>(scalar_kernels()).widen(&cells[0], &expected_wide[0], cells.size());
+        conversions<Cell>(scalar_kernels()).narrow(&values[0], &expected_narrow[0], values.size());
+        
+        for (size_t t = 0; t < tiers.size(); t++) {
+            std::vector<float> wide(cells.size());
+            std::vector<Cell> narrow(values.size());
+            conversions<Cell>(kernels_for(tiers[t])).widen(&cells[0], &wide[0], cells.size());
+            conversions<Cell>(kernels_for(tiers[t])).narrow(&values[0], &narrow[0], values.size());
+            
+            INFO( simd_tier_name(tiers[t]) );
+            REQUIRE( memcmp(&expected_wide[0], &wide[0], cells.size() * sizeof(float)) == 0 );
+            REQUIRE( memcmp(&expected_narrow[0], &narrow[0], values.size() * sizeof(Cell)) == 0 );
+        }
+    }
+    
+    // The widened kernels, on every tier, against the scalar cell kernel.
+    template <typename Cell>
+    void require_widened_kernels_match(unsigned int state)
+    {
+        std::vector<SimdTier> all_tiers(1, Scalar);
+        const std::vector<SimdTier> tiers = vector_tiers();
+        all_tiers.insert(all_tiers.end(), tiers.begin(), tiers.end());
+        const SimdTier initial = active_simd_tier();
+        
+        float edge_factors[16];
+        float corner_factors[16];
+        for (size_t i = 0; i < 16; i++) {
+            edge_factors[i] = expf(-0.05f * float(i));
+            corner_factors[i] = expf(-0.0707f * float(i));
+        }
+        
+        // Either side of the chunks rows are widened in, too.
+        const size_t counts[] = { 0, 1, 7, 16, 33, 70, 255, 256, 257, 600 };
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            const size_t count = counts[c];
+            
+            std::vector<Cell> input(3 * (count + 2));
+            for (size_t i = 0; i < input.size(); i++) {
+                input[i] = CellTraits<Cell>::encode(test_value(state));
+            }
+            const Cell * const above = &input[1];
+            const Cell * const row = &input[count + 3];
+            const Cell * const below = &input[2 * count + 5];
+            
+            std::vector<uint64_t> blocked(count / 64 + 2);
+            std::vector<uint8_t> terrain(count + 1);
+            std::vector<float> floor(count + 1);
+            for (size_t i = 0; i < blocked.size(); i++) {
+                const unsigned int bits = test::next_random(state);
+                blocked[i] = (uint64_t(bits) << 32) | (bits * 2654435761u);
+            }
+            for (size_t i = 0; i < count; i++) {
+                terrain[i] = uint8_t(test::next_random(state) >> 24) % 16;
+                floor[i] = i % 3 == 0 ? -INFINITY : test_value(state);
+            }
+            
+            for (int variant = 0; variant < 4; variant++) {
+                PropagateRowParams params = { 0.7f, 0.8f, 0.6f, variant != 0, 0.0f, 1.0f, nullptr, 0, nullptr, nullptr, nullptr, 0, nullptr };
+                if (variant == 2) {
+                    params.blocked = &blocked[0];
+                    params.blocked_bit = 5;
+                    params.floor = &floor[0];
+                } else if (variant == 3) {
+                    params.terrain = &terrain[0];
+                    params.edge_factors = edge_factors;
+                    params.corner_factors = corner_factors;
+                    params.terrain_types = 16;
+                }
+                
+                std::vector<Cell> expected(count + 1);
+                const float expected_residual = propagate_cells_row_residual<Cell>(scalar_kernels(), above, row, below, &expected[0], count, params);
+                
+                for (size_t t = 0; t < all_tiers.size(); t++) {
+                    force_simd_tier(all_tiers[t]);
+                    const CellKernelTable<Cell> table = cell_kernels<Cell>();
+                    
+                    std::vector<Cell> actual(count + 1);
+                    table.propagate_row(above, row, below, &actual[0], count, params);
+                    
+                    std::vector<Cell> measured(count + 1);
+                    const float residual = table.propagate_row_residual(above, row, below, &measured[0], count, params);
+                    
+                    INFO( simd_tier_name(all_tiers[t]) << " with " << count << " cells, variant " << variant );
+                    REQUIRE( memcmp(&expected[0], &actual[0], count * sizeof(Cell)) == 0 );
+                    REQUIRE( memcmp(&expected[0], &measured[0], count * sizeof(Cell)) == 0 );
+                    REQUIRE( residual == expected_residual );
+                }
+            }
+        }
+        
+        force_simd_tier(initial);
+    }
+    
+} // namespace
+
+TEST_CASE( "simd tiers are detected and can be forced", "[SimdDispatch]" ) {
+    const SimdTier initial = active_simd_tier();
+    
+    REQUIRE( initial <= detected_simd_tier() );
+    REQUIRE( force_simd_tier(Scalar) == Scalar );
+    REQUIRE( active_simd_tier() == Scalar );
+    REQUIRE( kernels().tier == Scalar );
+    REQUIRE( force_simd_tier(AVX512) == detected_simd_tier() );
+    REQUIRE( kernels().tier == detected_simd_tier() );
+    
+    REQUIRE( strcmp(simd_tier_name(AVX2), "avx2") == 0 );
+    
+    force_simd_tier(initial);
+}
+
+TEST_CASE( "vector propagate kernels match the scalar kernel bit for bit", "[MapKernels]" ) {
+    const std::vector<SimdTier> tiers = vector_tiers();
+    unsigned int state = 12345;
+    
+    for (size_t count = 0; count < 70; count++) {
+        // Three input rows with one readable cell either side.
+        std::vector<float> input(3 * (count + 2));
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = test_value(state);
+        }
+        const float * const above = &input[1];
+        const float * const row = &input[count + 3];
+        const float * const below = &input[2 * count + 5];
+        
+        for (int clamped = 0; clamped < 2; clamped++) {
+            const PropagateRowParams params = { 0.7f, 0.8f, 0.6f, clamped != 0, 0.0f, 1.0f, nullptr, 0, nullptr, nullptr, nullptr, 0, nullptr };
+            
+            std::vector<float> expected(count + 1);
+            scalar_kernels().propagate_row(above, row, below, &expected[0], count, params);
+            
+            for (size_t t = 0; t < tiers.size(); t++) {
+                std::vector<float> actual(count + 1);
+                kernels_for(tiers[t]).propagate_row(above, row, below, &actual[0], count, params);
+                
+                INFO( simd_tier_name(tiers[t]) << " with " << count << " cells, clamped " << clamped );
+                REQUIRE( memcmp(&expected[0], &actual[0], count * sizeof(float)) == 0 );
+            }
+        }
+    }
+}
+
+TEST_CASE( "residual kernels write the same row and report the largest change", "[MapKernels]" ) {
+    const std::vector<SimdTier> tiers = vector_tiers();
+    unsigned int state = 54321;
+    
+    for (size_t count = 0; count < 70; count++) {
+        std::vector<float> input(3 * (count + 2));
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = test_value(state);
+        }
+        const float * const above = &input[1];
+        const float * const row = &input[count + 3];
+        const float * const below = &input[2 * count + 5];
+        
+        for (int clamped = 0; clamped < 2; clamped++) {
+            const PropagateRowParams params = { 0.7f, 0.8f, 0.6f, clamped != 0, 0.0f, 1.0f, nullptr, 0, nullptr, nullptr, nullptr, 0, nullptr };
+            
+            std::vector<float> expected(count + 1);
+            scalar_kernels().propagate_row(above, row, below, &expected[0], count, params);
+            
+            float expected_residual = 0;
+            for (size_t i = 0; i < count; i++) {
+                expected_residual = std::max(expected_residual, fabsf(expected[i] - row[i]));
+            }
+            
+            std::vector<SimdTier> all_tiers(1, Scalar);
+            all_tiers.insert(all_tiers.end(), tiers.begin(), tiers.end());
+            for (size_t t = 0; t < all_tiers.size(); t++) {
+                std::vector<float> actual(count + 1);
+                const float residual = kernels_for(all_tiers[t]).propagate_row_residual(above, row, below, &actual[0], count, params);
+                
+                INFO( simd_tier_name(all_tiers[t]) << " with " << count << " cells, clamped " << clamped );
+                REQUIRE( memcmp(&expected[0], &actual[0], count * sizeof(float)) == 0 );
+                REQUIRE( residual == expected_residual );
+            }
+        }
+    }
+}
+
+TEST_CASE( "masked propagate kernels zero exactly the blocked cells", "[MapKernels]" ) {
+    std::vector<SimdTier> all_tiers(1, Scalar);
+    const std::vector<SimdTier> tiers = vector_tiers();
+    all_tiers.insert(all_tiers.end(), tiers.begin(), tiers.end());
+    unsigned int state = 999;
+    
+    const uint64_t blocked[3] = { 0x8000000000000001ull, 0x00f0f0f0f0f0f0f3ull, 0xffffffffffffffffull };
+    const size_t first_bits[] = { 0, 1, 32, 57, 64, 100 };
+    
+    for (size_t count = 0; count < 70; count++) {
+        std::vector<float> input(3 * (count + 2));
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = test_value(state);
+        }
+        const float * const above = &input[1];
+        const float * const row = &input[count + 3];
+        const float * const below = &input[2 * count + 5];
+        
+        for (size_t b = 0; b < sizeof(first_bits) / sizeof(first_bits[0]); b++) {
+            const size_t first_bit = first_bits[b];
+            if (first_bit + count > 64 * 3) continue;
+            
+            const PropagateRowParams params = { 0.7f, 0.8f, 0.6f, true, 0.0f, 1.0f, nullptr, 0, nullptr, nullptr, nullptr, 0, nullptr };
+            const PropagateRowParams masked = { 0.7f, 0.8f, 0.6f, true, 0.0f, 1.0f, blocked, first_bit, nullptr, nullptr, nullptr, 0, nullptr };
+            
+            std::vector<float> expected(count + 1);
+            scalar_kernels().propagate_row(above, row, below, &expected[0], count, params);
+            for (size_t i = 0; i < count; i++) {
+                const size_t bit = first_bit + i;
+                if ((blocked[bit / 64] >> (bit % 64)) & 1) {
+                    expected[i] = 0.0f;
+                }
+            }
+            
+            for (size_t t = 0; t < all_tiers.size(); t++) {
+                std::vector<float> actual(count + 1);
+                kernels_for(all_tiers[t]).propagate_row(above, row, below, &actual[0], count, masked);
+                
+                std::vector<float> measured(count + 1);
+                kernels_for(all_tiers[t]).propagate_row_residual(above, row, below, &measured[0], count, masked);
+                
+                INFO( simd_tier_name(all_tiers[t]) << " with " << count << " cells from bit " << first_bit );
+                REQUIRE( memcmp(&expected[0], &actual[0], count * sizeof(float)) == 0 );
+                REQUIRE( memcmp(&expected[0], &measured[0], count * sizeof(float)) == 0 );
+            }
+        }
+    }
+}
+
+TEST_CASE( "floored propagate kernels raise cells before clamping them", "[MapKernels]" ) {
+    std::vector<SimdTier> all_tiers(1, Scalar);
+    const std::vector<SimdTier> tiers = vector_tiers();
+    all_tiers.insert(all_tiers.end(), tiers.begin(), tiers.end());
+    unsigned int state = 5150;
+    
+    for (size_t count = 0; count < 70; count++) {
+        std::vector<float> input(3 * (count + 2));
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = test_value(state);
+        }
+        const float * const above = &input[1];
+        const float * const row = &input[count + 3];
+        const float * const below = &input[2 * count + 5];
+        
+        // Cells no emitter covers have a floor of -infinity.
+        std::vector<float> floor(count + 1);
+        for (size_t i = 0; i < count; i++) {
+            floor[i] = i % 3 == 0 ? -INFINITY : test_value(state);
+        }
+        
+        for (int clamped = 0; clamped < 2; clamped++) {
+            const PropagateRowParams params = { 0.7f, 0.8f, 0.6f, false, 0.0f, 1.0f, nullptr, 0, nullptr, nullptr, nullptr, 0, nullptr };
+            const PropagateRowParams floored = { 0.7f, 0.8f, 0.6f, clamped != 0, 0.0f, 1.0f, nullptr, 0, nullptr, nullptr, nullptr, 0, &floor[0] };
+            
+            std::vector<float> expected(count + 1);
+            scalar_kernels().propagate_row(above, row, below, &expected[0], count, params);
+            for (size_t i = 0; i < count; i++) {
+                expected[i] = floor[i] > expected[i] ? floor[i] : expected[i];
+                if (clamped) expected[i] = std::min(std::max(expected[i], 0.0f), 1.0f);
+            }
+            
+            for (size_t t = 0; t < all_tiers.size(); t++) {
+                std::vector<float> actual(count + 1);
+                kernels_for(all_tiers[t]).propagate_row(above, row, below, &actual[0], count, floored);
+                
+                std::vector<float> measured(count + 1);
+                kernels_for(all_tiers[t]).propagate_row_residual(above, row, below, &measured[0], count, floored);
+                
+                INFO( simd_tier_name(all_tiers[t]) << " with " << count << " cells, clamped " << clamped );
+                REQUIRE( memcmp(&expected[0], &actual[0], count * sizeof(float)) == 0 );
+                REQUIRE( memcmp(&expected[0], &measured[0], count * sizeof(float)) == 0 );
+            }
+        }
+    }
+}
+
+TEST_CASE( "terrain propagate kernels look their weights up per cell", "[MapKernels]" ) {
+    std::vector<SimdTier> all_tiers(1, Scalar);
+    const std::vector<SimdTier> tiers = vector_tiers();
+    all_tiers.insert(all_tiers.end(), tiers.begin(), tiers.end());
+    unsigned int state = 4242;
+    
+    float edge_factors[256];
+    float corner_factors[256];
+    for (size_t i = 0; i < 256; i++) {
+        edge_factors[i] = expf(-0.01f * float(i));
+        corner_factors[i] = expf(-0.01414f * float(i));
+    }
+    
+    for (size_t count = 0; count < 70; count++) {
+        std::vector<float> input(3 * (count + 2));
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = test_value(state);
+        }
+        const float * const above = &input[1];
+        const float * const row = &input[count + 3];
+        const float * const below = &input[2 * count + 5];
+        
+        std::vector<uint8_t> terrain(count + 1);
+        for (size_t i = 0; i < count; i++) {
+            terrain[i] = uint8_t(test::next_random(state) >> 24);
+        }
+        
+        // Cell by cell with the uniform kernel and that cell's weights.
+        std::vector<float> expected(count + 1);
+        for (size_t i = 0; i < count; i++) {
+            const PropagateRowParams cell_params = {
+                0.7f, edge_factors[terrain[i]], corner_factors[terrain[i]], true, 0.0f, 1.0f, nullptr, 0, nullptr, nullptr, nullptr, 0, nullptr
+            };
+            scalar_kernels().propagate_row(above + i, row + i, below + i, &expected[i], 1, cell_params);
+        }
+        
+        const PropagateRowParams params = {
+            0.7f, 0.0f, 0.0f, true, 0.0f, 1.0f, nullptr, 0, &terrain[0], edge_factors, corner_factors, 256, nullptr
+        };
+        
+        // The same again with few enough types to look up in registers.
+        std::vector<uint8_t> few_terrain(count + 1);
+        std::vector<float> few_expected(count + 1);
+        for (size_t i = 0; i < count; i++) {
+            few_terrain[i] = terrain[i] % 4;
+            const PropagateRowParams cell_params = {
+                0.7f, edge_factors[few_terrain[i]], corner_factors[few_terrain[i]], true, 0.0f, 1.0f, nullptr, 0, nullptr, nullptr, nullptr, 0, nullptr
+            };
+            scalar_kernels().propagate_row(above + i, row + i, below + i, &few_expected[i], 1, cell_params);
+        }
+        PropagateRowParams few_params = params;
+        few_params.terrain = &few_terrain[0];
+        few_params.terrain_types = 4;
+        
+        for (size_t t = 0; t < all_tiers.size(); t++) {
+            std::vector<float> actual(count + 1);
+            kernels_for(all_tiers[t]).propagate_row(above, row, below, &actual[0], count, params);
+            
+            std::vector<float> measured(count + 1);
+            kernels_for(all_tiers[t]).propagate_row_residual(above, row, below, &measured[0], count, params);
+            
+            std::vector<float> few(count + 1);
+            kernels_for(all_tiers[t]).propagate_row(above, row, below, &few[0], count, few_params);
+            
+            INFO( simd_tier_name(all_tiers[t]) << " with " << count << " cells" );
+            REQUIRE( memcmp(&expected[0], &actual[0], count * sizeof(float)) == 0 );
+            REQUIRE( memcmp(&expected[0], &measured[0], count * sizeof(float)) == 0 );
+            REQUIRE( memcmp(&few_expected[0], &few[0], count * sizeof(float)) == 0 );
+        }
+    }
+}
+
+TEST_CASE( "channel propagate kernels match the single channel kernel per channel", "[MapKernels]" ) {
+    std::vector<SimdTier> all_tiers(1, Scalar);
+    const std::vector<SimdTier> tiers = vector_tiers();
+    all_tiers.insert(all_tiers.end(), tiers.begin(), tiers.end());
+    unsigned int state = 777;
+    
+    const size_t channel_counts[] = { 1, 2, 3, 5, 8, 13, 16 };
+    for (size_t c = 0; c < sizeof(channel_counts) / sizeof(channel_counts[0]); c++) {
+        const size_t channels = channel_counts[c];
+        
+        std::vector<float> momentum(channels + MAX_SIMD_LANES);
+        std::vector<float> edge(channels + MAX_SIMD_LANES);
+        std::vector<float> corner(channels + MAX_SIMD_LANES);
+        for (size_t i = 0; i < momentum.size(); i++) {
+            const size_t channel = i % channels;
+            momentum[i] = 0.3f + 0.05f * float(channel);
+            edge[i] = expf(-0.1f * float(channel));
+            corner[i] = expf(-0.1414f * float(channel));
+        }
+        
+        for (size_t cells = 0; cells < 20; cells++) {
+            // Three rows of interleaved cells with one readable cell either side.
+            const size_t row_floats = (cells + 2) * channels;
+            std::vector<float> input(3 * row_floats);
+            for (size_t i = 0; i < input.size(); i++) {
+                input[i] = test_value(state);
+            }
+            const float * const above = &input[channels];
+            const float * const row = &input[row_floats + channels];
+            const float * const below = &input[2 * row_floats + channels];
+            
+            for (int clamped = 0; clamped < 2; clamped++) {
+                // Each channel on its own through the single channel kernel.
+                std::vector<float> expected(cells * channels + 1);
+                for (size_t channel = 0; channel < channels; channel++) {
+                    std::vector<float> split(3 * (cells + 2));
+                    for (size_t r = 0; r < 3; r++) {
+                        for (size_t x = 0; x < cells + 2; x++) {
+                            split[r * (cells + 2) + x] = input[r * row_floats + x * channels + channel];
+                        }
+                    }
+                    const PropagateRowParams params = {
+                        momentum[channel], edge[channel], corner[channel], clamped != 0, 0.0f, 1.0f, nullptr, 0, nullptr, nullptr, nullptr, 0, nullptr
+                    };
+                    std::vector<float> out(cells + 1);
+                    scalar_kernels().propagate_row(&split[1], &split[cells + 3], &split[2 * cells + 5], &out[0], cells, params);
+                    for (size_t x = 0; x < cells; x++) {
+                        expected[x * channels + channel] = out[x];
+                    }
+                }
+                
+                const PropagateChannelsParams params = {
+                    &momentum[0], &edge[0], &corner[0], channels, 0, clamped != 0, 0.0f, 1.0f
+                };
+                
+                for (size_t t = 0; t < all_tiers.size(); t++) {
+                    std::vector<float> actual(cells * channels + 1);
+                    kernels_for(all_tiers[t]).propagate_channels(above, row, below, &actual[0], cells * channels, params);
+                    
+                    INFO( simd_tier_name(all_tiers[t]) << " with " << cells << " cells of " << channels << " channels, clamped " << clamped );
+                    REQUIRE( memcmp(&expected[0], &actual[0], cells * channels * sizeof(float)) == 0 );
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE( "vector combine and clamp kernels match the scalar kernels", "[MapKernels]" ) {
+    const std::vector<SimdTier> tiers = vector_tiers();
+    const CombineOp ops[] = { CombineAdd, CombineSubtract, CombineMultiply, CombineMin, CombineMax, CombineThreshold };
+    unsigned int state = 999;
+    
+    for (size_t count = 0; count < 70; count++) {
+        std::vector<float> a(count + 1);
+        std::vector<float> b(count + 1);
+        for (size_t i = 0; i < count; i++) {
+            a[i] = test_value(state);
+            b[i] = test_value(state);
+        }
+        if (count > 3) a[count / 2] = NAN;
+        if (count > 5) b[count / 3] = NAN;
+        
+        for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+            std::vector<float> expected(count + 1);
+            scalar_kernels().combine(ops[o], &a[0], &b[0], &expected[0], count);
+            
+            for (size_t t = 0; t < tiers.size(); t++) {
+                std::vector<float> actual(count + 1);
+                kernels_for(tiers[t]).combine(ops[o], &a[0], &b[0], &actual[0], count);
+                
+                INFO( simd_tier_name(tiers[t]) << " with " << count << " cells, op " << ops[o] );
+                REQUIRE( memcmp(&expected[0], &actual[0], count * sizeof(float)) == 0 );
+            }
+        }
+        
+        std::vector<float> expected(count + 1);
+        scalar_kernels().clamp(&a[0], &expected[0], count, 0.0f, 1.0f);
+        
+        for (size_t t = 0; t < tiers.size(); t++) {
+            std::vector<float> actual(a);
+            kernels_for(tiers[t]).clamp(&actual[0], &actual[0], count, 0.0f, 1.0f);
+            
+            INFO( simd_tier_name(tiers[t]) << " clamping " << count << " cells in place" );
+            REQUIRE( memcmp(&expected[0], &actual[0], count * sizeof(float)) == 0 );
+        }
+    }
+}
+
+TEST_CASE( "vector fill and max kernels match the scalar kernels", "[MapKernels]" ) {
+    const std::vector<SimdTier> tiers = vector_tiers();
+    unsigned int state = 54321;
+    
+    for (size_t count = 0; count < 70; count++) {
+        std::vector<float> input(count + 1);
+        for (size_t i = 0; i < count; i++) {
+            input[i] = test_value(state);
+        }
+        if (count > 3) input[count / 2] = NAN;
+        
+        const float expected_max = scalar_kernels().max(&input[0], count, -INFINITY);
+        
+        for (size_t t = 0; t < tiers.size(); t++) {
+            const KernelTable& table = kernels_for(tiers[t]);
+            INFO( simd_tier_name(tiers[t]) << " with " << count << " cells" );
+            
+            REQUIRE( table.max(&input[0], count, -INFINITY) == expected_max );
+            
+            std::vector<float> filled(count + 1, -1.0f);
+            table.fill(&filled[0], count, 0.25f);
+            for (size_t i = 0; i < count; i++) {
+                REQUIRE( filled[i] == 0.25f );
+            }
+            REQUIRE( filled[count] == -1.0f );
+        }
+    }
+}
+
+TEST_CASE( "vector cell conversions match the scalar ones", "[MapKernels]" ) {
+    unsigned int state = 777;
+    
+    // Values either side of every point where a code rounds up, the
+    // special values, and floats of every class.
+    std::vector<float> values;
+    for (int code = 0; code <= 255; code++) {
+        const float midpoint = (float(code) + 0.5f) / 255.0f;
+        values.push_back(midpoint);
+        values.push_back(nextafterf(midpoint, 0.0f));
+        values.push_back(nextafterf(midpoint, 2.0f));
+    }
+    const float specials[] = { 0.0f, -0.0f, 1.0f, nextafterf(1.0f, 0.0f), 2.0f, -1.0f, 65504.0f, 65520.0f, 1e30f, -1e30f, INFINITY, -INFINITY, NAN, -NAN };
+    values.insert(values.end(), specials, specials + sizeof(specials) / sizeof(specials[0]));
+    for (size_t i = 0; i < 4000; i++) {
+        values.push_back(test_bits(state));
+        values.push_back(test_value(state));
+    }
+    
+    std::vector<uint8_t> bytes;
+    std::vector<uint16_t> words;
+    std::vector<Half> halves;
+    for (uint32_t bits = 0; bits <= 0xffff; bits++) {
+        if (bits <= 0xff) bytes.push_back(uint8_t(bits));
+        words.push_back(uint16_t(bits));
+        
+        // Signaling NaNs, which encode never produces, come out of the
+        // hardware conversions quiet.
+        const bool signaling = (bits & 0x7e00) == 0x7c00 && (bits & 0x3ff) != 0;
+        if (!signaling) {
+            const Half half = { uint16_t(bits) };
+            halves.push_back(half);
+        }
+    }
+    
+    SECTION( "uint8_t" ) {
+        require_same_conversions(bytes, values);
+    }
+    SECTION( "uint16_t" ) {
+        require_same_conversions(words, values);
+    }
+    SECTION( "Half" ) {
+        require_same_conversions(halves, values);
+    }
+}
+
+TEST_CASE( "widened cell kernels match the scalar cell kernel bit for bit", "[MapKernels]" ) {
+    SECTION( "uint8_t" ) {
+        require_widened_kernels_match<uint8_t>(1);
+    }
+    SECTION( "uint16_t" ) {
+        require_widened_kernels_match<uint16_t>(2);
+    }
+    SECTION( "Half" ) {
+        require_widened_kernels_match<Half>(3);
+    }
+}
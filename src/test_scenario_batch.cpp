@@ -0,0 +1,150 @@
+#include "catch.hpp"
+#include "scenario_batch.h"
+#include "test_helpers.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace influence_map;
+
+namespace {
+    
+    // A settled map with a few emitters, as a planner would see it.
+    void set_up(InfluenceMap& map, const size_t num_emitters)
+    {
+        map.set_sparse_propagation(true);
+        for (size_t i = 0; i < num_emitters; i++) {
+            const InfluenceMap::StampSource source = {
+                (37 * i + 11) % map.width(), (53 * i + 29) % map.height(), 4, 1.0f, FalloffLinear
+            };
+            map.add_emitter(source);
+        }
+        for (size_t step = 0; step < 300; step++) {
+            map.propagate(0.5f, 1.0f);
+        }
+    }
+    
+    // Candidate plans of a few units each, scattered over the map.
+    std::vector<InfluenceMap::StampSource> plan_sources(const size_t num_scenarios,
+                                                       const size_t units,
+                                                       const size_t width,
+                                                       const size_t height)
+    {
+        std::vector<InfluenceMap::StampSource> sources;
+        unsigned int state = 5;
+        for (size_t i = 0; i < num_scenarios * units; i++) {
+            const unsigned int bits = test::next_random(state);
+            const InfluenceMap::StampSource source = {
+                (bits >> 8) % width, (bits >> 16) % height, 3 + (bits >> 28) % 3, 0.75f, FalloffLinear
+            };
+            sources.push_back(source);
+        }
+        return sources;
+    }
+    
+    std::vector<Scenario> scenarios_for(const std::vector<InfluenceMap::StampSource>& sources, const size_t units)
+    {
+        std::vector<Scenario> scenarios;
+        for (size_t i = 0; i < sources.size(); i += units) {
+            const Scenario scenario = { &sources[i], units, i % 2 == 0 ? StampMax : StampAdd };
+            scenarios.push_back(scenario);
+        }
+        return scenarios;
+    }
+    
+    // How much influence a plan puts over the middle of the map.
+    struct ScoreCentre
+    {
+        float operator()(const InfluenceMapFork& fork) const
+        {
+            float total = 0.0f;
+            for (size_t y = fork.height() / 4; y < 3 * fork.height() / 4; y++) {
+                for (size_t x = fork.width() / 4; x < 3 * fork.width() / 4; x++) {
+                    total += fork.influence(x, y);
+                }
+            }
+            return total;
+        }
+    };
+
+} // namespace
+
+TEST_CASE( "scenario batches score each scenario as a fork of the map would", "[ScenarioBatch]" ) {
+    InfluenceMap map(160, 128, true, 0.0f);
+    set_up(map, 6);
+    
+    const size_t units = 3;
+    const std::vector<InfluenceMap::StampSource> sources = plan_sources(40, units, map.width(), map.height());
+    const std::vector<Scenario> scenarios = scenarios_for(sources, units);
+    
+    std::vector<float> expected;
+    for (size_t i = 0; i < scenarios.size(); i++) {
+        InfluenceMapFork fork(map);
+        fork.stamp_many(scenarios[i].sources, scenarios[i].num_sources, scenarios[i].blend);
+        for (size_t step = 0; step < 4; step++) {
+            fork.propagate(0.5f, 1.0f);
+        }
+        expected.push_back(ScoreCentre()(fork));
+    }
+    
+    ThreadPool pool(4);
+    ScenarioBatch serial;
+    ScenarioBatch parallel(&pool);
+    REQUIRE( parallel.thread_pool() == &pool );
+    
+    // The second round runs on workspaces the first left tiles in.
+    for (size_t round = 0; round < 2; round++) {
+        std::vector<float> serial_scores(scenarios.size(), -1.0f);
+        std::vector<float> parallel_scores(scenarios.size(), -1.0f);
+        serial.evaluate(map, &scenarios[0], scenarios.size(), 4, 0.5f, 1.0f, ScoreCentre(), &serial_scores[0]);
+        parallel.evaluate(map, &scenarios[0], scenarios.size(), 4, 0.5f, 1.0f, ScoreCentre(), &parallel_scores[0]);
+        
+        REQUIRE( serial_scores == expected );
+        REQUIRE( parallel_scores == expected );
+    }
+    
+    // Scenarios that do nothing score the map itself.
+    const Scenario nothing = { nullptr, 0, StampMax };
+    float score = -1.0f;
+    parallel.evaluate(map, &nothing, 1, 0, 0.5f, 1.0f, ScoreCentre(), &score);
+    REQUIRE( score == ScoreCentre()(InfluenceMapFork(map)) );
+}
+
+TEST_CASE( "scenario batch throughput", "[.][benchmark][ScenarioBatch]" ) {
+    typedef std::chrono::steady_clock Clock;
+    
+    InfluenceMap map(1024, 1024, true, 0.0f);
+    set_up(map, 40);
+    
+    const size_t units = 4;
+    const size_t num_scenarios = 2000;
+    const size_t steps = 4;
+    const std::vector<InfluenceMap::StampSource> sources = plan_sources(num_scenarios, units, map.width(), map.height());
+    const std::vector<Scenario> scenarios = scenarios_for(sources, units);
+    
+    // Score only the middle cell, so that the time is all forking and
+    // propagating rather than scoring.
+    struct ScoreMiddleCell
+    {
+        float operator()(const InfluenceMapFork& fork) const
+        {
+            return fork.influence(fork.width() / 2, fork.height() / 2);
+        }
+    };
+    
+    std::vector<float> scores(num_scenarios);
+    const size_t thread_counts[] = { 1, 2, 4, 0 };
+    for (size_t t = 0; t < 4; t++) {
+        ThreadPool pool(thread_counts[t]);
+        ScenarioBatch batch(&pool);
+        batch.evaluate(map, &scenarios[0], 100, steps, 0.5f, 1.0f, ScoreMiddleCell(), &scores[0]);
+        
+        const Clock::time_point start = Clock::now();
+        batch.evaluate(map, &scenarios[0], num_scenarios, steps, 0.5f, 1.0f, ScoreMiddleCell(), &scores[0]);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        
+        std::cout << pool.num_threads() << " threads: " << size_t(num_scenarios / seconds)
+                  << " scenarios/s (" << units << " units, " << steps << " steps, 1024x1024)" << std::endl;
+    }
+}
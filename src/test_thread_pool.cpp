@@ -0,0 +1,39 @@
+#include "catch.hpp"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <vector>
+
+using namespace influence_map;
+
+TEST_CASE( "thread pools run every task exactly once", "[ThreadPool]" ) {
+    const size_t thread_counts[] = { 1, 2, 3, 8 };
+    
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        ThreadPool pool(thread_counts[t]);
+        REQUIRE( pool.num_threads() == thread_counts[t] );
+        
+        // Reuse the same pool many times to shake out hand-over races.
+        for (size_t round = 0; round < 200; round++) {
+            const size_t num_tasks = round % 37;
+            std::vector<std::atomic<int> > runs(num_tasks);
+            for (size_t i = 0; i < num_tasks; i++) {
+                runs[i].store(0);
+            }
+            
+            pool.parallel_for(num_tasks, [&](const size_t task) {
+                runs[task]++;
+            });
+            
+            for (size_t i = 0; i < num_tasks; i++) {
+                REQUIRE( runs[i].load() == 1 );
+            }
+        }
+    }
+}
+
+TEST_CASE( "thread pools default to the hardware thread count", "[ThreadPool]" ) {
+    ThreadPool pool(0);
+    
+    REQUIRE( pool.num_threads() >= 1 );
+}
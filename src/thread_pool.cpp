@@ -0,0 +1,120 @@
+#include "thread_pool.h"
+
+namespace influence_map {
+    
+    ThreadPool::ThreadPool(const size_t num_threads) :
+        _stopping(false), _generation(0), _active_workers(0), _task(nullptr), _context(nullptr), _num_tasks(0), _next_task(0)
+    {
+        size_t threads = num_threads;
+        if (threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        
+        for (size_t i = 1; i < threads; i++) {
+            _workers.push_back(std::thread(&ThreadPool::worker_loop, this));
+        }
+    }
+    
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _work_available.notify_all();
+        
+        for (size_t i = 0; i < _workers.size(); i++) {
+            _workers[i].join();
+        }
+    }
+    
+    size_t ThreadPool::num_threads() const
+    {
+        return _workers.size() + 1;
+    }
+    
+    void ThreadPool::run(const size_t num_tasks, const TaskFn task, void * const context)
+    {
+        if (num_tasks == 0) {
+            return;
+        }
+        
+        if (_workers.empty() || num_tasks == 1) {
+            for (size_t i = 0; i < num_tasks; i++) {
+                task(context, i);
+            }
+            return;
+        }
+        
+        std::lock_guard<std::mutex> run_lock(_run_mutex);
+        
+        {
+            // A worker that woke late for the previous call may still be on its
+            // way out; let it go before _next_task is reset underneath it.
+            std::unique_lock<std::mutex> lock(_mutex);
+            _work_finished.wait(lock, [this] { return _active_workers == 0; });
+            
+            _task = task;
+            _context = context;
+            _num_tasks = num_tasks;
+            _next_task.store(0);
+            _generation++;
+        }
+        _work_available.notify_all();
+        
+        run_tasks(task, context, num_tasks);
+        
+        // Every task has been handed out, but workers may still be running
+        // theirs. Wait for them so none of them is left holding this call's
+        // task when the next call reuses _next_task.
+        std::unique_lock<std::mutex> lock(_mutex);
+        _work_finished.wait(lock, [this] { return _active_workers == 0; });
+    }
+    
+    void ThreadPool::run_tasks(const TaskFn task, void * const context, const size_t num_tasks)
+    {
+        for (;;) {
+            const size_t i = _next_task.fetch_add(1);
+            if (i >= num_tasks) {
+                return;
+            }
+            task(context, i);
+        }
+    }
+    
+    void ThreadPool::worker_loop()
+    {
+        size_t seen_generation = 0;
+        
+        for (;;) {
+            TaskFn task;
+            void* context;
+            size_t num_tasks;
+            
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _work_available.wait(lock, [this, seen_generation] { return _stopping || _generation != seen_generation; });
+                if (_stopping) {
+                    return;
+                }
+                
+                seen_generation = _generation;
+                task = _task;
+                context = _context;
+                num_tasks = _num_tasks;
+                _active_workers++;
+            }
+            
+            run_tasks(task, context, num_tasks);
+            
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _active_workers--;
+                if (_active_workers == 0) {
+                    _work_finished.notify_all();
+                }
+            }
+        }
+    }
+    
+} // namespace influence_map
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace influence_map {
+    
+    /**
+     * A fixed set of worker threads that are started once and then reused for
+     * every parallel operation, so there is no per-call thread creation.
+     *
+     * The thread calling run() always takes part in the work, so a pool of
+     * num_threads has num_threads - 1 background workers.
+     */
+    class ThreadPool
+    {
+    public:
+        typedef void (*TaskFn)(void * const context, const size_t task);
+        
+        /**
+         * A num_threads of 0 uses one thread per hardware thread.
+         */
+        explicit ThreadPool(const size_t num_threads);
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ~ThreadPool();
+        
+        size_t num_threads() const;
+        
+        /**
+         * Calls task(context, i) once for every i in [0, num_tasks), spread over the
+         * pool, and returns when all of them have finished. Tasks are handed out in
+         * order but may finish in any order.
+         *
+         * Calls from several threads at once are safe; they take turns.
+         */
+        void run(const size_t num_tasks, const TaskFn task, void * const context);
+        
+        /**
+         * run() for anything callable as function(size_t task).
+         */
+        template <typename Function>
+        void parallel_for(const size_t num_tasks, const Function& function);
+        
+    private:
+        std::vector<std::thread> _workers;
+        
+        std::mutex _run_mutex;
+        
+        std::mutex _mutex;
+        std::condition_variable _work_available;
+        std::condition_variable _work_finished;
+        
+        // Guarded by _mutex
+        bool _stopping;
+        size_t _generation;
+        size_t _active_workers;
+        TaskFn _task;
+        void* _context;
+        size_t _num_tasks;
+        
+        std::atomic<size_t> _next_task;
+        
+        void worker_loop();
+        void run_tasks(const TaskFn task, void * const context, const size_t num_tasks);
+        
+        template <typename Function>
+        static void invoke(void * const context, const size_t task);
+    };
+    
+    template <typename Function>
+    void ThreadPool::parallel_for(const size_t num_tasks, const Function& function)
+    {
+        run(num_tasks, &ThreadPool::invoke<Function>, const_cast<void*>(static_cast<const void*>(&function)));
+    }
+    
+    template <typename Function>
+    void ThreadPool::invoke(void * const context, const size_t task)
+    {
+        (*static_cast<const Function*>(context))(task);
+    }
+    
+} // namespace influence_map